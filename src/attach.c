@@ -0,0 +1,144 @@
+#define _DEFAULT_SOURCE
+
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "export.h"
+
+
+// Gives up on a frame after this many torn reads in a row
+#define ATTACH_RETRIES 1000
+
+
+const struct export_shared *attach(const char *name) {
+    int fd = shm_open(name, O_RDONLY, 0);
+    if (fd < 0) {
+        fprintf(stderr, "Unable to open shared memory %s\n", name);
+        exit(EXIT_FAILURE);
+    }
+
+    const struct export_shared *shared = mmap(NULL, sizeof(struct export_shared), PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (shared == MAP_FAILED) {
+        fprintf(stderr, "Unable to map shared memory %s\n", name);
+        exit(EXIT_FAILURE);
+    }
+
+    if (memcmp(shared->magic, EXPORT_MAGIC, sizeof(EXPORT_MAGIC)) != 0 || shared->version != EXPORT_VERSION || shared->size != sizeof(struct export_shared)) {
+        fprintf(stderr, "%s is not a cnes export of this version\n", name);
+        exit(EXIT_FAILURE);
+    }
+
+    return shared;
+}
+
+void read_frame(const struct export_shared *shared, struct export_shared *copy) {
+    for (int i = 0; i < ATTACH_RETRIES; i++) {
+        if (export_read(shared, copy)) return;
+        usleep(100);
+    }
+
+    fprintf(stderr, "The emulator kept writing, no consistent frame was read\n");
+    exit(EXIT_FAILURE);
+}
+
+void print_frame(const struct export_shared *frame) {
+    const struct export_cpu *cpu = &frame->cpu;
+    printf("frame %lu cycle %lu PC:%04X A:%02X X:%02X Y:%02X S:%02X P:%02X buttons %02X %02X\n",
+            frame->frame, cpu->cycles, cpu->pc, cpu->a, cpu->x, cpu->y, cpu->s, cpu->p, frame->buttons[0], frame->buttons[1]);
+}
+
+void send_command(const char *path, const char *command) {
+    struct sockaddr_un address = { .sun_family = AF_UNIX };
+    if (strlen(path) >= sizeof(address.sun_path)) {
+        fprintf(stderr, "Control socket path is too long: %s\n", path);
+        exit(EXIT_FAILURE);
+    }
+    strcpy(address.sun_path, path);
+
+    int fd = socket(AF_UNIX, SOCK_DGRAM, 0);
+    if (fd < 0 || sendto(fd, command, strlen(command), 0, (struct sockaddr *)&address, sizeof(address)) < 0) {
+        fprintf(stderr, "Unable to send to control socket %s\n", path);
+        exit(EXIT_FAILURE);
+    }
+    close(fd);
+}
+
+
+int main(int argc, char **argv) {
+    const char *name = NULL;
+    const char *control = NULL;
+    int port = -1;
+    int buttons = 0;
+    int watch = 0;
+    bool dump = false;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--control") == 0 && i + 1 < argc) {
+            control = argv[++i];
+        } else if (strcmp(argv[i], "--buttons") == 0 && i + 2 < argc) {
+            port = atoi(argv[++i]);
+            buttons = strtol(argv[++i], NULL, 0);
+        } else if (strcmp(argv[i], "--watch") == 0 && i + 1 < argc) {
+            watch = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--ram") == 0) {
+            dump = true;
+        } else if (name == NULL && argv[i][0] != '-') {
+            name = argv[i];
+        } else {
+            name = NULL;
+            control = NULL;
+            break;
+        }
+    }
+
+    if ((name == NULL && control == NULL) || (port >= 0) != (control != NULL)) {
+        fprintf(stderr, "Usage: %s [--watch FRAMES] [--ram] [--control SOCKET --buttons PORT MASK] [SHM_NAME]\n", argv[0]);
+        fprintf(stderr, "Reads a running emulator's --export and sends input to its --control socket\n");
+        exit(EXIT_FAILURE);
+    }
+
+    if (control != NULL) {
+        char command[64];
+        snprintf(command, sizeof(command), "buttons %d %d\n", port, buttons);
+        send_command(control, command);
+    }
+
+    if (name == NULL) {
+        return EXIT_SUCCESS;
+    }
+
+    const struct export_shared *shared = attach(name);
+    static struct export_shared frame;
+    read_frame(shared, &frame);
+    print_frame(&frame);
+
+    // Polls for new frames, a reader never holds anything the emulator waits on
+    for (uint64_t last = frame.frame; watch > 0; usleep(1000)) {
+        read_frame(shared, &frame);
+        if (frame.frame == last) continue;
+
+        last = frame.frame;
+        print_frame(&frame);
+        watch--;
+    }
+
+    if (dump) {
+        for (int row = 0; row < 0x800; row += 16) {
+            printf("%04X:", row);
+            for (int i = 0; i < 16; i++) {
+                printf(" %02X", frame.ram[row + i]);
+            }
+            printf("\n");
+        }
+    }
+
+    return EXIT_SUCCESS;
+}
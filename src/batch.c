@@ -0,0 +1,889 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "nes.h"
+#include "batch.h"
+
+
+#define lane_warning(b, lane, format, ...) do { if (!state.quiet) fprintf(stderr, "WARNING [CYCLE %04lX PC %04X LANE %d]: " format, b->cycles[lane], b->pc[lane], lane, ##__VA_ARGS__); } while (0)
+
+
+static uint8_t with_nz(uint8_t p, uint8_t value) {
+    return (p & ~((1 << NEGATIVE) | (1 << ZERO))) | (value & (1 << NEGATIVE)) | (value == 0 ? 1 << ZERO : 0);
+}
+
+static uint8_t with_flag(uint8_t p, enum flag flag, bool value) {
+    return (p & ~(1 << flag)) | (value ? 1 << flag : 0);
+}
+
+static uint8_t rom_read(uint16_t address) {
+    return cartridge.prg_rom[(address - 0x8000) & (cartridge.header.prg_size == 1 ? 0x3fff : 0x7fff)];
+}
+
+static bool branch_taken(enum instruction_name name, uint8_t p) {
+    switch (name) {
+        case BCC: return !(p & 1 << CARRY);
+        case BCS: return p & 1 << CARRY;
+        case BEQ: return p & 1 << ZERO;
+        case BNE: return !(p & 1 << ZERO);
+        case BMI: return p & 1 << NEGATIVE;
+        case BPL: return !(p & 1 << NEGATIVE);
+        case BVC: return !(p & 1 << OVERFLOW);
+        default: return p & 1 << OVERFLOW;
+    }
+}
+
+
+// The scalar path, a copy of the interpreter working on one lane's state
+
+static uint8_t lane_controller(struct batch *b, int lane, int port) {
+    if (b->strobe[lane]) {
+        return b->buttons[port][lane] & 1;
+    }
+
+    uint8_t data = b->shift[port][lane] & 1;
+    b->shift[port][lane] = (b->shift[port][lane] >> 1) | 0x80;
+    return data;
+}
+
+static uint8_t lane_read(struct batch *b, int lane, uint16_t address) {
+    if (address < 0x2000) {
+        return b->ram[address & 0x07ff][lane];
+    } else if (address >= 0x8000) {
+        return rom_read(address);
+    } else if (address >= 0x6000) {
+        return b->prg_ram[address - 0x6000][lane];
+    } else if (address < 0x4000) {
+        return ppu_read_register(&b->ppu[lane], address);
+    } else if (address == 0x4016 || address == 0x4017) {
+        return 0x40 | lane_controller(b, lane, address - 0x4016);
+    }
+
+    lane_warning(b, lane, "Read from unmapped address: 0x%04X\n", address);
+    return 0;
+}
+
+static uint16_t lane_read_16(struct batch *b, int lane, uint16_t address) {
+    uint8_t low = lane_read(b, lane, address);
+    return low | lane_read(b, lane, address + 1) << 8;
+}
+
+static void lane_write(struct batch *b, int lane, uint16_t address, uint8_t data) {
+    if (address < 0x2000) {
+        b->ram[address & 0x07ff][lane] = data;
+    } else if (address >= 0x8000) {
+        // NROM has no registers, writes to ROM are dropped
+    } else if (address >= 0x6000) {
+        b->prg_ram[address - 0x6000][lane] = data;
+    } else if (address < 0x4000) {
+        ppu_write_register(&b->ppu[lane], address, data);
+    } else if (address == 0x4014) {
+        for (int i = 0; i < 256; i++) {
+            b->ppu[lane].oam[(b->ppu[lane].oam_address + i) & 0xff] = lane_read(b, lane, data << 8 | i);
+        }
+    } else if (address == 0x4016) {
+        b->strobe[lane] = data & 1;
+        if (b->strobe[lane]) {
+            b->shift[0][lane] = b->buttons[0][lane];
+            b->shift[1][lane] = b->buttons[1][lane];
+        }
+    } else {
+        lane_warning(b, lane, "Write to unmapped address: $%04X with data: #$%02X\n", address, data);
+    }
+}
+
+static void lane_push(struct batch *b, int lane, uint8_t data) {
+    b->ram[0x0100 + b->s[lane]--][lane] = data;
+}
+
+static uint8_t lane_pop(struct batch *b, int lane) {
+    return b->ram[0x0100 + ++b->s[lane]][lane];
+}
+
+// Same reads in the same order as read_operand(), they matter when code runs from the controller ports
+static uint16_t lane_operand(struct batch *b, int lane, enum address_mode mode) {
+    uint16_t pc = b->pc[lane];
+    uint8_t operand_8 = lane_read(b, lane, pc + 1);
+    uint16_t operand_16 = lane_read_16(b, lane, pc + 1);
+    uint8_t x = b->x[lane];
+    uint8_t y = b->y[lane];
+
+    switch (mode) {
+        case IMMEDIATE:
+        case RELATIVE:
+            return pc + 1;
+        case ZERO_PAGE:
+            return operand_8;
+        case ABSOLUTE:
+            return operand_16;
+        case INDIRECT:
+            return lane_read(b, lane, operand_16) + 256 * lane_read(b, lane, (operand_16 & 0xff00) | (((operand_16 & 0xff) + 1) % 256));
+        case ZERO_PAGE_X:
+            return (operand_8 + x) % 256;
+        case ZERO_PAGE_Y:
+            return (operand_8 + y) % 256;
+        case ABSOLUTE_X:
+            return operand_16 + x;
+        case ABSOLUTE_Y:
+            return operand_16 + y;
+        case INDEXED_INDIRECT:
+            return lane_read(b, lane, (operand_8 + x) % 256) + 256 * lane_read(b, lane, (operand_8 + x + 1) % 256);
+        case INDIRECT_INDEXED:
+            return lane_read(b, lane, operand_8) + 256 * lane_read(b, lane, (operand_8 + 1) % 256) + y;
+        default:
+            return 0;
+    }
+}
+
+static bool lane_page_cross(struct batch *b, int lane, enum address_mode mode) {
+    uint16_t pc = b->pc[lane];
+
+    switch (mode) {
+        case ABSOLUTE_X:
+            return (lane_read_16(b, lane, pc + 1) & 0xff) + b->x[lane] > 0xff;
+        case ABSOLUTE_Y:
+            return (lane_read_16(b, lane, pc + 1) & 0xff) + b->y[lane] > 0xff;
+        case INDIRECT_INDEXED:
+            return ((lane_read_16(b, lane, lane_read(b, lane, pc + 1)) & 0xff) + b->y[lane]) > 0xff;
+        default:
+            return false;
+    }
+}
+
+// Returns the instruction's cycles like execute_next(), or 0 when the lane stopped at an undocumented opcode
+static int run_lane(struct batch *b, int lane) {
+    uint16_t pc = b->pc[lane];
+    uint8_t opcode = lane_read(b, lane, pc);
+
+    enum instruction_name name = INSTRUCTION_LOOKUP[opcode];
+    enum address_mode mode = ADDRESS_MODE_LOOKUP[opcode];
+
+    if (name == INSTRUCTION_NONE) {
+        lane_warning(b, lane, "Stopped at undocumented opcode: #$%02X\n", opcode);
+        b->halted[lane] = true;
+        return 0;
+    }
+
+    int cycles = INSTRUCTION_CYCLES[name] + ADDRESS_MODE_CYCLES[mode];
+    uint16_t address = lane_operand(b, lane, mode);
+    uint16_t next = pc;
+
+    uint8_t *a = &b->a[lane];
+    uint8_t *x = &b->x[lane];
+    uint8_t *y = &b->y[lane];
+    uint8_t *p = &b->p[lane];
+    uint8_t *reg = name == LDX || name == STX || name == CPX || name == INX || name == DEX ? x :
+                   name == LDY || name == STY || name == CPY || name == INY || name == DEY ? y : a;
+    uint8_t data, value, initial;
+    int result;
+
+    switch (name) {
+        case ADC: case SBC:
+            data = lane_read(b, lane, address);
+            data = name == SBC ? ~data : data;
+            result = *a + data + (*p & 1 << CARRY ? 1 : 0);
+            *p = with_flag(*p, CARRY, result > 0xff);
+            *p = with_flag(*p, OVERFLOW, ~(*a ^ data) & (*a ^ result) & 0x80);
+            *a = result;
+            *p = with_nz(*p, *a);
+            break;
+        case AND:
+            *a &= lane_read(b, lane, address);
+            *p = with_nz(*p, *a);
+            break;
+        case ORA:
+            *a |= lane_read(b, lane, address);
+            *p = with_nz(*p, *a);
+            break;
+        case EOR:
+            *a ^= lane_read(b, lane, address);
+            *p = with_nz(*p, *a);
+            break;
+        case ASL: case LSR: case ROL: case ROR:
+            data = mode == ACCUMULATOR ? *a : lane_read(b, lane, address);
+            initial = *p & 1 << CARRY ? 1 : 0;
+            if (name == ASL || name == ROL) {
+                value = data << 1 | (name == ROL ? initial : 0);
+                *p = with_flag(*p, CARRY, data & 0x80);
+            } else {
+                value = data >> 1 | (name == ROR ? initial << 7 : 0);
+                *p = with_flag(*p, CARRY, data & 1);
+            }
+            *p = with_nz(*p, value);
+            if (mode == ACCUMULATOR) {
+                *a = value;
+            } else {
+                lane_write(b, lane, address, value);
+                cycles += mode == ABSOLUTE_X ? 3 : 2;
+            }
+            break;
+        case BCC: case BCS: case BEQ: case BMI: case BNE: case BPL: case BVC: case BVS:
+            if (branch_taken(name, *p)) {
+                next = pc + (int8_t)lane_read(b, lane, address) + 2;
+                cycles += 1;
+            }
+            if (name != BEQ && next >> 8 != pc >> 8) {
+                cycles += 2;
+            }
+            break;
+        case BIT:
+            data = lane_read(b, lane, address);
+            *p = with_flag(*p, ZERO, (*a & data) == 0);
+            *p = with_flag(*p, OVERFLOW, data & 0x40);
+            *p = with_flag(*p, NEGATIVE, data & 0x80);
+            break;
+        case BRK:
+            lane_push(b, lane, pc >> 8);
+            lane_push(b, lane, pc & 0xff);
+            lane_push(b, lane, *p);
+            next = lane_read_16(b, lane, IRQ_VECTOR);
+            *p = with_flag(*p, BREAK, true);
+            break;
+        case CLC: case SEC:
+            *p = with_flag(*p, CARRY, name == SEC);
+            break;
+        case CLD: case SED:
+            *p = with_flag(*p, DECIMAL, name == SED);
+            break;
+        case CLI: case SEI:
+            *p = with_flag(*p, INTERRUPT, name == SEI);
+            break;
+        case CLV:
+            *p = with_flag(*p, OVERFLOW, false);
+            break;
+        case CMP: case CPX: case CPY:
+            data = lane_read(b, lane, address);
+            *p = with_flag(*p, CARRY, *reg >= data);
+            *p = with_nz(*p, *reg - data);
+            break;
+        case DEC: case INC:
+            value = lane_read(b, lane, address) + (name == INC ? 1 : -1);
+            *p = with_nz(*p, value);
+            lane_write(b, lane, address, value);
+            cycles += mode == ABSOLUTE_X ? 1 : 0;
+            break;
+        case DEX: case DEY:
+            *reg -= 1;
+            *p = with_nz(*p, *reg);
+            break;
+        case INX: case INY:
+            *reg += 1;
+            *p = with_nz(*p, *reg);
+            break;
+        case JMP:
+            next = address;
+            break;
+        case JSR:
+            lane_push(b, lane, (pc + 2) >> 8);
+            lane_push(b, lane, (pc + 2) & 0xff);
+            next = address;
+            break;
+        case LDA: case LDX: case LDY:
+            *reg = lane_read(b, lane, address);
+            *p = with_nz(*p, *reg);
+            if (name == LDA && (mode == ABSOLUTE_X || mode == ABSOLUTE_Y || mode == INDIRECT_INDEXED) && lane_page_cross(b, lane, mode)) {
+                cycles += 1;
+            } else if (name == LDX && mode == ABSOLUTE_Y && lane_page_cross(b, lane, mode)) {
+                cycles += 1;
+            } else if (name == LDY && mode == ABSOLUTE_X && lane_page_cross(b, lane, mode)) {
+                cycles += 1;
+            }
+            break;
+        case NOP:
+            break;
+        case PHA:
+            lane_push(b, lane, *a);
+            break;
+        case PHP:
+            lane_push(b, lane, *p | 1 << BREAK);
+            break;
+        case PLA:
+            *a = lane_pop(b, lane);
+            *p = with_nz(*p, *a);
+            break;
+        case PLP:
+            initial = *p;
+            *p = lane_pop(b, lane) | 1 << ONE;
+            *p = with_flag(*p, BREAK, initial & 1 << BREAK);
+            break;
+        case RTI:
+            *p = lane_pop(b, lane) | 1 << ONE;
+            data = lane_pop(b, lane);
+            next = data | lane_pop(b, lane) << 8;
+            break;
+        case RTS:
+            data = lane_pop(b, lane);
+            next = (data | lane_pop(b, lane) << 8) + 1;
+            break;
+        case STA: case STX: case STY:
+            lane_write(b, lane, address, *reg);
+            if (name == STA && (mode == ABSOLUTE_X || mode == ABSOLUTE_Y || mode == INDIRECT_INDEXED)) {
+                cycles += 1;
+            }
+            break;
+        case TAX:
+            *x = *a;
+            *p = with_nz(*p, *x);
+            break;
+        case TAY:
+            *y = *a;
+            *p = with_nz(*p, *y);
+            break;
+        case TSX:
+            *x = b->s[lane];
+            *p = with_nz(*p, *x);
+            break;
+        case TXA:
+            *a = *x;
+            *p = with_nz(*p, *a);
+            break;
+        case TXS:
+            b->s[lane] = *x;
+            break;
+        case TYA:
+            *a = *y;
+            *p = with_nz(*p, *a);
+            break;
+        default:
+            break;
+    }
+
+    // Jumps and branches to themselves still move on, like in execute_next()
+    if (next == pc) {
+        next += instruction_length(mode);
+    }
+    b->pc[lane] = next;
+
+    return cycles;
+}
+
+
+// The SIMD path. Every loop runs over all BATCH_LANES lanes and blends its result
+// with the old value for lanes outside the group, so the compiler can vectorize it.
+// Indexed operands and the stack turn into per-lane gathers and scatters.
+#define SELECT(field, value) b->field[lane] = mask[lane] ? (value) : b->field[lane]
+#define LANES for (int lane = 0; lane < BATCH_LANES; lane++)
+
+// With GCC on x86-64 the vector path is built for AVX-512 and AVX2 as well as the
+// baseline, and the dynamic loader picks the widest the CPU has. Elsewhere it is built
+// once, for the baseline.
+#if defined(__GNUC__) && !defined(__clang__) && defined(__x86_64__) && defined(__ELF__)
+#define LANE_KERNEL __attribute__((target_clones("arch=x86-64-v4", "avx2", "default")))
+
+static const char *lane_instructions() {
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("x86-64-v4") ? "AVX-512" : __builtin_cpu_supports("avx2") ? "AVX2" : "SSE2";
+}
+#else
+#define LANE_KERNEL
+
+static const char *lane_instructions() {
+    return "baseline";
+}
+#endif
+
+// Memory without side effects, which lane_read(b, ) and lane_write(b, ) can touch in any order
+static bool plain_memory(uint16_t address) {
+    return address < 0x2000 || address >= 0x6000;
+}
+
+// Runs one instruction for every lane in mask. Returns false, before changing anything,
+// for BRK, JMP indirect and any lane touching the controllers or unmapped addresses,
+// which then take the scalar path.
+LANE_KERNEL
+static bool run_vector(struct batch *b, uint16_t pc, const uint8_t *mask) {
+    uint8_t opcode = rom_read(pc);
+    enum instruction_name name = INSTRUCTION_LOOKUP[opcode];
+    enum address_mode mode = ADDRESS_MODE_LOOKUP[opcode];
+
+    // Operands past $FFFF would come from each lane's RAM
+    if (name == INSTRUCTION_NONE || name == BRK || mode == INDIRECT || pc > 0xfffd) {
+        return false;
+    }
+
+    uint8_t operand_8 = rom_read(pc + 1);
+    uint16_t operand_16 = operand_8 | rom_read(pc + 2) << 8;
+    uint16_t length = instruction_length(mode);
+
+    // The effective address per lane, and whether indexing crossed a page
+    uint16_t where[BATCH_LANES];
+    bool crossed[BATCH_LANES];
+    bool uniform = false;
+    uint16_t address = 0;
+
+    switch (mode) {
+        case ZERO_PAGE_X:
+        case ZERO_PAGE_Y:
+            LANES {
+                where[lane] = (operand_8 + (mode == ZERO_PAGE_X ? b->x[lane] : b->y[lane])) & 0xff;
+                crossed[lane] = false;
+            }
+            break;
+        case ABSOLUTE_X:
+        case ABSOLUTE_Y:
+            LANES {
+                uint8_t index = mode == ABSOLUTE_X ? b->x[lane] : b->y[lane];
+                where[lane] = operand_16 + index;
+                crossed[lane] = operand_8 + index > 0xff;
+            }
+            break;
+        case INDEXED_INDIRECT:
+            LANES {
+                uint8_t pointer = operand_8 + b->x[lane];
+                where[lane] = b->ram[pointer][lane] | b->ram[(uint8_t)(pointer + 1)][lane] << 8;
+                crossed[lane] = false;
+            }
+            break;
+        case INDIRECT_INDEXED:
+            LANES {
+                uint8_t low = b->ram[operand_8][lane];
+                where[lane] = (low | b->ram[(uint8_t)(operand_8 + 1)][lane] << 8) + b->y[lane];
+                crossed[lane] = low + b->y[lane] > 0xff;
+            }
+            break;
+        default:
+            uniform = true;
+            address = mode == IMMEDIATE || mode == RELATIVE ? pc + 1 : mode == ZERO_PAGE ? operand_8 : operand_16;
+            LANES {
+                crossed[lane] = false;
+            }
+            break;
+    }
+
+    bool memory = mode != IMPLICIT && mode != ACCUMULATOR && mode != IMMEDIATE && mode != RELATIVE && name != JMP && name != JSR;
+    if (memory && uniform && !plain_memory(address)) {
+        return false;
+    } else if (memory && !uniform) {
+        LANES {
+            if (mask[lane] && !plain_memory(where[lane])) {
+                return false;
+            }
+        }
+    }
+
+    // A column of one byte per lane for memory at a shared address, a single value for ROM and immediates
+    uint8_t value[BATCH_LANES];
+    uint8_t *column = NULL;
+    if (uniform) {
+        uint8_t constant = 0;
+        if (!memory || address >= 0x8000) {
+            constant = mode == IMMEDIATE || mode == RELATIVE || memory ? rom_read(address) : 0;
+        } else {
+            column = address < 0x2000 ? b->ram[address & 0x07ff] : b->prg_ram[address - 0x6000];
+        }
+        LANES {
+            value[lane] = column != NULL ? column[lane] : constant;
+        }
+    } else {
+        LANES {
+            value[lane] = mask[lane] ? lane_read(b, lane, where[lane]) : 0;
+        }
+    }
+
+    int cycles = INSTRUCTION_CYCLES[name] + ADDRESS_MODE_CYCLES[mode];
+    uint8_t extra[BATCH_LANES] = { 0 };
+    uint16_t next[BATCH_LANES];
+    bool write = false;
+
+    LANES {
+        next[lane] = pc + length;
+    }
+
+    switch (name) {
+        case ADC: case SBC:
+            LANES {
+                uint8_t data = name == SBC ? ~value[lane] : value[lane];
+                int result = b->a[lane] + data + (b->p[lane] & 1);
+                uint8_t p = with_flag(b->p[lane], CARRY, result > 0xff);
+                p = with_flag(p, OVERFLOW, ~(b->a[lane] ^ data) & (b->a[lane] ^ result) & 0x80);
+                SELECT(p, with_nz(p, result));
+                SELECT(a, result);
+            }
+            break;
+        case AND:
+            LANES {
+                SELECT(p, with_nz(b->p[lane], b->a[lane] & value[lane]));
+                SELECT(a, b->a[lane] & value[lane]);
+            }
+            break;
+        case ORA:
+            LANES {
+                SELECT(p, with_nz(b->p[lane], b->a[lane] | value[lane]));
+                SELECT(a, b->a[lane] | value[lane]);
+            }
+            break;
+        case EOR:
+            LANES {
+                SELECT(p, with_nz(b->p[lane], b->a[lane] ^ value[lane]));
+                SELECT(a, b->a[lane] ^ value[lane]);
+            }
+            break;
+        case ASL: case LSR: case ROL: case ROR:
+            LANES {
+                uint8_t data = mode == ACCUMULATOR ? b->a[lane] : value[lane];
+                uint8_t carry = b->p[lane] & 1;
+                uint8_t result = name == ASL ? data << 1 : name == ROL ? data << 1 | carry :
+                                 name == LSR ? data >> 1 : data >> 1 | carry << 7;
+                bool out = name == ASL || name == ROL ? data & 0x80 : data & 1;
+                SELECT(p, with_nz(with_flag(b->p[lane], CARRY, out), result));
+                if (mode == ACCUMULATOR) {
+                    SELECT(a, result);
+                } else {
+                    value[lane] = result;
+                }
+            }
+            write = mode != ACCUMULATOR;
+            cycles += mode == ACCUMULATOR ? 0 : mode == ABSOLUTE_X ? 3 : 2;
+            break;
+        case BIT:
+            LANES {
+                uint8_t p = with_flag(b->p[lane], ZERO, (b->a[lane] & value[lane]) == 0);
+                p = (p & 0x3f) | (value[lane] & 0xc0);
+                SELECT(p, p);
+            }
+            break;
+        case CLC: case SEC: case CLD: case SED: case CLI: case SEI: case CLV:
+            LANES {
+                enum flag flag = name == CLC || name == SEC ? CARRY : name == CLD || name == SED ? DECIMAL :
+                                 name == CLI || name == SEI ? INTERRUPT : OVERFLOW;
+                SELECT(p, with_flag(b->p[lane], flag, name == SEC || name == SED || name == SEI));
+            }
+            break;
+        case CMP:
+            LANES {
+                SELECT(p, with_nz(with_flag(b->p[lane], CARRY, b->a[lane] >= value[lane]), b->a[lane] - value[lane]));
+            }
+            break;
+        case CPX:
+            LANES {
+                SELECT(p, with_nz(with_flag(b->p[lane], CARRY, b->x[lane] >= value[lane]), b->x[lane] - value[lane]));
+            }
+            break;
+        case CPY:
+            LANES {
+                SELECT(p, with_nz(with_flag(b->p[lane], CARRY, b->y[lane] >= value[lane]), b->y[lane] - value[lane]));
+            }
+            break;
+        case DEC: case INC:
+            LANES {
+                value[lane] += name == INC ? 1 : -1;
+                SELECT(p, with_nz(b->p[lane], value[lane]));
+            }
+            write = true;
+            cycles += mode == ABSOLUTE_X ? 1 : 0;
+            break;
+        case DEX: case INX:
+            LANES {
+                uint8_t result = b->x[lane] + (name == INX ? 1 : -1);
+                SELECT(p, with_nz(b->p[lane], result));
+                SELECT(x, result);
+            }
+            break;
+        case DEY: case INY:
+            LANES {
+                uint8_t result = b->y[lane] + (name == INY ? 1 : -1);
+                SELECT(p, with_nz(b->p[lane], result));
+                SELECT(y, result);
+            }
+            break;
+        case LDA:
+            LANES {
+                SELECT(p, with_nz(b->p[lane], value[lane]));
+                SELECT(a, value[lane]);
+                extra[lane] = (mode == ABSOLUTE_X || mode == ABSOLUTE_Y || mode == INDIRECT_INDEXED) && crossed[lane];
+            }
+            break;
+        case LDX:
+            LANES {
+                SELECT(p, with_nz(b->p[lane], value[lane]));
+                SELECT(x, value[lane]);
+                extra[lane] = mode == ABSOLUTE_Y && crossed[lane];
+            }
+            break;
+        case LDY:
+            LANES {
+                SELECT(p, with_nz(b->p[lane], value[lane]));
+                SELECT(y, value[lane]);
+                extra[lane] = mode == ABSOLUTE_X && crossed[lane];
+            }
+            break;
+        case STA: case STX: case STY:
+            LANES {
+                value[lane] = name == STA ? b->a[lane] : name == STX ? b->x[lane] : b->y[lane];
+            }
+            write = true;
+            cycles += name == STA && (mode == ABSOLUTE_X || mode == ABSOLUTE_Y || mode == INDIRECT_INDEXED) ? 1 : 0;
+            break;
+        case TAX: case TSX:
+            LANES {
+                uint8_t result = name == TAX ? b->a[lane] : b->s[lane];
+                SELECT(p, with_nz(b->p[lane], result));
+                SELECT(x, result);
+            }
+            break;
+        case TAY:
+            LANES {
+                SELECT(p, with_nz(b->p[lane], b->a[lane]));
+                SELECT(y, b->a[lane]);
+            }
+            break;
+        case TXA: case TYA:
+            LANES {
+                uint8_t result = name == TXA ? b->x[lane] : b->y[lane];
+                SELECT(p, with_nz(b->p[lane], result));
+                SELECT(a, result);
+            }
+            break;
+        case TXS:
+            LANES {
+                SELECT(s, b->x[lane]);
+            }
+            break;
+        case PHA: case PHP:
+            LANES {
+                uint8_t *slot = &b->ram[0x0100 + b->s[lane]][lane];
+                *slot = mask[lane] ? (name == PHA ? b->a[lane] : b->p[lane] | 1 << BREAK) : *slot;
+                SELECT(s, b->s[lane] - 1);
+            }
+            break;
+        case PLA:
+            LANES {
+                uint8_t data = b->ram[0x0100 + (uint8_t)(b->s[lane] + 1)][lane];
+                SELECT(s, b->s[lane] + 1);
+                SELECT(p, with_nz(b->p[lane], data));
+                SELECT(a, data);
+            }
+            break;
+        case PLP:
+            LANES {
+                uint8_t data = b->ram[0x0100 + (uint8_t)(b->s[lane] + 1)][lane] | 1 << ONE;
+                SELECT(s, b->s[lane] + 1);
+                SELECT(p, (data & ~(1 << BREAK)) | (b->p[lane] & 1 << BREAK));
+            }
+            break;
+        case JSR:
+            LANES {
+                uint8_t *high = &b->ram[0x0100 + b->s[lane]][lane];
+                *high = mask[lane] ? (pc + 2) >> 8 : *high;
+                uint8_t *low = &b->ram[0x0100 + (uint8_t)(b->s[lane] - 1)][lane];
+                *low = mask[lane] ? (pc + 2) & 0xff : *low;
+                SELECT(s, b->s[lane] - 2);
+                next[lane] = operand_16;
+            }
+            break;
+        case RTS: case RTI:
+            LANES {
+                uint8_t s = b->s[lane];
+                if (name == RTI) {
+                    SELECT(p, b->ram[0x0100 + (uint8_t)++s][lane] | 1 << ONE);
+                }
+                uint8_t low = b->ram[0x0100 + (uint8_t)++s][lane];
+                uint8_t high = b->ram[0x0100 + (uint8_t)++s][lane];
+                SELECT(s, s);
+                next[lane] = (low | high << 8) + (name == RTS ? 1 : 0);
+            }
+            break;
+        case JMP:
+            LANES {
+                next[lane] = operand_16;
+            }
+            break;
+        case BCC: case BCS: case BEQ: case BMI: case BNE: case BPL: case BVC: case BVS: {
+            uint16_t target = pc + (int8_t)operand_8 + 2;
+            uint8_t taken_extra = 1 + (name != BEQ && target >> 8 != pc >> 8 ? 2 : 0);
+            LANES {
+                bool taken = branch_taken(name, b->p[lane]);
+                next[lane] = taken ? target : pc + 2;
+                extra[lane] = taken ? taken_extra : 0;
+            }
+            break;
+        }
+        default:
+            break;
+    }
+
+    // Writes to ROM are dropped
+    if (write && uniform && column != NULL) {
+        LANES {
+            column[lane] = mask[lane] ? value[lane] : column[lane];
+        }
+    } else if (write && !uniform) {
+        LANES {
+            if (mask[lane]) {
+                lane_write(b, lane, where[lane], value[lane]);
+            }
+        }
+    }
+
+    // Jumps and branches to themselves still move on, like in execute_next()
+    LANES {
+        SELECT(cycles, b->cycles[lane] + cycles + extra[lane]);
+        SELECT(pc, next[lane] == pc ? pc + length : next[lane]);
+    }
+
+    return true;
+}
+
+
+void batch_init(struct batch *b, int lanes) {
+    struct snapshot snapshot;
+
+    b->lanes = lanes < 1 ? 1 : lanes > BATCH_LANES ? BATCH_LANES : lanes;
+    b->frames = state.frames;
+    b->instructions = 0;
+    b->vector_instructions = 0;
+    b->groups = 0;
+
+    save_snapshot(&snapshot);
+    for (int lane = 0; lane < b->lanes; lane++) {
+        batch_load_lane(b, lane, &snapshot);
+    }
+}
+
+void batch_load_lane(struct batch *b, int lane, const struct snapshot *snapshot) {
+    const struct nes *machine = &snapshot->nes;
+
+    b->pc[lane] = machine->cpu.pc;
+    b->a[lane] = machine->cpu.a;
+    b->x[lane] = machine->cpu.x;
+    b->y[lane] = machine->cpu.y;
+    b->s[lane] = machine->cpu.s;
+    b->p[lane] = machine->cpu.p;
+    b->cycles[lane] = machine->cpu.cycles;
+    b->halted[lane] = false;
+
+    for (int port = 0; port < 2; port++) {
+        b->buttons[port][lane] = machine->controllers[port].buttons;
+        b->shift[port][lane] = machine->controllers[port].shift;
+    }
+    b->strobe[lane] = machine->controller_strobe;
+
+    for (int i = 0; i < 2048; i++) {
+        b->ram[i][lane] = machine->cpu.ram[i];
+    }
+    for (int i = 0; i < 0x2000; i++) {
+        b->prg_ram[i][lane] = snapshot->prg_ram[i];
+    }
+
+    b->ppu[lane] = machine->ppu;
+    b->ppu[lane].framebuffer = NULL;
+}
+
+void batch_save_lane(const struct batch *b, int lane, struct snapshot *snapshot) {
+    struct nes *machine = &snapshot->nes;
+
+    // The framebuffer pointer comes from the main machine, like load_snapshot() keeps it
+    *machine = nes;
+    machine->ppu = b->ppu[lane];
+    machine->ppu.framebuffer = nes.ppu.framebuffer;
+
+    machine->cpu.pc = b->pc[lane];
+    machine->cpu.a = b->a[lane];
+    machine->cpu.x = b->x[lane];
+    machine->cpu.y = b->y[lane];
+    machine->cpu.s = b->s[lane];
+    machine->cpu.p = b->p[lane];
+    machine->cpu.cycles = b->cycles[lane];
+
+    for (int port = 0; port < 2; port++) {
+        machine->controllers[port].buttons = b->buttons[port][lane];
+        machine->controllers[port].shift = b->shift[port][lane];
+    }
+    machine->controller_strobe = b->strobe[lane];
+
+    for (int i = 0; i < 2048; i++) {
+        machine->cpu.ram[i] = b->ram[i][lane];
+    }
+    for (int i = 0; i < 0x2000; i++) {
+        snapshot->prg_ram[i] = b->prg_ram[i][lane];
+    }
+    snapshot->frames = b->frames;
+}
+
+void batch_set_buttons(struct batch *b, int lane, int port, uint8_t buttons) {
+    b->buttons[port][lane] = buttons;
+
+    if (b->strobe[lane]) {
+        b->shift[port][lane] = buttons;
+    }
+}
+
+void batch_run(struct batch *b, uint64_t until) {
+    uint8_t mask[BATCH_LANES];
+
+    for (;;) {
+        int leader = -1;
+        for (int lane = 0; lane < b->lanes; lane++) {
+            if (!b->halted[lane] && b->cycles[lane] < until && (leader < 0 || b->pc[lane] < b->pc[leader])) {
+                leader = lane;
+            }
+        }
+
+        if (leader < 0) {
+            break;
+        }
+
+        uint16_t pc = b->pc[leader];
+        int count = 0;
+        LANES {
+            mask[lane] = lane < b->lanes && !b->halted[lane] && b->cycles[lane] < until && b->pc[lane] == pc;
+            count += mask[lane];
+        }
+        b->groups++;
+
+        if (count == 1) {
+            int cycles = run_lane(b, leader);
+            b->cycles[leader] += cycles;
+            b->instructions += cycles > 0;
+            continue;
+        }
+
+        if (pc >= 0x8000 && run_vector(b, pc, mask)) {
+            b->instructions += count;
+            b->vector_instructions += count;
+            continue;
+        }
+
+        LANES {
+            if (mask[lane]) {
+                int cycles = run_lane(b, lane);
+                b->cycles[lane] += cycles;
+                b->instructions += cycles > 0;
+            }
+        }
+    }
+}
+
+// Ends like run_frame(), with vertical blank and the NMI but nothing drawn
+void batch_run_frame(struct batch *b) {
+    uint64_t frame_start = b->frames * CPU_CYCLES_PER_FRAME;
+
+    // Each lane stops at its first instruction boundary past the pre-render line, as run_frame() does
+    batch_run(b, frame_start + CPU_CYCLES_PER_VBLANK);
+    for (int lane = 0; lane < b->lanes; lane++) {
+        ppu_end_vblank(&b->ppu[lane]);
+    }
+
+    batch_run(b, frame_start + CPU_CYCLES_PER_FRAME);
+    b->frames++;
+
+    for (int lane = 0; lane < b->lanes; lane++) {
+        if (ppu_start_vblank(&b->ppu[lane]) && !b->halted[lane]) {
+            lane_push(b, lane, b->pc[lane] >> 8);
+            lane_push(b, lane, b->pc[lane] & 0xff);
+            lane_push(b, lane, b->p[lane] & ~(1 << BREAK));
+            b->p[lane] |= 1 << INTERRUPT;
+            b->pc[lane] = rom_read(NMI_VECTOR) | rom_read(NMI_VECTOR + 1) << 8;
+            b->cycles[lane] += 7;
+        }
+    }
+}
+
+void batch_report(const struct batch *b, FILE *f) {
+    double vector = b->instructions > 0 ? 100.0 * b->vector_instructions / b->instructions : 0;
+    double width = b->groups > 0 ? (double)b->instructions / b->groups : 0;
+
+    fprintf(f, "batch of %d lanes: %lu instructions, %.1f%% in SIMD lanes (%s), %.1f lanes per group on average\n",
+            b->lanes, b->instructions, vector, lane_instructions(), width);
+}
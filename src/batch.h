@@ -0,0 +1,73 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "nes.h"
+
+// Runs up to BATCH_LANES copies of the loaded cartridge side by side, for workloads
+// such as reinforcement learning where every instance runs the same ROM with its own
+// inputs. State is kept in structure-of-arrays form. Lanes at the same PC run the
+// instruction together in fixed-width lane loops, which the compiler turns into
+// SIMD. On x86-64 they are built for AVX-512 and AVX2 too, and the widest the CPU has
+// is picked at load time. Lanes that diverge take a scalar path that mirrors
+// execute_next(), and they join the group again once their PCs match. The lowest PC
+// always runs first, so lanes that fell behind catch up with the ones waiting ahead
+// of them.
+//
+// Each function works on the batch it is given and only reads the main machine, so
+// separate batches can run on separate threads. Each lane has its own PPU registers and
+// memory. Lanes have no framebuffer, ppu_draw() draws one when it is asked for. Tracing,
+// the debugger, the profiler and the write log are not involved. A lane that reaches an
+// undocumented opcode stops there, where the interpreter would exit.
+
+#define BATCH_LANES 32
+
+struct batch {
+    int lanes;
+    uint64_t frames;
+
+    uint16_t pc[BATCH_LANES];
+    uint8_t a[BATCH_LANES];
+    uint8_t x[BATCH_LANES];
+    uint8_t y[BATCH_LANES];
+    uint8_t s[BATCH_LANES];
+    uint8_t p[BATCH_LANES];
+    uint64_t cycles[BATCH_LANES];
+    bool halted[BATCH_LANES];
+
+    uint8_t buttons[2][BATCH_LANES];
+    uint8_t shift[2][BATCH_LANES];
+    bool strobe[BATCH_LANES];
+
+    // Address-major, so lanes reading the same address touch consecutive bytes
+    uint8_t ram[2048][BATCH_LANES];
+    uint8_t prg_ram[0x2000][BATCH_LANES];
+
+    // Only reached through the scalar path, so lane-major
+    struct ppu ppu[BATCH_LANES];
+
+    // Instructions summed over lanes, and how many of those ran in SIMD lanes
+    uint64_t instructions;
+    uint64_t vector_instructions;
+    uint64_t groups;
+};
+
+// Every lane starts as a copy of the machine as it is now
+void batch_init(struct batch *b, int lanes);
+
+// Moves one lane to or from a snapshot, so it can be checked, saved or run on its own
+void batch_load_lane(struct batch *b, int lane, const struct snapshot *snapshot);
+void batch_save_lane(const struct batch *b, int lane, struct snapshot *snapshot);
+
+void batch_set_buttons(struct batch *b, int lane, int port, uint8_t buttons);
+
+// Runs every lane until its cycle counter reaches until
+void batch_run(struct batch *b, uint64_t until);
+void batch_run_frame(struct batch *b);
+
+// Prints how much of the work ran in SIMD lanes, and with which instructions
+void batch_report(const struct batch *b, FILE *f);
+
+#endif
@@ -0,0 +1,88 @@
+#define _DEFAULT_SOURCE
+
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "battery.h"
+#include "nes.h"
+
+
+struct battery battery = { 0 };
+
+struct {
+    uint8_t *mapping;
+    size_t host_page;
+} save = { 0 };
+
+
+bool battery_open(const char *filename) {
+    battery_close();
+
+    int fd = open(filename, O_RDWR | O_CREAT, 0644);
+    if (fd < 0) {
+        logf_error("Unable to open save file %s\n", filename);
+        return false;
+    }
+
+    // A short or new file is extended with zeroes, a longer one keeps its tail
+    struct stat file;
+    if (fstat(fd, &file) != 0 || (file.st_size < PRG_RAM_SIZE && ftruncate(fd, PRG_RAM_SIZE) != 0)) {
+        logf_error("Unable to size save file %s\n", filename);
+        close(fd);
+        return false;
+    }
+
+    void *mapping = mmap(NULL, PRG_RAM_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED) {
+        logf_error("Unable to map save file %s\n", filename);
+        return false;
+    }
+
+    save.mapping = mapping;
+    save.host_page = sysconf(_SC_PAGESIZE);
+    battery.mapped = true;
+
+    cartridge.prg_ram = save.mapping;
+    map_memory();
+    mark_pages_written(PRG_RAM_DIRTY_PAGES);
+
+    // Nothing was written to the file yet
+    track_dirty_pages(DIRTY_BATTERY, true);
+    take_dirty_pages(DIRTY_BATTERY);
+    return true;
+}
+
+void battery_close() {
+    if (!battery.mapped) return;
+
+    track_dirty_pages(DIRTY_BATTERY, false);
+    msync(save.mapping, PRG_RAM_SIZE, MS_SYNC);
+
+    // Carries on from the saved bytes, unless the cartridge is being unloaded anyway
+    if (state.prg_ram != NULL) {
+        memcpy(state.prg_ram, save.mapping, PRG_RAM_SIZE);
+        cartridge.prg_ram = state.prg_ram;
+        map_memory();
+    }
+
+    munmap(save.mapping, PRG_RAM_SIZE);
+    save.mapping = NULL;
+    battery.mapped = false;
+}
+
+// MS_ASYNC only starts writeback, waiting for the disk would stall the frame
+void battery_end_frame() {
+    uint64_t written = (take_dirty_pages(DIRTY_BATTERY) & PRG_RAM_DIRTY_PAGES) >> 8;
+    if (written == 0) return;
+
+    size_t first = __builtin_ctzll(written) << 8;
+    size_t end = (64 - __builtin_clzll(written)) << 8;
+    first &= ~(save.host_page - 1);
+
+    msync(save.mapping + first, end - first, MS_ASYNC);
+}
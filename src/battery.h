@@ -0,0 +1,28 @@
+#ifndef BATTERY_H
+#define BATTERY_H
+
+#include <stdbool.h>
+
+// Battery-backed PRG RAM, flagged by bit 1 of iNES flags 6, mapped straight from a save
+// file with MAP_SHARED. Writes go to the mapping like any PRG RAM write, and the kernel
+// keeps them in the page cache even if the emulator crashes. Dirty page tracking finds
+// the pages written each frame, and only those are scheduled for writeback at the end of
+// the frame. Closing waits for the writeback.
+
+struct battery {
+    bool mapped;
+};
+
+extern struct battery battery;
+
+#define battery_frame() do { if (battery.mapped) battery_end_frame(); } while (0)
+
+// Replaces PRG RAM with the file, created as zeroes when missing
+bool battery_open(const char *filename);
+
+// PRG RAM goes back to plain memory holding the same bytes
+void battery_close();
+
+void battery_end_frame();
+
+#endif
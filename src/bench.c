@@ -0,0 +1,689 @@
+#define _POSIX_C_SOURCE 199309L
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "nes.h"
+#include "engine.h"
+#include "batch.h"
+#include "env.h"
+#include "fork.h"
+
+
+const uint32_t PRG_SIZE = 0x8000;
+const uint16_t PRG_START = 0x8000;
+
+const uint64_t DEFAULT_INSTRUCTIONS = 20000000;
+const int DEFAULT_REPEAT = 3;
+
+
+struct workload {
+    const char *name;
+    void (*generate)();
+};
+
+struct result {
+    const char *name;
+    uint64_t instructions;
+    uint64_t cycles;
+    double seconds;
+};
+
+// What the per-class breakdown sorts opcodes into. Shifts and rotates of A count as ALU,
+// of memory as read-modify-write.
+enum opcode_class {
+    CLASS_ALU,
+    CLASS_LOAD_STORE,
+    CLASS_BRANCH,
+    CLASS_STACK,
+    CLASS_RMW,
+    CLASSES,
+};
+
+const char *CLASS_NAMES[CLASSES] = {
+    [CLASS_ALU]        = "alu",
+    [CLASS_LOAD_STORE] = "load/store",
+    [CLASS_BRANCH]     = "branch",
+    [CLASS_STACK]      = "stack",
+    [CLASS_RMW]        = "rmw",
+};
+
+struct class_result {
+    uint64_t instructions;
+    double seconds;
+};
+
+struct batch batch __attribute__((aligned(64)));
+
+// Tiny assembler writing straight into the PRG ROM of the synthetic cartridge
+struct {
+    uint8_t *prg;
+    uint16_t pc;
+} assembler = { 0 };
+
+uint8_t find_opcode(enum instruction_name name, enum address_mode mode) {
+    for (int i = 0; i < 256; i++) {
+        if (INSTRUCTION_LOOKUP[i] == name && ADDRESS_MODE_LOOKUP[i] == mode) {
+            return i;
+        }
+    }
+
+    fprintf(stderr, "No opcode for %s %s\n", INSTRUCTION_NAME_STRING[name], ADDRESS_MODE_STRING[mode]);
+    exit(EXIT_FAILURE);
+}
+
+void emit_8(uint8_t data) {
+    assembler.prg[assembler.pc++ - PRG_START] = data;
+}
+
+uint16_t emit(enum instruction_name name, enum address_mode mode, uint16_t operand) {
+    uint16_t address = assembler.pc;
+
+    emit_8(find_opcode(name, mode));
+    if (instruction_length(mode) >= 2) {
+        emit_8(operand & 0xff);
+    }
+    if (instruction_length(mode) == 3) {
+        emit_8(operand >> 8);
+    }
+
+    return address;
+}
+
+void emit_branch(enum instruction_name name, uint16_t target) {
+    emit(name, RELATIVE, (uint8_t)(target - (assembler.pc + 2)));
+}
+
+void patch_branch(uint16_t branch, uint16_t target) {
+    assembler.prg[branch + 1 - PRG_START] = target - (branch + 2);
+}
+
+void set_vector(uint16_t vector, uint16_t address) {
+    assembler.prg[vector - PRG_START] = address & 0xff;
+    assembler.prg[vector + 1 - PRG_START] = address >> 8;
+}
+
+
+void generate_alu() {
+    uint16_t loop = emit(CLC, IMPLICIT, 0);
+    emit(LDA, IMMEDIATE, 0x13);
+    emit(ADC, IMMEDIATE, 0x07);
+    emit(AND, IMMEDIATE, 0x7f);
+    emit(ORA, IMMEDIATE, 0x10);
+    emit(EOR, IMMEDIATE, 0x55);
+    emit(ASL, ACCUMULATOR, 0);
+    emit(ROL, ACCUMULATOR, 0);
+    emit(LSR, ACCUMULATOR, 0);
+    emit(ROR, ACCUMULATOR, 0);
+    emit(SEC, IMPLICIT, 0);
+    emit(SBC, IMMEDIATE, 0x03);
+    emit(CMP, IMMEDIATE, 0x40);
+    emit(TAX, IMPLICIT, 0);
+    emit(INX, IMPLICIT, 0);
+    emit(TXA, IMPLICIT, 0);
+    emit(TAY, IMPLICIT, 0);
+    emit(DEY, IMPLICIT, 0);
+    emit(TYA, IMPLICIT, 0);
+    emit(JMP, ABSOLUTE, loop);
+}
+
+void generate_branch() {
+    uint16_t outer = emit(LDX, IMMEDIATE, 0x40);
+
+    uint16_t inner = emit(CPX, IMMEDIATE, 0x20);
+    uint16_t skip_carry = emit(BCC, RELATIVE, 0);
+    emit(NOP, IMPLICIT, 0);
+    patch_branch(skip_carry, emit(TXA, IMPLICIT, 0));
+    emit(AND, IMMEDIATE, 0x01);
+    uint16_t skip_zero = emit(BEQ, RELATIVE, 0);
+    emit(NOP, IMPLICIT, 0);
+    patch_branch(skip_zero, assembler.pc);
+    uint16_t skip_negative = emit(BMI, RELATIVE, 0);
+    uint16_t skip_positive = emit(BPL, RELATIVE, 0);
+    patch_branch(skip_negative, assembler.pc);
+    patch_branch(skip_positive, emit(CLV, IMPLICIT, 0));
+    uint16_t skip_overflow = emit(BVC, RELATIVE, 0);
+    emit(NOP, IMPLICIT, 0);
+    patch_branch(skip_overflow, emit(DEX, IMPLICIT, 0));
+    emit_branch(BNE, inner);
+
+    emit(JMP, ABSOLUTE, outer);
+}
+
+void generate_memory_indexed() {
+    emit(LDA, IMMEDIATE, 0x00);
+    emit(STA, ZERO_PAGE, 0x10);
+    emit(LDA, IMMEDIATE, 0x03);
+    emit(STA, ZERO_PAGE, 0x11);
+
+    uint16_t outer = emit(LDX, IMMEDIATE, 0x00);
+    emit(LDY, IMMEDIATE, 0x80);
+
+    uint16_t loop = emit(LDA, ABSOLUTE_X, 0x0200);
+    emit(ADC, IMMEDIATE, 0x01);
+    emit(STA, ABSOLUTE_X, 0x0200);
+    emit(LDA, INDIRECT_INDEXED, 0x10);
+    emit(EOR, ABSOLUTE_X, 0x0400);
+    emit(STA, INDIRECT_INDEXED, 0x10);
+    emit(INC, ABSOLUTE_X, 0x0500);
+    emit(LDA, ABSOLUTE_Y, 0x06c0);
+    emit(STA, ZERO_PAGE_X, 0x20);
+    emit(INX, IMPLICIT, 0);
+    emit(INY, IMPLICIT, 0);
+    emit_branch(BNE, loop);
+
+    emit(JMP, ABSOLUTE, outer);
+}
+
+void generate_stack() {
+    uint16_t loop = emit(JSR, ABSOLUTE, 0);
+    emit(JMP, ABSOLUTE, loop);
+
+    uint16_t outer_routine = emit(PHA, IMPLICIT, 0);
+    emit(PHP, IMPLICIT, 0);
+    uint16_t call_inner = emit(JSR, ABSOLUTE, 0);
+    emit(PLP, IMPLICIT, 0);
+    emit(PLA, IMPLICIT, 0);
+    emit(RTS, IMPLICIT, 0);
+
+    uint16_t inner_routine = emit(TSX, IMPLICIT, 0);
+    emit(PHA, IMPLICIT, 0);
+    emit(PLA, IMPLICIT, 0);
+    emit(TXS, IMPLICIT, 0);
+    emit(RTS, IMPLICIT, 0);
+
+    assembler.prg[loop + 1 - PRG_START] = outer_routine & 0xff;
+    assembler.prg[loop + 2 - PRG_START] = outer_routine >> 8;
+    assembler.prg[call_inner + 1 - PRG_START] = inner_routine & 0xff;
+    assembler.prg[call_inner + 2 - PRG_START] = inner_routine >> 8;
+}
+
+const struct workload WORKLOADS[] = {
+    { "alu", generate_alu },
+    { "branch", generate_branch },
+    { "memory_indexed", generate_memory_indexed },
+    { "stack", generate_stack },
+};
+
+const int WORKLOAD_COUNT = sizeof(WORKLOADS) / sizeof(WORKLOADS[0]);
+
+
+// Builds an NROM-256 image around the generated program and powers it on
+void load_workload(const struct workload *workload) {
+    cleanup_nes();
+
+    state.filesize = 16 + PRG_SIZE;
+    state.filedata = calloc(state.filesize, 1);
+    if (state.filedata == NULL) {
+        log_error("Failed to allocate workload image\n");
+        exit(EXIT_FAILURE);
+    }
+
+    memcpy(state.filedata, "NES\x1A", 4);
+    state.filedata[4] = PRG_SIZE / 0x4000;
+
+    assembler.prg = state.filedata + 16;
+    assembler.pc = PRG_START;
+
+    workload->generate();
+
+    set_vector(NMI_VECTOR, PRG_START);
+    set_vector(RESET_VECTOR, PRG_START);
+    set_vector(IRQ_VECTOR, PRG_START);
+
+    load_cartridge();
+    init_memory();
+    memset(&nes.cpu, 0, sizeof(nes.cpu));
+    poweron();
+}
+
+double now() {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+struct result run_workload(const struct workload *workload, const struct engine *engine, uint64_t instructions) {
+    load_workload(workload);
+
+    uint64_t initial_cycles = nes.cpu.cycles;
+    uint64_t executed = 0;
+    double start = now();
+
+    // Block engines run a frame's worth of cycles at a time and may overshoot by a block
+    if (engine->run != NULL) {
+        while (executed < instructions) {
+            uint32_t count = 0;
+            nes.cpu.cycles += engine->run(CPU_CYCLES_PER_FRAME, &count);
+            executed += count;
+        }
+    } else {
+        for (; executed < instructions; executed++) {
+            nes.cpu.cycles += engine->step();
+        }
+    }
+
+    struct result result = {
+        .name = workload->name,
+        .instructions = executed,
+        .cycles = nes.cpu.cycles - initial_cycles,
+        .seconds = now() - start,
+    };
+
+    return result;
+}
+
+enum opcode_class opcode_class(uint8_t opcode) {
+    switch (INSTRUCTION_LOOKUP[opcode]) {
+        case LDA: case LDX: case LDY: case STA: case STX: case STY:
+            return CLASS_LOAD_STORE;
+        case BCC: case BCS: case BEQ: case BMI: case BNE: case BPL: case BVC: case BVS: case JMP:
+            return CLASS_BRANCH;
+        case PHA: case PHP: case PLA: case PLP: case JSR: case RTS: case RTI: case BRK: case TSX: case TXS:
+            return CLASS_STACK;
+        case ASL: case LSR: case ROL: case ROR:
+            return ADDRESS_MODE_LOOKUP[opcode] == ACCUMULATOR ? CLASS_ALU : CLASS_RMW;
+        case INC: case DEC:
+            return CLASS_RMW;
+        default:
+            return CLASS_ALU;
+    }
+}
+
+// Time stamps for single instructions, the TSC where there is one
+#if defined(__GNUC__) && defined(__x86_64__)
+uint64_t ticks() {
+    return __builtin_ia32_rdtsc();
+}
+#else
+uint64_t ticks() {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (uint64_t)t.tv_sec * 1000000000 + t.tv_nsec;
+}
+#endif
+
+// Runs the workload again one step at a time, timing each instruction and adding it to
+// its opcode's class. Block engines step here too. The average cost of taking two time
+// stamps is measured first and taken off every instruction, and ticks are turned into
+// seconds against the monotonic clock over the whole run.
+void time_classes(const struct workload *workload, const struct engine *engine, uint64_t instructions, struct class_result *classes) {
+    load_workload(workload);
+
+    uint64_t ticks_by_class[CLASSES] = { 0 };
+    uint64_t counts[CLASSES] = { 0 };
+
+    const int calibration = 1 << 20;
+    uint64_t overhead = 0;
+    for (int i = 0; i < calibration; i++) {
+        uint64_t before = ticks();
+        overhead += ticks() - before;
+    }
+    overhead /= calibration;
+
+    double start = now();
+    uint64_t first = ticks();
+
+    for (uint64_t executed = 0; executed < instructions; executed++) {
+        enum opcode_class class = opcode_class(cpu_read_8(nes.cpu.pc));
+
+        uint64_t before = ticks();
+        int cycles = engine->step();
+        uint64_t taken = ticks() - before;
+
+        nes.cpu.cycles += cycles;
+        ticks_by_class[class] += taken > overhead ? taken - overhead : 0;
+        counts[class]++;
+    }
+
+    double seconds_per_tick = (now() - start) / (ticks() - first);
+
+    for (int i = 0; i < CLASSES; i++) {
+        classes[i].instructions += counts[i];
+        classes[i].seconds += ticks_by_class[i] * seconds_per_tick;
+    }
+}
+
+void print_classes(const struct class_result *classes) {
+    uint64_t total = 0;
+    for (int i = 0; i < CLASSES; i++) {
+        total += classes[i].instructions;
+    }
+
+    printf("%-16s %14s %10s %10s\n", "class", "instructions", "share", "ns/instr");
+    for (int i = 0; i < CLASSES; i++) {
+        const struct class_result *c = &classes[i];
+        if (c->instructions == 0) {
+            continue;
+        }
+        printf("%-16s %14lu %9.1f%% %10.2f\n", CLASS_NAMES[i], c->instructions,
+               100.0 * c->instructions / total, c->seconds * 1e9 / c->instructions);
+    }
+}
+
+// Runs lanes copies of the workload through the batch engine a frame at a time, instructions counts every lane
+struct result run_workload_batch(const struct workload *workload, int lanes, uint64_t instructions) {
+    load_workload(workload);
+    batch_init(&batch, lanes);
+
+    uint64_t initial_cycles = nes.cpu.cycles * batch.lanes;
+    double start = now();
+
+    while (batch.instructions < instructions) {
+        batch_run_frame(&batch);
+    }
+
+    uint64_t cycles = 0;
+    for (int lane = 0; lane < batch.lanes; lane++) {
+        cycles += batch.cycles[lane];
+    }
+
+    struct result result = {
+        .name = workload->name,
+        .instructions = batch.instructions,
+        .cycles = cycles - initial_cycles,
+        .seconds = now() - start,
+    };
+
+    return result;
+}
+
+// Steps instances copies of the workload through the RL environment, one frame per step, with
+// grayscale observations at half resolution
+struct result run_workload_env(const struct workload *workload, int instances, int threads, uint64_t instructions) {
+    load_workload(workload);
+
+    struct env_config config = { .instances = instances, .threads = threads, .frame_skip = 1, .downsample = 2 };
+    struct env *env = env_create(&config);
+
+    uint8_t *actions = calloc(instances, 1);
+    uint8_t *observations = env == NULL ? NULL : malloc(instances * env_observation_size(env));
+    float *rewards = malloc(instances * sizeof(float));
+    uint8_t *dones = malloc(instances);
+    if (env == NULL || actions == NULL || observations == NULL || rewards == NULL || dones == NULL) {
+        fprintf(stderr, "Failed to create an environment of %d instances\n", instances);
+        exit(EXIT_FAILURE);
+    }
+
+    uint64_t steps = 0;
+    double start = now();
+
+    while (env_instructions(env) < instructions) {
+        env_step(env, actions, observations, rewards, dones);
+        steps++;
+    }
+
+    struct result result = {
+        .name = workload->name,
+        .instructions = env_instructions(env),
+        .cycles = steps * instances * CPU_CYCLES_PER_FRAME,
+        .seconds = now() - start,
+    };
+
+    env_destroy(env);
+    free(actions);
+    free(observations);
+    free(rewards);
+    free(dones);
+
+    return result;
+}
+
+struct fork_result {
+    const char *name;
+    uint64_t nodes;
+    double seconds;
+    double snapshot_seconds;
+    struct fork_usage usage;
+};
+
+// Grows a search tree of nodes states, each one frame on from a random earlier node.
+// Only capture and restore are timed, next to a full snapshot save and load per node.
+struct fork_result run_workload_fork(const struct workload *workload, const struct engine *engine, int nodes) {
+    static struct snapshot snapshot;
+
+    load_workload(workload);
+
+    struct fork_node **tree = malloc(nodes * sizeof(struct fork_node *));
+    if (tree == NULL) {
+        fprintf(stderr, "Failed to allocate %d nodes\n", nodes);
+        exit(EXIT_FAILURE);
+    }
+
+    uint64_t rng = 1;
+    double seconds = 0;
+    double snapshot_seconds = 0;
+
+    double start = now();
+    tree[0] = fork_capture();
+    seconds += now() - start;
+
+    for (int i = 1; i < nodes; i++) {
+        rng = rng * 6364136223846793005ull + 1442695040888963407ull;
+
+        start = now();
+        fork_restore(tree[(rng >> 33) % i]);
+        seconds += now() - start;
+
+        uint64_t until = nes.cpu.cycles + CPU_CYCLES_PER_FRAME;
+        while (nes.cpu.cycles < until) {
+            nes.cpu.cycles += engine->run != NULL ? engine->run(until - nes.cpu.cycles, NULL) : engine->step();
+        }
+
+        start = now();
+        tree[i] = fork_capture();
+        seconds += now() - start;
+
+        start = now();
+        save_snapshot(&snapshot);
+        load_snapshot(&snapshot);
+        snapshot_seconds += now() - start;
+    }
+
+    struct fork_result result = {
+        .name = workload->name,
+        .nodes = nodes,
+        .seconds = seconds,
+        .snapshot_seconds = snapshot_seconds,
+        .usage = fork_usage(),
+    };
+
+    for (int i = 0; i < nodes; i++) {
+        fork_release(tree[i]);
+    }
+    fork_close();
+    free(tree);
+
+    return result;
+}
+
+void print_fork_results(const struct fork_result *results, int count) {
+    printf("%-16s %14s %14s %12s %12s\n", "workload", "forks/s", "snapshots/s", "bytes/node", "pages/node");
+
+    // A fork is one restore and one capture, a snapshot one save and one load
+    for (int i = 0; i < count; i++) {
+        const struct fork_result *r = &results[i];
+        printf("%-16s %14.0f %14.0f %12.0f %12.2f\n", r->name,
+                r->nodes / r->seconds,
+                (r->nodes - 1) / r->snapshot_seconds,
+                (double)r->usage.bytes / r->usage.nodes,
+                (double)r->usage.pages / r->usage.nodes);
+    }
+
+    printf("a full snapshot is %zu bytes\n", sizeof(struct snapshot));
+}
+
+void print_results(const struct result *results, int count) {
+    printf("%-16s %14s %14s %10s\n", "workload", "instr/s", "cycles/s", "ns/instr");
+
+    for (int i = 0; i < count; i++) {
+        const struct result *r = &results[i];
+        printf("%-16s %14.0f %14.0f %10.2f\n", r->name,
+                r->instructions / r->seconds,
+                r->cycles / r->seconds,
+                r->seconds * 1e9 / r->instructions);
+    }
+}
+
+void write_json(const char *filename, const char *commit, const struct result *results, int count, const struct class_result *classes) {
+    FILE *f = fopen(filename, "w");
+    if (f == NULL) {
+        fprintf(stderr, "Unable to open %s for writing\n", filename);
+        exit(EXIT_FAILURE);
+    }
+
+    fprintf(f, "{\n");
+    fprintf(f, "  \"commit\": \"%s\",\n", commit);
+    fprintf(f, "  \"workloads\": [\n");
+
+    for (int i = 0; i < count; i++) {
+        const struct result *r = &results[i];
+        fprintf(f, "    {\"name\": \"%s\", \"instructions\": %lu, \"cycles\": %lu, \"seconds\": %.6f, "
+                "\"instructions_per_second\": %.0f, \"cycles_per_second\": %.0f, \"ns_per_instruction\": %.3f}%s\n",
+                r->name, r->instructions, r->cycles, r->seconds,
+                r->instructions / r->seconds,
+                r->cycles / r->seconds,
+                r->seconds * 1e9 / r->instructions,
+                i + 1 < count ? "," : "");
+    }
+
+    fprintf(f, "  ]%s\n", classes != NULL ? "," : "");
+
+    if (classes != NULL) {
+        fprintf(f, "  \"classes\": [\n");
+        for (int i = 0; i < CLASSES; i++) {
+            const struct class_result *c = &classes[i];
+            fprintf(f, "    {\"name\": \"%s\", \"instructions\": %lu, \"ns_per_instruction\": %.3f}%s\n",
+                    CLASS_NAMES[i], c->instructions, c->instructions > 0 ? c->seconds * 1e9 / c->instructions : 0,
+                    i + 1 < CLASSES ? "," : "");
+        }
+        fprintf(f, "  ]\n");
+    }
+
+    fprintf(f, "}\n");
+    fclose(f);
+}
+
+int main(int argc, char **argv) {
+    atexit(cleanup_nes);
+
+    uint64_t instructions = DEFAULT_INSTRUCTIONS;
+    int repeat = DEFAULT_REPEAT;
+    const char *json = NULL;
+    const char *commit = "unknown";
+    const char *only = NULL;
+    const struct engine *engine = &ENGINES[0];
+    int lanes = 0;
+    int instances = 0;
+    int threads = 0;
+    int nodes = 0;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--instructions") == 0 && i + 1 < argc) {
+            instructions = strtoull(argv[++i], NULL, 0);
+        } else if (strcmp(argv[i], "--repeat") == 0 && i + 1 < argc) {
+            repeat = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--json") == 0 && i + 1 < argc) {
+            json = argv[++i];
+        } else if (strcmp(argv[i], "--commit") == 0 && i + 1 < argc) {
+            commit = argv[++i];
+        } else if (strcmp(argv[i], "--workload") == 0 && i + 1 < argc) {
+            only = argv[++i];
+        } else if (strcmp(argv[i], "--engine") == 0 && i + 1 < argc && find_engine(argv[i + 1]) != NULL) {
+            engine = find_engine(argv[++i]);
+        } else if (strcmp(argv[i], "--batch") == 0 && i + 1 < argc) {
+            lanes = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--env") == 0 && i + 1 < argc) {
+            instances = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+            threads = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--fork") == 0 && i + 1 < argc) {
+            nodes = atoi(argv[++i]);
+        } else {
+            fprintf(stderr, "Usage: %s [--instructions N] [--repeat N] [--workload NAME] [--engine NAME | --batch K | --env N [--threads N] | --fork NODES] [--json FILE] [--commit ID]\n", argv[0]);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    if (nodes > 1) {
+        struct fork_result fork_results[sizeof(WORKLOADS) / sizeof(WORKLOADS[0])] = { 0 };
+        int fork_count = 0;
+
+        for (int i = 0; i < WORKLOAD_COUNT; i++) {
+            if (only != NULL && strcmp(only, WORKLOADS[i].name) != 0) {
+                continue;
+            }
+
+            for (int r = 0; r < repeat; r++) {
+                struct fork_result result = run_workload_fork(&WORKLOADS[i], engine, nodes);
+                if (r == 0 || result.seconds < fork_results[fork_count].seconds) {
+                    fork_results[fork_count] = result;
+                }
+            }
+
+            fork_count++;
+        }
+
+        print_fork_results(fork_results, fork_count);
+        return EXIT_SUCCESS;
+    }
+
+    struct result results[sizeof(WORKLOADS) / sizeof(WORKLOADS[0])] = { 0 };
+    int count = 0;
+
+    // Only single engines are broken down by class, over every workload run
+    struct class_result classes[CLASSES] = { 0 };
+    bool by_class = instances == 0 && lanes == 0;
+
+    for (int i = 0; i < WORKLOAD_COUNT; i++) {
+        if (only != NULL && strcmp(only, WORKLOADS[i].name) != 0) {
+            continue;
+        }
+
+        // First, so the engine's own counters are left from a timed run
+        if (by_class) {
+            time_classes(&WORKLOADS[i], engine, instructions, classes);
+        }
+
+        // Keep the fastest run to filter out scheduler noise
+        for (int r = 0; r < repeat; r++) {
+            struct result result = instances > 0 ? run_workload_env(&WORKLOADS[i], instances, threads, instructions) :
+                                   lanes > 0 ? run_workload_batch(&WORKLOADS[i], lanes, instructions) :
+                                               run_workload(&WORKLOADS[i], engine, instructions);
+            if (r == 0 || result.seconds < results[count].seconds) {
+                results[count] = result;
+            }
+        }
+
+        count++;
+    }
+
+    print_results(results, count);
+
+    if (instances > 0) {
+        for (int i = 0; i < count; i++) {
+            double frames = results[i].cycles / results[i].seconds / CPU_CYCLES_PER_FRAME;
+            printf("%-16s %14.0f instance-frames/s %14.0f per minute\n", results[i].name, frames, frames * 60);
+        }
+    } else if (lanes > 0) {
+        for (int i = 0; i < count; i++) {
+            printf("%-16s %14.0f instance-frames/s\n", results[i].name, results[i].cycles / results[i].seconds / CPU_CYCLES_PER_FRAME);
+        }
+        batch_report(&batch, stdout);
+    } else {
+        print_classes(classes);
+
+        if (engine->report != NULL) {
+            engine->report(stdout);
+        }
+    }
+
+    if (json != NULL) {
+        write_json(json, commit, results, count, by_class ? classes : NULL);
+    }
+
+    return EXIT_SUCCESS;
+}
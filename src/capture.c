@@ -0,0 +1,322 @@
+#define _POSIX_C_SOURCE 200112L
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "capture.h"
+#include "nes.h"
+
+
+// About a quarter of a second at 60 frames a second
+#define CAPTURE_QUEUE 16
+
+// Samples a slot can hold, about 20 frames at 44.1kHz. Audio of dropped frames is kept
+// for the next slot, so only a longer run of drops loses sound.
+#define CAPTURE_SAMPLES 16384
+
+#define CAPTURE_SAMPLE_RATE 44100
+
+#define FRAME_PIXELS (CNES_WIDTH * CNES_HEIGHT)
+#define CHROMA_PIXELS (FRAME_PIXELS / 4)
+
+// NTSC runs at 39375000 / 655171, about 60.1 frames a second, with 8:7 pixels
+const char Y4M_HEADER[] = "YUV4MPEG2 W256 H240 F39375000:655171 Ip A8:7 C420jpeg\n";
+const char INDEXED_MAGIC[8] = "CNESIDX1";
+
+
+struct capture_slot {
+    // Frames dropped since the one before this, written again as copies of it
+    uint64_t skipped;
+
+    uint8_t pixels[FRAME_PIXELS];
+    int16_t samples[CAPTURE_SAMPLES];
+    size_t sample_count;
+};
+
+struct {
+    bool open;
+    enum capture_format format;
+    FILE *video;
+    FILE *audio;
+
+    // Full-range BT.601 for every palette index
+    uint8_t y[64];
+    uint8_t u[64];
+    uint8_t v[64];
+
+    // The last frame written, encoded, for standing in for dropped ones
+    uint8_t *encoded;
+    size_t encoded_size;
+    bool have_encoded;
+
+    // Only the emulation thread writes a slot before it is queued and only the writer
+    // thread reads it after, the lock covers the counts
+    struct capture_slot slots[CAPTURE_QUEUE];
+    int head;
+    int count;
+    uint64_t skipped;
+    int16_t carried[CAPTURE_SAMPLES];
+    size_t carried_count;
+    bool stopping;
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t queued;
+
+    struct capture_stats stats;
+} recorder = { 0 };
+
+
+static void put_16(uint8_t *p, uint16_t value) {
+    p[0] = value;
+    p[1] = value >> 8;
+}
+
+static void put_32(uint8_t *p, uint32_t value) {
+    put_16(p, value);
+    put_16(p + 2, value >> 16);
+}
+
+// Sizes are filled in by capture_close(), the header is rewritten then
+static void write_wav_header(uint32_t data_size) {
+    uint8_t header[44];
+    memcpy(header, "RIFF", 4);
+    put_32(header + 4, 36 + data_size);
+    memcpy(header + 8, "WAVEfmt ", 8);
+    put_32(header + 16, 16);
+    put_16(header + 20, 1);
+    put_16(header + 22, 1);
+    put_32(header + 24, CAPTURE_SAMPLE_RATE);
+    put_32(header + 28, CAPTURE_SAMPLE_RATE * sizeof(int16_t));
+    put_16(header + 32, sizeof(int16_t));
+    put_16(header + 34, 16);
+    memcpy(header + 36, "data", 4);
+    put_32(header + 40, data_size);
+
+    fseek(recorder.audio, 0, SEEK_SET);
+    fwrite(header, sizeof(header), 1, recorder.audio);
+}
+
+static void build_yuv_palette() {
+    for (int i = 0; i < 64; i++) {
+        double r = PALETTE[i][0], g = PALETTE[i][1], b = PALETTE[i][2];
+        recorder.y[i] = 0.299 * r + 0.587 * g + 0.114 * b + 0.5;
+        recorder.u[i] = 128 - 0.168736 * r - 0.331264 * g + 0.5 * b + 0.5;
+        recorder.v[i] = 128 + 0.5 * r - 0.418688 * g - 0.081312 * b + 0.5;
+    }
+}
+
+// Chroma is the average of each 2x2 block
+static void encode_y4m(const uint8_t *pixels, uint8_t *out) {
+    memcpy(out, "FRAME\n", 6);
+    uint8_t *y = out + 6;
+    uint8_t *u = y + FRAME_PIXELS;
+    uint8_t *v = u + CHROMA_PIXELS;
+
+    for (int i = 0; i < FRAME_PIXELS; i++) {
+        y[i] = recorder.y[pixels[i] & 0x3f];
+    }
+
+    for (int row = 0; row < CNES_HEIGHT; row += 2) {
+        for (int column = 0; column < CNES_WIDTH; column += 2) {
+            const uint8_t *p = pixels + row * CNES_WIDTH + column;
+            uint8_t block[4] = { p[0] & 0x3f, p[1] & 0x3f, p[CNES_WIDTH] & 0x3f, p[CNES_WIDTH + 1] & 0x3f };
+
+            int chroma = (row / 2) * (CNES_WIDTH / 2) + column / 2;
+            u[chroma] = (recorder.u[block[0]] + recorder.u[block[1]] + recorder.u[block[2]] + recorder.u[block[3]] + 2) / 4;
+            v[chroma] = (recorder.v[block[0]] + recorder.v[block[1]] + recorder.v[block[2]] + recorder.v[block[3]] + 2) / 4;
+        }
+    }
+}
+
+static void write_slot(const struct capture_slot *slot) {
+    if (recorder.video != NULL) {
+        for (uint64_t i = 0; i < slot->skipped && recorder.have_encoded; i++) {
+            fwrite(recorder.encoded, recorder.encoded_size, 1, recorder.video);
+        }
+
+        if (recorder.format == CAPTURE_Y4M) {
+            encode_y4m(slot->pixels, recorder.encoded);
+        } else {
+            memcpy(recorder.encoded, slot->pixels, FRAME_PIXELS);
+        }
+        recorder.have_encoded = true;
+        fwrite(recorder.encoded, recorder.encoded_size, 1, recorder.video);
+    }
+
+    if (recorder.audio != NULL) {
+        fwrite(slot->samples, sizeof(int16_t), slot->sample_count, recorder.audio);
+    }
+}
+
+static void *run_writer(void *context) {
+    pthread_mutex_lock(&recorder.lock);
+    for (;;) {
+        while (recorder.count == 0 && !recorder.stopping) {
+            pthread_cond_wait(&recorder.queued, &recorder.lock);
+        }
+        if (recorder.count == 0) break;
+
+        struct capture_slot *slot = &recorder.slots[recorder.head];
+        pthread_mutex_unlock(&recorder.lock);
+
+        write_slot(slot);
+
+        pthread_mutex_lock(&recorder.lock);
+        recorder.head = (recorder.head + 1) % CAPTURE_QUEUE;
+        recorder.count--;
+    }
+    pthread_mutex_unlock(&recorder.lock);
+
+    return NULL;
+}
+
+
+bool capture_open(const char *video_path, enum capture_format format, const char *audio_path) {
+    capture_close();
+    memset(&recorder.stats, 0, sizeof(recorder.stats));
+    recorder.format = format;
+
+    if (video_path != NULL) {
+        recorder.video = fopen(video_path, "wb");
+        if (recorder.video == NULL) {
+            logf_error("Unable to open video capture file %s\n", video_path);
+            return false;
+        }
+    }
+
+    if (audio_path != NULL) {
+        recorder.audio = fopen(audio_path, "wb");
+        if (recorder.audio == NULL) {
+            logf_error("Unable to open audio capture file %s\n", audio_path);
+            capture_close();
+            return false;
+        }
+        write_wav_header(0);
+    }
+
+    if (recorder.video != NULL && format == CAPTURE_Y4M) {
+        build_yuv_palette();
+        fputs(Y4M_HEADER, recorder.video);
+        recorder.encoded_size = 6 + FRAME_PIXELS + 2 * CHROMA_PIXELS;
+    } else if (recorder.video != NULL) {
+        uint8_t header[12];
+        memcpy(header, INDEXED_MAGIC, sizeof(INDEXED_MAGIC));
+        put_16(header + 8, CNES_WIDTH);
+        put_16(header + 10, CNES_HEIGHT);
+        fwrite(header, sizeof(header), 1, recorder.video);
+        fwrite(PALETTE, 64 * 3, 1, recorder.video);
+        recorder.encoded_size = FRAME_PIXELS;
+    }
+
+    recorder.encoded = malloc(recorder.encoded_size > 0 ? recorder.encoded_size : 1);
+    recorder.have_encoded = false;
+    recorder.head = 0;
+    recorder.count = 0;
+    recorder.skipped = 0;
+    recorder.carried_count = 0;
+    recorder.stopping = false;
+
+    pthread_mutex_init(&recorder.lock, NULL);
+    pthread_cond_init(&recorder.queued, NULL);
+
+    int code = recorder.encoded == NULL ? -1 : pthread_create(&recorder.thread, NULL, run_writer, NULL);
+    if (code != 0) {
+        logf_error("Unable to start capture thread: %d\n", code);
+        pthread_cond_destroy(&recorder.queued);
+        pthread_mutex_destroy(&recorder.lock);
+        capture_close();
+        return false;
+    }
+
+    recorder.open = true;
+    return true;
+}
+
+void capture_close() {
+    if (recorder.open) {
+        pthread_mutex_lock(&recorder.lock);
+        recorder.stopping = true;
+        pthread_cond_signal(&recorder.queued);
+        pthread_mutex_unlock(&recorder.lock);
+
+        pthread_join(recorder.thread, NULL);
+        pthread_cond_destroy(&recorder.queued);
+        pthread_mutex_destroy(&recorder.lock);
+        recorder.open = false;
+
+        // Frames dropped at the very end still take up their time
+        for (uint64_t i = 0; i < recorder.skipped && recorder.video != NULL && recorder.have_encoded; i++) {
+            fwrite(recorder.encoded, recorder.encoded_size, 1, recorder.video);
+        }
+
+        if (recorder.audio != NULL) {
+            fwrite(recorder.carried, sizeof(int16_t), recorder.carried_count, recorder.audio);
+        }
+        recorder.stats.samples += recorder.carried_count;
+
+        logf_info("Captured %lu frames and %lu samples, dropped %lu frames and %lu samples\n",
+                recorder.stats.frames, recorder.stats.samples, recorder.stats.dropped, recorder.stats.dropped_samples);
+    }
+
+    if (recorder.video != NULL) {
+        fclose(recorder.video);
+        recorder.video = NULL;
+    }
+
+    if (recorder.audio != NULL) {
+        write_wav_header(recorder.stats.samples * sizeof(int16_t));
+        fclose(recorder.audio);
+        recorder.audio = NULL;
+    }
+
+    free(recorder.encoded);
+    recorder.encoded = NULL;
+}
+
+
+void capture_frame(const uint8_t *framebuffer, const int16_t *samples, size_t count) {
+    if (!recorder.open) return;
+
+    pthread_mutex_lock(&recorder.lock);
+    bool full = recorder.count == CAPTURE_QUEUE;
+    int tail = (recorder.head + recorder.count) % CAPTURE_QUEUE;
+    pthread_mutex_unlock(&recorder.lock);
+
+    size_t room = CAPTURE_SAMPLES - recorder.carried_count;
+    size_t kept = count < room ? count : room;
+    recorder.stats.dropped_samples += count - kept;
+
+    if (full) {
+        memcpy(recorder.carried + recorder.carried_count, samples, kept * sizeof(int16_t));
+        recorder.carried_count += kept;
+        recorder.skipped++;
+        recorder.stats.dropped++;
+        return;
+    }
+
+    // The writer does not look at the slot until it is counted below
+    struct capture_slot *slot = &recorder.slots[tail];
+
+    slot->skipped = recorder.skipped;
+    memcpy(slot->pixels, framebuffer, FRAME_PIXELS);
+    memcpy(slot->samples, recorder.carried, recorder.carried_count * sizeof(int16_t));
+    memcpy(slot->samples + recorder.carried_count, samples, kept * sizeof(int16_t));
+    slot->sample_count = recorder.carried_count + kept;
+
+    recorder.stats.frames++;
+    recorder.stats.samples += slot->sample_count;
+    recorder.skipped = 0;
+    recorder.carried_count = 0;
+
+    pthread_mutex_lock(&recorder.lock);
+    recorder.count++;
+    pthread_cond_signal(&recorder.queued);
+    pthread_mutex_unlock(&recorder.lock);
+}
+
+struct capture_stats capture_stats() {
+    return recorder.stats;
+}
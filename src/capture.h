@@ -0,0 +1,42 @@
+#ifndef CAPTURE_H
+#define CAPTURE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "cnes.h"
+
+// Records video and audio to disk without holding up emulation. Each frame is copied as
+// palette indices, a third of what RGB would take, into a bounded queue. A background
+// thread converts and writes it out. When the queue is full the frame is dropped and
+// counted, never waited for. The frame written next is preceded by copies of the last
+// written one, so the video keeps its frame rate, and carries the dropped frames' audio.
+//
+// Video is either Y4M, converted to 4:2:0 on the background thread, or indexed: the
+// magic "CNESIDX1", width and height as little-endian 16-bit values, the 64 RGB palette
+// triples, and then width * height palette indices per frame. Audio is 16-bit mono WAV.
+
+enum capture_format {
+    CAPTURE_Y4M,
+    CAPTURE_INDEXED,
+};
+
+struct capture_stats {
+    uint64_t frames;
+    uint64_t dropped;
+    uint64_t samples;
+    uint64_t dropped_samples;
+};
+
+// Either path may be NULL to record only the other
+CNES_API bool capture_open(const char *video_path, enum capture_format format, const char *audio_path);
+
+// Waits for the queue to drain, then finishes the files and logs the counts
+CNES_API void capture_close();
+
+// Queues one frame, CNES_WIDTH * CNES_HEIGHT palette indices, and the samples produced with it
+CNES_API void capture_frame(const uint8_t *framebuffer, const int16_t *samples, size_t count);
+
+CNES_API struct capture_stats capture_stats();
+
+#endif
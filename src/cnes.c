@@ -0,0 +1,158 @@
+#include <stdbool.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include "cnes.h"
+#include "nes.h"
+#include "statehash.h"
+#include "battery.h"
+
+
+// 44.1kHz at 60 frames a second, with room for a long frame
+#define AUDIO_CAPACITY 1024
+
+struct cnes {
+    bool loaded;
+
+    // Host buffer the core draws into, reapplied whenever a ROM load rebuilds memory
+    uint8_t *framebuffer;
+
+    // Stays empty until there is an APU to fill it
+    int16_t audio[AUDIO_CAPACITY];
+    size_t audio_count;
+};
+
+static struct cnes instance;
+static bool created = false;
+
+
+struct cnes *cnes_create() {
+    if (created) return NULL;
+
+    memset(&instance, 0, sizeof(instance));
+    created = true;
+    return &instance;
+}
+
+void cnes_destroy(struct cnes *cnes) {
+    if (cnes == NULL) return;
+
+    state_hash_close();
+    cleanup_nes();
+    cnes->loaded = false;
+    created = false;
+}
+
+
+bool cnes_load_rom(struct cnes *cnes, const uint8_t *data, size_t size) {
+    cleanup_nes();
+    cnes->loaded = false;
+
+    memset(&nes, 0, sizeof(nes));
+    state.frames = 0;
+
+    state.filedata = malloc(size > 0 ? size : 1);
+    if (state.filedata == NULL) return false;
+    memcpy(state.filedata, data, size);
+    state.filesize = size;
+
+    if (!load_cartridge()) {
+        cleanup_nes();
+        return false;
+    }
+
+    init_memory();
+    if (cnes->framebuffer != NULL) {
+        nes.ppu.framebuffer = cnes->framebuffer;
+    }
+
+    poweron();
+    cnes->loaded = true;
+    return true;
+}
+
+bool cnes_load_rom_file(struct cnes *cnes, const char *filename) {
+    size_t size;
+    uint8_t *data = read_file(filename, &size);
+    if (data == NULL) return false;
+
+    bool loaded = cnes_load_rom(cnes, data, size);
+    free(data);
+    return loaded;
+}
+
+bool cnes_map_save_file(struct cnes *cnes, const char *filename) {
+    if (!cnes->loaded) return false;
+    if (!cartridge.battery) return true;
+
+    return battery_open(filename);
+}
+
+
+void cnes_set_buttons(struct cnes *cnes, int port, uint8_t buttons) {
+    if (port < 0 || port > 1) return;
+    set_buttons(port, buttons);
+}
+
+void cnes_step_frame(struct cnes *cnes) {
+    cnes->audio_count = 0;
+    if (!cnes->loaded) return;
+
+    run_frame();
+}
+
+uint64_t cnes_frame_count(const struct cnes *cnes) {
+    return state.frames;
+}
+
+
+const uint8_t *cnes_framebuffer(const struct cnes *cnes) {
+    return nes.ppu.framebuffer;
+}
+
+void cnes_set_framebuffer(struct cnes *cnes, uint8_t *buffer) {
+    cnes->framebuffer = buffer;
+
+    if (cnes->loaded) {
+        nes.ppu.framebuffer = buffer != NULL ? buffer : state.framebuffer;
+    }
+}
+
+bool cnes_take_changed_rows(struct cnes *cnes, int *first, int *last) {
+    return cnes->loaded && ppu_take_changed_rows(first, last);
+}
+
+const uint8_t (*cnes_palette())[3] {
+    return PALETTE;
+}
+
+const int16_t *cnes_audio_samples(const struct cnes *cnes, size_t *count) {
+    *count = cnes->audio_count;
+    return cnes->audio;
+}
+
+
+uint64_t cnes_state_hash(struct cnes *cnes) {
+    state_hash_open();
+    return state_hash_update();
+}
+
+
+size_t cnes_state_size() {
+    return sizeof(struct snapshot);
+}
+
+bool cnes_save_state(const struct cnes *cnes, void *buffer, size_t size) {
+    if (!cnes->loaded || size < sizeof(struct snapshot)) return false;
+
+    save_snapshot(buffer);
+    return true;
+}
+
+// load_snapshot() keeps the current framebuffer pointer, so a host buffer survives this
+bool cnes_load_state(struct cnes *cnes, const void *buffer, size_t size) {
+    if (!cnes->loaded || size < sizeof(struct snapshot)) return false;
+
+    load_snapshot(buffer);
+    return true;
+}
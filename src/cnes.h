@@ -0,0 +1,83 @@
+#ifndef CNES_H
+#define CNES_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "ppu.h"
+
+// Embedding API for hosts that drive the emulator themselves, such as training loops,
+// test harnesses or other frontends. It has no SDL dependency. The host feeds input,
+// steps one frame at a time, and reads the picture and sound straight out of buffers
+// that stay put between calls, so nothing is copied per frame.
+//
+// The core keeps the machine in process globals, so only one cnes can exist at a time.
+// cnes_create() returns NULL while another one is alive.
+
+#if defined(__GNUC__)
+#define CNES_API __attribute__((visibility("default")))
+#else
+#define CNES_API
+#endif
+
+#define CNES_WIDTH PPU_WIDTH
+#define CNES_HEIGHT PPU_HEIGHT
+
+// Standard controller bits, as they are shifted out of $4016/$4017
+#define CNES_BUTTON_A      (1 << 0)
+#define CNES_BUTTON_B      (1 << 1)
+#define CNES_BUTTON_SELECT (1 << 2)
+#define CNES_BUTTON_START  (1 << 3)
+#define CNES_BUTTON_UP     (1 << 4)
+#define CNES_BUTTON_DOWN   (1 << 5)
+#define CNES_BUTTON_LEFT   (1 << 6)
+#define CNES_BUTTON_RIGHT  (1 << 7)
+
+struct cnes;
+
+CNES_API struct cnes *cnes_create();
+CNES_API void cnes_destroy(struct cnes *cnes);
+
+// Both copy the iNES image, then power the machine on. A failed load leaves no cartridge.
+CNES_API bool cnes_load_rom(struct cnes *cnes, const uint8_t *data, size_t size);
+CNES_API bool cnes_load_rom_file(struct cnes *cnes, const char *filename);
+
+// Maps battery RAM from a save file, created if missing, so writes persist as they happen.
+// Cartridges without a battery map nothing and return true. Loading a ROM closes the file.
+CNES_API bool cnes_map_save_file(struct cnes *cnes, const char *filename);
+
+CNES_API void cnes_set_buttons(struct cnes *cnes, int port, uint8_t buttons);
+
+// Runs the CPU to the end of the current frame
+CNES_API void cnes_step_frame(struct cnes *cnes);
+CNES_API uint64_t cnes_frame_count(const struct cnes *cnes);
+
+// One palette index per pixel, CNES_WIDTH * CNES_HEIGHT bytes. The pointer stays valid
+// until the cnes is destroyed or a ROM is loaded.
+CNES_API const uint8_t *cnes_framebuffer(const struct cnes *cnes);
+
+// Makes the core draw into the host's buffer instead, which must hold CNES_WIDTH *
+// CNES_HEIGHT bytes and outlive the cnes. NULL goes back to the internal buffer.
+CNES_API void cnes_set_framebuffer(struct cnes *cnes, uint8_t *buffer);
+
+// The band of framebuffer rows drawn since the last call, so a host converts and uploads
+// only those. A static screen draws nothing and returns false.
+CNES_API bool cnes_take_changed_rows(struct cnes *cnes, int *first, int *last);
+
+// 64 RGB triples for turning palette indices into colours
+CNES_API const uint8_t (*cnes_palette())[3];
+
+// Mono samples produced by the last cnes_step_frame(), valid until the next one
+CNES_API const int16_t *cnes_audio_samples(const struct cnes *cnes, size_t *count);
+
+// Hash of the machine state for comparing peers or replays. The first call turns hashing
+// on, after which only the memory pages written since the previous call are hashed again.
+CNES_API uint64_t cnes_state_hash(struct cnes *cnes);
+
+// Machine state as an opaque blob, only meant to be loaded by the same build. The buffer
+// is written in place and needs malloc alignment.
+CNES_API size_t cnes_state_size();
+CNES_API bool cnes_save_state(const struct cnes *cnes, void *buffer, size_t size);
+CNES_API bool cnes_load_state(struct cnes *cnes, const void *buffer, size_t size);
+
+#endif
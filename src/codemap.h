@@ -0,0 +1,14 @@
+#ifndef CODEMAP_H
+#define CODEMAP_H
+
+// One flag byte per PRG ROM byte in the FCEUX .cdl layout, so maps from
+// either emulator can be exchanged. Bit 7 is unused by FCEUX and marks the
+// first byte of an instruction, which is what ahead-of-time decoding needs.
+
+enum code_map_flag {
+    CODE_MAP_CODE   = 1 << 0,
+    CODE_MAP_DATA   = 1 << 1,
+    CODE_MAP_OPCODE = 1 << 7,
+};
+
+#endif
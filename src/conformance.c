@@ -0,0 +1,384 @@
+#define _DEFAULT_SOURCE
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include "nes.h"
+#include "engine.h"
+#include "workers.h"
+
+
+#define CONFORMANCE_PATH_LENGTH 1024
+#define CONFORMANCE_TEXT_LENGTH (2 * CONFORMANCE_PATH_LENGTH)
+
+// Blargg's test ROMs ask for a reset at least 100ms after writing $81
+const long RESET_DELAY_FRAMES = 6;
+
+const long FRAMES_PER_SECOND = 60;
+const long DEFAULT_TIMEOUT_SECONDS = 30;
+
+// $6000 is the status byte, $6001-$6003 hold the signature and $6004 starts the text
+const uint16_t STATUS_OFFSET = 0;
+const uint16_t TEXT_OFFSET = 4;
+const uint8_t SIGNATURE[3] = { 0xde, 0xb0, 0x61 };
+
+const uint8_t STATUS_RUNNING = 0x80;
+const uint8_t STATUS_RESET = 0x81;
+
+
+enum verdict {
+    VERDICT_PENDING,
+    VERDICT_PASS,
+    VERDICT_FAIL,
+    VERDICT_TIMEOUT,
+    VERDICT_UNSUPPORTED,
+    VERDICT_ERROR,
+    VERDICTS,
+};
+
+const char *VERDICT_STRING[] = {
+    [VERDICT_PENDING]     = "CRASH",
+    [VERDICT_PASS]        = "PASS",
+    [VERDICT_FAIL]        = "FAIL",
+    [VERDICT_TIMEOUT]     = "TIMEOUT",
+    [VERDICT_UNSUPPORTED] = "SKIP",
+    [VERDICT_ERROR]       = "ERROR",
+};
+
+struct test {
+    char path[CONFORMANCE_PATH_LENGTH];
+    char suite[CONFORMANCE_PATH_LENGTH];
+
+    // CPU timing tests run and report first since the instruction tables are the usual culprit
+    bool timing;
+};
+
+// Lives in shared memory so forked workers can report back
+struct outcome {
+    enum verdict verdict;
+    uint8_t status;
+    long frames;
+    char text[CONFORMANCE_TEXT_LENGTH];
+};
+
+struct {
+    bool verbose;
+    long timeout;
+    int jobs;
+} options = { .timeout = DEFAULT_TIMEOUT_SECONDS, .jobs = 0 };
+
+struct outcome *outcomes = NULL;
+
+
+bool has_signature() {
+    return memcmp(cartridge.prg_ram + STATUS_OFFSET + 1, SIGNATURE, sizeof(SIGNATURE)) == 0;
+}
+
+void copy_text(char *text, size_t length) {
+    size_t i = 0;
+    for (; i + 1 < length && TEXT_OFFSET + i < PRG_RAM_SIZE; i++) {
+        char c = cartridge.prg_ram[TEXT_OFFSET + i];
+        if (c == '\0') {
+            break;
+        }
+        text[i] = c;
+    }
+    text[i] = '\0';
+}
+
+void run_test(const struct test *test, struct outcome *outcome) {
+    state.filedata = read_file(test->path, &state.filesize);
+    if (state.filedata == NULL) {
+        snprintf(outcome->text, sizeof(outcome->text), "unable to read %s", test->path);
+        outcome->verdict = VERDICT_ERROR;
+        return;
+    }
+
+    if (!load_cartridge()) {
+        snprintf(outcome->text, sizeof(outcome->text), "invalid iNES image");
+        outcome->verdict = VERDICT_ERROR;
+        return;
+    }
+
+    if (cartridge.mapper != 0) {
+        snprintf(outcome->text, sizeof(outcome->text), "mapper %u", cartridge.mapper);
+        outcome->verdict = VERDICT_UNSUPPORTED;
+        return;
+    }
+
+    init_memory();
+    poweron();
+
+    long frames = options.timeout * FRAMES_PER_SECOND;
+    long reset_at = -1;
+    bool started = false;
+
+    for (long frame = 0; frame < frames; frame++) {
+        run_frame();
+        outcome->frames = frame + 1;
+
+        if (frame == reset_at) {
+            reset();
+            reset_at = -1;
+            continue;
+        }
+
+        if (!has_signature()) {
+            continue;
+        }
+
+        started = true;
+        uint8_t status = cartridge.prg_ram[STATUS_OFFSET];
+
+        if (status == STATUS_RUNNING) {
+            continue;
+        }
+        if (status == STATUS_RESET) {
+            if (reset_at < 0) {
+                reset_at = frame + RESET_DELAY_FRAMES;
+            }
+            continue;
+        }
+
+        outcome->status = status;
+        copy_text(outcome->text, sizeof(outcome->text));
+        outcome->verdict = status == 0 ? VERDICT_PASS : VERDICT_FAIL;
+        return;
+    }
+
+    if (started) {
+        copy_text(outcome->text, sizeof(outcome->text));
+    } else {
+        snprintf(outcome->text, sizeof(outcome->text), "no $6000 signature written");
+    }
+    outcome->verdict = VERDICT_TIMEOUT;
+}
+
+
+const char *basename_of(const char *path) {
+    const char *slash = strrchr(path, '/');
+    return slash != NULL ? slash + 1 : path;
+}
+
+bool is_timing_test(const char *path) {
+    char lower[CONFORMANCE_PATH_LENGTH];
+    size_t i = 0;
+    for (; path[i] != '\0' && i + 1 < sizeof(lower); i++) {
+        lower[i] = tolower((unsigned char)path[i]);
+    }
+    lower[i] = '\0';
+
+    return strstr(lower, "timing") != NULL || strstr(lower, "cycle") != NULL || strstr(lower, "branch") != NULL;
+}
+
+bool has_rom_extension(const char *name) {
+    size_t length = strlen(name);
+    return length > 4 && strcasecmp(name + length - 4, ".nes") == 0;
+}
+
+void add_test(struct test **tests, int *count, const char *root, const char *path) {
+    *tests = realloc(*tests, (*count + 1) * sizeof(struct test));
+    if (*tests == NULL) {
+        fprintf(stderr, "Unable to allocate test list\n");
+        exit(EXIT_FAILURE);
+    }
+
+    struct test *test = &(*tests)[(*count)++];
+    memset(test, 0, sizeof(*test));
+    snprintf(test->path, sizeof(test->path), "%s", path);
+
+    // The suite is the directory the ROM lives in, relative to the scanned root
+    const char *relative = path + strlen(root);
+    while (*relative == '/') {
+        relative++;
+    }
+    snprintf(test->suite, sizeof(test->suite), "%s", relative);
+
+    char *slash = strrchr(test->suite, '/');
+    if (slash != NULL) {
+        *slash = '\0';
+    } else {
+        snprintf(test->suite, sizeof(test->suite), ".");
+    }
+
+    test->timing = is_timing_test(path);
+}
+
+void scan(struct test **tests, int *count, const char *root, const char *directory) {
+    DIR *dir = opendir(directory);
+    if (dir == NULL) {
+        fprintf(stderr, "Unable to open directory %s\n", directory);
+        exit(EXIT_FAILURE);
+    }
+
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL) {
+        if (entry->d_name[0] == '.') {
+            continue;
+        }
+
+        char path[CONFORMANCE_PATH_LENGTH];
+        if (snprintf(path, sizeof(path), "%s/%s", directory, entry->d_name) >= (int)sizeof(path)) {
+            continue;
+        }
+
+        struct stat info;
+        if (stat(path, &info) != 0) {
+            continue;
+        }
+
+        if (S_ISDIR(info.st_mode)) {
+            scan(tests, count, root, path);
+        } else if (S_ISREG(info.st_mode) && has_rom_extension(entry->d_name)) {
+            add_test(tests, count, root, path);
+        }
+    }
+
+    closedir(dir);
+}
+
+int compare_tests(const void *a, const void *b) {
+    const struct test *x = a, *y = b;
+    if (x->timing != y->timing) {
+        return x->timing ? -1 : 1;
+    }
+    return strcmp(x->path, y->path);
+}
+
+
+void run_job(int index, void *context) {
+    struct test *tests = context;
+    run_test(&tests[index], &outcomes[index]);
+}
+
+// Only the first line of the ROM's own report fits in the matrix, --verbose prints all of it
+void print_text(const char *text) {
+    if (options.verbose) {
+        for (const char *line = text; *line != '\0';) {
+            const char *end = strchr(line, '\n');
+            int length = end != NULL ? (int)(end - line) : (int)strlen(line);
+            if (length > 0) {
+                printf("\n             %.*s", length, line);
+            }
+            line += length + (end != NULL);
+        }
+        return;
+    }
+
+    const char *end = strchr(text, '\n');
+    while (end == text) {
+        text++;
+        end = strchr(text, '\n');
+    }
+    printf("  %.*s", end != NULL ? (int)(end - text) : (int)strlen(text), text);
+}
+
+void print_matrix(const struct test *tests, int count) {
+    for (int pass = 0; pass < 2; pass++) {
+        bool timing = pass == 0;
+        const char *suite = NULL;
+
+        for (int i = 0; i < count; i++) {
+            if (tests[i].timing != timing) {
+                continue;
+            }
+
+            if (suite == NULL || strcmp(suite, tests[i].suite) != 0) {
+                suite = tests[i].suite;
+                printf("%s%s\n", timing ? "[timing] " : "", suite);
+            }
+
+            const struct outcome *outcome = &outcomes[i];
+            printf("  %-8s %-32s", VERDICT_STRING[outcome->verdict], basename_of(tests[i].path));
+
+            if (outcome->verdict == VERDICT_FAIL) {
+                printf("  #%u", outcome->status);
+            }
+            print_text(outcome->text);
+            printf("\n");
+        }
+    }
+
+    int totals[VERDICTS] = { 0 };
+    for (int i = 0; i < count; i++) {
+        totals[outcomes[i].verdict]++;
+    }
+
+    printf("\n%d tests:", count);
+    for (int verdict = VERDICT_PASS; verdict < VERDICTS; verdict++) {
+        printf(" %d %s", totals[verdict], VERDICT_STRING[verdict]);
+    }
+    printf(" %d %s\n", totals[VERDICT_PENDING], VERDICT_STRING[VERDICT_PENDING]);
+}
+
+int main(int argc, char **argv) {
+    const char *roots[argc];
+    int root_count = 0;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--verbose") == 0) {
+            options.verbose = true;
+        } else if (strcmp(argv[i], "--jobs") == 0 && i + 1 < argc) {
+            options.jobs = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--timeout") == 0 && i + 1 < argc) {
+            options.timeout = atol(argv[++i]);
+        } else if (strcmp(argv[i], "--engine") == 0 && i + 1 < argc && find_engine(argv[i + 1]) != NULL) {
+            current_engine = find_engine(argv[++i]);
+        } else if (argv[i][0] != '-') {
+            roots[root_count++] = argv[i];
+        } else {
+            root_count = 0;
+            break;
+        }
+    }
+
+    if (root_count == 0 || options.timeout <= 0) {
+        fprintf(stderr, "Usage: %s [--jobs N] [--timeout SECONDS] [--engine NAME] [--verbose] DIRECTORY...\n", argv[0]);
+        fprintf(stderr, "Runs every .nes file below DIRECTORY and reads results from the $6000 test protocol\n");
+        exit(EXIT_FAILURE);
+    }
+
+    struct test *tests = NULL;
+    int count = 0;
+    for (int i = 0; i < root_count; i++) {
+        scan(&tests, &count, roots[i], roots[i]);
+    }
+
+    if (count == 0) {
+        fprintf(stderr, "No .nes files found\n");
+        exit(EXIT_FAILURE);
+    }
+
+    qsort(tests, count, sizeof(struct test), compare_tests);
+
+    outcomes = workers_shared(count * sizeof(struct outcome));
+    int *statuses = calloc(count + 1, sizeof(int));
+
+    workers_run(count, options.jobs, !options.verbose, run_job, tests, statuses);
+
+    for (int i = 0; i < count; i++) {
+        if (outcomes[i].verdict == VERDICT_PENDING) {
+            snprintf(outcomes[i].text, sizeof(outcomes[i].text), "emulator exited with status %d after %ld frames", WIFEXITED(statuses[i]) ? WEXITSTATUS(statuses[i]) : -1, outcomes[i].frames);
+        }
+    }
+
+    print_matrix(tests, count);
+
+    int failures = 0;
+    for (int i = 0; i < count; i++) {
+        if (outcomes[i].verdict != VERDICT_PASS && outcomes[i].verdict != VERDICT_UNSUPPORTED) {
+            failures++;
+        }
+    }
+
+    free(statuses);
+    free(tests);
+
+    return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
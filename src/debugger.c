@@ -0,0 +1,764 @@
+#define _DEFAULT_SOURCE
+
+#include <ctype.h>
+#include <poll.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "nes.h"
+#include "debugger.h"
+
+
+#define DEBUGGER_MAX_POINTS 64
+#define DEBUGGER_LINE_LENGTH 256
+#define DEBUGGER_REASON_LENGTH 128
+
+
+enum space {
+    SPACE_CPU,
+    SPACE_PPU,
+};
+
+enum reg {
+    REG_A,
+    REG_X,
+    REG_Y,
+    REG_S,
+    REG_P,
+    REG_PC,
+};
+
+enum comparison {
+    COMPARE_EQ,
+    COMPARE_NE,
+    COMPARE_LT,
+    COMPARE_GT,
+    COMPARE_LE,
+    COMPARE_GE,
+};
+
+const char *REG_STRING[] = { "a", "x", "y", "s", "p", "pc" };
+const char *COMPARISON_STRING[] = { "==", "!=", "<", ">", "<=", ">=" };
+
+struct condition {
+    bool active;
+    enum reg reg;
+    enum comparison comparison;
+    uint16_t value;
+};
+
+// Breakpoints are execute watchpoints on a single address, a point with no type is a bare condition
+struct point {
+    bool used;
+    uint8_t type;
+    enum space space;
+    uint16_t start;
+    uint16_t end;
+    struct condition condition;
+    uint64_t hits;
+};
+
+struct debugger debugger = { 0 };
+
+struct {
+    bool open;
+
+    int input;
+    int listener;
+    int client;
+    FILE *out;
+    const char *socket_path;
+
+    char line[DEBUGGER_LINE_LENGTH];
+    size_t length;
+
+    struct point points[DEBUGGER_MAX_POINTS];
+
+    uint64_t step_instructions;
+    uint64_t stop_cycle;
+    const char *stop_reason;
+
+    // Lets the instruction the debugger stopped on run when execution resumes
+    bool skip;
+
+    // A watchpoint fired during an instruction, stop before the next one
+    bool pending;
+    char reason[DEBUGGER_REASON_LENGTH];
+} session = { .input = -1, .listener = -1, .client = -1, .stop_cycle = UINT64_MAX };
+
+
+// Reads memory without side effects or watchpoint hits, registers read as -1
+static int peek(uint16_t address) {
+    if (address < 0x2000) {
+        return nes.cpu.ram[address & 0x07ff];
+    } else if (address >= 0x8000) {
+        return cartridge.prg_rom[(address - 0x8000) & (cartridge.header.prg_size == 1 ? 0x3fff : 0x7fff)];
+    } else if (address >= 0x6000) {
+        return cartridge.prg_ram[address - 0x6000];
+    }
+    return -1;
+}
+
+static uint16_t register_value(enum reg reg) {
+    switch (reg) {
+        case REG_A: return nes.cpu.a;
+        case REG_X: return nes.cpu.x;
+        case REG_Y: return nes.cpu.y;
+        case REG_S: return nes.cpu.s;
+        case REG_P: return nes.cpu.p;
+        case REG_PC: return nes.cpu.pc;
+    }
+    return 0;
+}
+
+static bool condition_holds(const struct condition *condition) {
+    if (!condition->active) {
+        return true;
+    }
+
+    uint16_t value = register_value(condition->reg);
+
+    switch (condition->comparison) {
+        case COMPARE_EQ: return value == condition->value;
+        case COMPARE_NE: return value != condition->value;
+        case COMPARE_LT: return value < condition->value;
+        case COMPARE_GT: return value > condition->value;
+        case COMPARE_LE: return value <= condition->value;
+        case COMPARE_GE: return value >= condition->value;
+    }
+    return false;
+}
+
+// Mirrors of work RAM are folded so a watch on $0010 also sees $0810
+static bool in_range(const struct point *point, uint16_t address) {
+    if (address >= point->start && address <= point->end) {
+        return true;
+    }
+    return point->space == SPACE_CPU && address < 0x2000 && point->end < 0x2000 &&
+           (address & 0x07ff) >= point->start && (address & 0x07ff) <= point->end;
+}
+
+
+static void print_registers() {
+    if (session.out == NULL) {
+        return;
+    }
+
+    uint16_t pc = nes.cpu.pc;
+    int opcode = peek(pc);
+    enum instruction_name name = opcode >= 0 ? INSTRUCTION_LOOKUP[opcode] : INSTRUCTION_NONE;
+    enum address_mode mode = opcode >= 0 ? ADDRESS_MODE_LOOKUP[opcode] : ADDRESS_MODE_NONE;
+
+    fprintf(session.out, "%04X ", pc);
+    for (int i = 0; i < 3; i++) {
+        int data = peek(pc + i);
+        if (name != INSTRUCTION_NONE && i < instruction_length(mode) && data >= 0) {
+            fprintf(session.out, " %02X", data);
+        } else {
+            fprintf(session.out, "   ");
+        }
+    }
+
+    uint64_t frame_cycle = nes.cpu.cycles - state.frames * CPU_CYCLES_PER_FRAME;
+    fprintf(session.out, "  %-4s A:%02X X:%02X Y:%02X P:%02X SP:%02X CYC:%lu FRAME:%lu SCANLINE:%lu\n",
+            name != INSTRUCTION_NONE ? INSTRUCTION_NAME_STRING[name] : "???", nes.cpu.a, nes.cpu.x, nes.cpu.y,
+            nes.cpu.p, nes.cpu.s, nes.cpu.cycles, state.frames, frame_cycle * 3 / SCANLINE_WIDTH);
+}
+
+static void print_point(int index) {
+    const struct point *point = &session.points[index];
+
+    fprintf(session.out, "#%d ", index);
+    if (point->type == 0) {
+        fprintf(session.out, "until");
+    } else {
+        fprintf(session.out, "%s%s%s%s $%04X", point->space == SPACE_PPU ? "ppu " : "",
+                point->type & WATCH_READ ? "r" : "", point->type & WATCH_WRITE ? "w" : "", point->type & WATCH_EXECUTE ? "x" : "",
+                point->start);
+        if (point->end != point->start) {
+            fprintf(session.out, "-$%04X", point->end);
+        }
+    }
+
+    if (point->condition.active) {
+        fprintf(session.out, " if %s %s $%X", REG_STRING[point->condition.reg], COMPARISON_STRING[point->condition.comparison], point->condition.value);
+    }
+    fprintf(session.out, " hits %lu\n", point->hits);
+}
+
+
+// Recomputes the public flags and rebuilds the memory map around them
+static void update() {
+    bool executing = false;
+    bool conditions = false;
+    bool watching = false;
+
+    for (int i = 0; i < DEBUGGER_MAX_POINTS; i++) {
+        const struct point *point = &session.points[i];
+        if (!point->used || point->space != SPACE_CPU) {
+            continue;
+        }
+
+        executing = executing || (point->type & WATCH_EXECUTE);
+        conditions = conditions || point->type == 0;
+        watching = watching || (point->type & (WATCH_READ | WATCH_WRITE));
+    }
+
+    debugger.watching = watching;
+    debugger.armed = executing || conditions || session.pending || session.step_instructions > 0 || session.stop_cycle != UINT64_MAX;
+
+    map_memory();
+}
+
+void debugger_mask_pages() {
+    // Anything checked on every instruction needs every fetch on the slow path
+    bool every_fetch = session.pending || session.step_instructions > 0 || session.stop_cycle != UINT64_MAX;
+
+    for (int i = 0; i < DEBUGGER_MAX_POINTS; i++) {
+        const struct point *point = &session.points[i];
+        if (!point->used || point->space != SPACE_CPU) {
+            continue;
+        }
+
+        if (point->type == 0) {
+            every_fetch = true;
+            continue;
+        }
+
+        for (int page = point->start >> 8; page <= point->end >> 8; page++) {
+            // Work RAM pages are masked in every mirror
+            for (int mirror = page; mirror < 0x100; mirror += 0x08) {
+                if (point->type & WATCH_READ) {
+                    memory_map.read[mirror] = NULL;
+                }
+                if (point->type & WATCH_WRITE) {
+                    memory_map.write[mirror] = NULL;
+                }
+                if (point->type & WATCH_EXECUTE) {
+                    memory_map.fetch[mirror] = NULL;
+                }
+
+                if (page >= 0x08 || mirror + 0x08 >= 0x20) {
+                    break;
+                }
+            }
+        }
+    }
+
+    if (every_fetch) {
+        memset(memory_map.fetch, 0, sizeof(memory_map.fetch));
+    }
+}
+
+static void stop(const char *reason) {
+    debugger.paused = true;
+    session.pending = false;
+    session.step_instructions = 0;
+    session.stop_cycle = UINT64_MAX;
+    update();
+
+    if (session.out != NULL) {
+        fprintf(session.out, "stopped: %s\n", reason);
+        print_registers();
+    }
+}
+
+static void resume() {
+    debugger.paused = false;
+    update();
+
+    // Only fetches on the slow path consult the skip flag
+    session.skip = memory_map.fetch[nes.cpu.pc >> 8] == NULL;
+}
+
+
+bool debugger_fetch(uint16_t pc) {
+    if (session.skip) {
+        session.skip = false;
+        return false;
+    }
+
+    if (session.pending) {
+        stop(session.reason);
+        return true;
+    }
+
+    if (session.step_instructions > 0 && --session.step_instructions == 0) {
+        stop("step");
+        return true;
+    }
+
+    if (nes.cpu.cycles >= session.stop_cycle) {
+        stop(session.stop_reason);
+        return true;
+    }
+
+    for (int i = 0; i < DEBUGGER_MAX_POINTS; i++) {
+        struct point *point = &session.points[i];
+        if (!point->used || point->space != SPACE_CPU) {
+            continue;
+        }
+
+        bool match = point->type == 0 || ((point->type & WATCH_EXECUTE) && in_range(point, pc));
+        if (match && condition_holds(&point->condition)) {
+            point->hits++;
+            snprintf(session.reason, sizeof(session.reason), "%s #%d at $%04X", point->type == 0 ? "until" : "break", i, pc);
+            stop(session.reason);
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static void check_access(enum space space, uint16_t address, enum watch_type type) {
+    for (int i = 0; i < DEBUGGER_MAX_POINTS; i++) {
+        struct point *point = &session.points[i];
+        if (!point->used || point->space != space || !(point->type & type) || !in_range(point, address)) {
+            continue;
+        }
+
+        if (condition_holds(&point->condition)) {
+            point->hits++;
+            snprintf(session.reason, sizeof(session.reason), "watch #%d %s %s$%04X at $%04X", i,
+                     type == WATCH_READ ? "read" : "write", space == SPACE_PPU ? "ppu " : "", address, nes.cpu.pc);
+
+            // The access is already under way, stop before the next instruction instead
+            session.pending = true;
+            update();
+            return;
+        }
+    }
+}
+
+void debugger_access(uint16_t address, enum watch_type type) {
+    check_access(SPACE_CPU, address, type);
+}
+
+// For PPU memory accesses through PPUDATA
+void debugger_ppu_access(uint16_t address, enum watch_type type) {
+    if (session.open) {
+        check_access(SPACE_PPU, address, type);
+    }
+}
+
+
+static bool parse_number(const char *text, uint16_t *value) {
+    char *end;
+    unsigned long number;
+
+    if (text[0] == '$') {
+        number = strtoul(text + 1, &end, 16);
+    } else {
+        number = strtoul(text, &end, 0);
+    }
+
+    if (end == text || *end != '\0' || number > 0xffff) {
+        return false;
+    }
+    *value = number;
+    return true;
+}
+
+static bool parse_range(const char *text, uint16_t *start, uint16_t *end) {
+    char copy[DEBUGGER_LINE_LENGTH];
+    snprintf(copy, sizeof(copy), "%s", text);
+
+    char *dash = strchr(copy, '-');
+    if (dash != NULL) {
+        *dash = '\0';
+        return parse_number(copy, start) && parse_number(dash + 1, end) && *start <= *end;
+    }
+
+    if (!parse_number(copy, start)) {
+        return false;
+    }
+    *end = *start;
+    return true;
+}
+
+// Conditions are a single comparison like 'a == $10' or 'x>=3'
+static bool parse_condition(const char *text, struct condition *condition) {
+    while (isspace((unsigned char)*text)) {
+        text++;
+    }
+
+    condition->active = false;
+    if (*text == '\0') {
+        return true;
+    }
+
+    bool found = false;
+    for (int reg = REG_PC; reg >= REG_A; reg--) {
+        size_t length = strlen(REG_STRING[reg]);
+        if (strncasecmp(text, REG_STRING[reg], length) == 0) {
+            condition->reg = reg;
+            text += length;
+            found = true;
+            break;
+        }
+    }
+    if (!found) {
+        return false;
+    }
+
+    while (isspace((unsigned char)*text)) {
+        text++;
+    }
+
+    found = false;
+    for (int comparison = COMPARE_GE; comparison >= COMPARE_EQ; comparison--) {
+        size_t length = strlen(COMPARISON_STRING[comparison]);
+        if (strncmp(text, COMPARISON_STRING[comparison], length) == 0) {
+            condition->comparison = comparison;
+            text += length;
+            found = true;
+            break;
+        }
+    }
+    if (!found) {
+        return false;
+    }
+
+    while (isspace((unsigned char)*text)) {
+        text++;
+    }
+
+    char value[DEBUGGER_LINE_LENGTH];
+    snprintf(value, sizeof(value), "%s", text);
+    for (int i = strlen(value) - 1; i >= 0 && isspace((unsigned char)value[i]); i--) {
+        value[i] = '\0';
+    }
+
+    condition->active = true;
+    return parse_number(value, &condition->value);
+}
+
+static int add_point(uint8_t type, enum space space, uint16_t start, uint16_t end, const struct condition *condition) {
+    // Ranges inside one copy of work RAM are stored by their first mirror
+    if (space == SPACE_CPU && end < 0x2000 && end - start < 0x0800 && (start & 0x07ff) <= (end & 0x07ff)) {
+        start &= 0x07ff;
+        end &= 0x07ff;
+    }
+
+    for (int i = 0; i < DEBUGGER_MAX_POINTS; i++) {
+        if (!session.points[i].used) {
+            session.points[i] = (struct point){ .used = true, .type = type, .space = space, .start = start, .end = end, .condition = *condition };
+            update();
+            return i;
+        }
+    }
+    return -1;
+}
+
+// Splits 'ARGS if COND' in place, returning the condition text or NULL
+static char *split_condition(char *args) {
+    char *found = strstr(args, " if ");
+    if (found != NULL) {
+        *found = '\0';
+        return found + 4;
+    }
+    if (strncmp(args, "if ", 3) == 0) {
+        *args = '\0';
+        return args + 3;
+    }
+    return NULL;
+}
+
+
+static void print_help() {
+    fprintf(session.out,
+            "break ADDR [if COND]                  stop before executing ADDR\n"
+            "watch r|w|rw|x START[-END] [ppu] [if COND]\n"
+            "                                      stop after an access to the range\n"
+            "until COND                            stop once COND holds, checked every instruction\n"
+            "delete N|all                          remove a break, watch or until\n"
+            "list                                  show breaks and watches\n"
+            "continue | c                          resume\n"
+            "step [N] | s                          run N instructions\n"
+            "scanline                              run to the next scanline\n"
+            "frame                                 run to the next frame\n"
+            "pause                                 stop at the next frame boundary\n"
+            "regs                                  show registers\n"
+            "mem ADDR [LENGTH]                     dump CPU memory\n"
+            "quit                                  exit the emulator\n"
+            "COND is REG OP VALUE with REG one of a x y s p pc and OP one of == != < > <= >=\n");
+}
+
+static void run_command(char *line) {
+    char *command = strtok(line, " \t");
+    if (command == NULL) {
+        return;
+    }
+    char *args = strtok(NULL, "");
+    if (args == NULL) {
+        args = "";
+    }
+
+    struct condition condition = { 0 };
+
+    if (strcmp(command, "break") == 0 || strcmp(command, "b") == 0) {
+        char *condition_text = split_condition(args);
+        char *address_text = strtok(args, " \t");
+        uint16_t address;
+        if (address_text == NULL || !parse_number(address_text, &address) || (condition_text != NULL && !parse_condition(condition_text, &condition))) {
+            fprintf(session.out, "error: usage: break ADDR [if COND]\n");
+            return;
+        }
+
+        int index = add_point(WATCH_EXECUTE, SPACE_CPU, address, address, &condition);
+        if (index < 0) {
+            fprintf(session.out, "error: too many points\n");
+        } else {
+            print_point(index);
+        }
+    } else if (strcmp(command, "watch") == 0 || strcmp(command, "w") == 0) {
+        char *condition_text = split_condition(args);
+        char *kind = strtok(args, " \t");
+        char *range = strtok(NULL, " \t");
+        char *space_text = strtok(NULL, " \t");
+
+        uint8_t type = 0;
+        for (const char *c = kind != NULL ? kind : ""; *c != '\0'; c++) {
+            type |= *c == 'r' ? WATCH_READ : *c == 'w' ? WATCH_WRITE : *c == 'x' ? WATCH_EXECUTE : 0x80;
+        }
+
+        enum space space = space_text != NULL && strcmp(space_text, "ppu") == 0 ? SPACE_PPU : SPACE_CPU;
+        uint16_t start, end;
+
+        if (type == 0 || (type & 0x80) || range == NULL || !parse_range(range, &start, &end) ||
+            (space_text != NULL && space == SPACE_CPU && strcmp(space_text, "cpu") != 0) ||
+            (space == SPACE_PPU && (type & WATCH_EXECUTE)) ||
+            (condition_text != NULL && !parse_condition(condition_text, &condition))) {
+            fprintf(session.out, "error: usage: watch r|w|rw|x START[-END] [cpu|ppu] [if COND]\n");
+            return;
+        }
+
+        int index = add_point(type, space, start, end, &condition);
+        if (index < 0) {
+            fprintf(session.out, "error: too many points\n");
+        } else {
+            print_point(index);
+        }
+    } else if (strcmp(command, "until") == 0) {
+        if (!parse_condition(args, &condition) || !condition.active) {
+            fprintf(session.out, "error: usage: until COND\n");
+            return;
+        }
+
+        int index = add_point(0, SPACE_CPU, 0, 0, &condition);
+        if (index < 0) {
+            fprintf(session.out, "error: too many points\n");
+        } else {
+            print_point(index);
+        }
+    } else if (strcmp(command, "delete") == 0 || strcmp(command, "d") == 0) {
+        if (strcmp(args, "all") == 0) {
+            memset(session.points, 0, sizeof(session.points));
+        } else {
+            int index = atoi(args);
+            if (index < 0 || index >= DEBUGGER_MAX_POINTS || !session.points[index].used) {
+                fprintf(session.out, "error: no point %s\n", args);
+                return;
+            }
+            session.points[index].used = false;
+        }
+        update();
+        fprintf(session.out, "ok\n");
+    } else if (strcmp(command, "list") == 0 || strcmp(command, "l") == 0) {
+        for (int i = 0; i < DEBUGGER_MAX_POINTS; i++) {
+            if (session.points[i].used) {
+                print_point(i);
+            }
+        }
+        fprintf(session.out, "ok\n");
+    } else if (strcmp(command, "continue") == 0 || strcmp(command, "c") == 0) {
+        resume();
+        fprintf(session.out, "running\n");
+    } else if (strcmp(command, "step") == 0 || strcmp(command, "s") == 0) {
+        long count = args[0] != '\0' ? atol(args) : 1;
+        session.step_instructions = count > 0 ? count : 1;
+        resume();
+    } else if (strcmp(command, "scanline") == 0) {
+        uint64_t frame_start = state.frames * CPU_CYCLES_PER_FRAME;
+        uint64_t line = (nes.cpu.cycles - frame_start) * 3 / SCANLINE_WIDTH;
+        session.stop_cycle = frame_start + ((line + 1) * SCANLINE_WIDTH + 2) / 3;
+        session.stop_reason = "scanline";
+        resume();
+    } else if (strcmp(command, "frame") == 0) {
+        session.stop_cycle = (state.frames + 1) * CPU_CYCLES_PER_FRAME;
+        session.stop_reason = "frame";
+        resume();
+    } else if (strcmp(command, "pause") == 0) {
+        debugger.paused = true;
+        fprintf(session.out, "stopped: pause\n");
+        print_registers();
+    } else if (strcmp(command, "regs") == 0 || strcmp(command, "r") == 0) {
+        print_registers();
+    } else if (strcmp(command, "mem") == 0 || strcmp(command, "m") == 0) {
+        char *address_text = strtok(args, " \t");
+        char *length_text = strtok(NULL, " \t");
+        uint16_t address, length = 16;
+        if (address_text == NULL || !parse_number(address_text, &address) || (length_text != NULL && !parse_number(length_text, &length))) {
+            fprintf(session.out, "error: usage: mem ADDR [LENGTH]\n");
+            return;
+        }
+
+        for (uint32_t i = 0; i < length; i++) {
+            if (i % 16 == 0) {
+                fprintf(session.out, "%s%04X:", i > 0 ? "\n" : "", (uint16_t)(address + i));
+            }
+            int data = peek(address + i);
+            if (data >= 0) {
+                fprintf(session.out, " %02X", data);
+            } else {
+                fprintf(session.out, " --");
+            }
+        }
+        fprintf(session.out, "\n");
+    } else if (strcmp(command, "quit") == 0 || strcmp(command, "q") == 0) {
+        exit(EXIT_SUCCESS);
+    } else if (strcmp(command, "help") == 0 || strcmp(command, "h") == 0) {
+        print_help();
+    } else {
+        fprintf(session.out, "error: unknown command %s, try help\n", command);
+    }
+}
+
+
+static void drop_client() {
+    if (session.out != NULL && session.client >= 0) {
+        fclose(session.out);
+        session.out = NULL;
+    }
+    if (session.client >= 0) {
+        close(session.client);
+        session.client = -1;
+    }
+    session.input = -1;
+    session.length = 0;
+}
+
+static void read_commands() {
+    char buffer[DEBUGGER_LINE_LENGTH];
+    ssize_t count = read(session.input, buffer, sizeof(buffer));
+
+    if (count <= 0) {
+        // Losing the controlling end should not leave the emulator stuck
+        drop_client();
+        if (debugger.paused) {
+            resume();
+        }
+        return;
+    }
+
+    for (ssize_t i = 0; i < count; i++) {
+        if (buffer[i] == '\n' || buffer[i] == '\r') {
+            session.line[session.length] = '\0';
+            session.length = 0;
+
+            if (session.out != NULL) {
+                run_command(session.line);
+                fflush(session.out);
+            }
+        } else if (session.length + 1 < sizeof(session.line)) {
+            session.line[session.length++] = buffer[i];
+        }
+    }
+}
+
+void debugger_poll(int timeout_ms) {
+    if (!session.open) {
+        return;
+    }
+
+    struct pollfd fds[2];
+    int count = 0;
+
+    if (session.input >= 0) {
+        fds[count++] = (struct pollfd){ .fd = session.input, .events = POLLIN };
+    }
+    if (session.listener >= 0 && session.client < 0) {
+        fds[count++] = (struct pollfd){ .fd = session.listener, .events = POLLIN };
+    }
+
+    if (count == 0 || poll(fds, count, timeout_ms) <= 0) {
+        return;
+    }
+
+    for (int i = 0; i < count; i++) {
+        if (fds[i].revents == 0) {
+            continue;
+        }
+
+        if (fds[i].fd == session.listener) {
+            session.client = accept(session.listener, NULL, NULL);
+            if (session.client >= 0) {
+                session.input = session.client;
+                session.out = fdopen(dup(session.client), "w");
+                fprintf(session.out, "cnes debugger, %s\n", debugger.paused ? "paused" : "running");
+                fflush(session.out);
+            }
+        } else {
+            read_commands();
+        }
+    }
+}
+
+bool debugger_open(const char *socket_path) {
+    if (socket_path == NULL) {
+        session.input = STDIN_FILENO;
+        session.out = stdout;
+    } else {
+        struct sockaddr_un address = { .sun_family = AF_UNIX };
+        if (strlen(socket_path) >= sizeof(address.sun_path)) {
+            logf_warning("Debugger socket path is too long: %s\n", socket_path);
+            return false;
+        }
+        strcpy(address.sun_path, socket_path);
+
+        session.listener = socket(AF_UNIX, SOCK_STREAM, 0);
+        unlink(socket_path);
+        if (session.listener < 0 || bind(session.listener, (struct sockaddr *)&address, sizeof(address)) != 0 || listen(session.listener, 1) != 0) {
+            logf_warning("Unable to listen on debugger socket %s\n", socket_path);
+            if (session.listener >= 0) {
+                close(session.listener);
+                session.listener = -1;
+            }
+            return false;
+        }
+        session.socket_path = socket_path;
+    }
+
+    session.open = true;
+
+    // Start stopped at the reset vector so breakpoints can be placed first
+    debugger.paused = true;
+    if (session.out != NULL) {
+        fprintf(session.out, "cnes debugger, paused at reset, try help\n");
+        print_registers();
+        fflush(session.out);
+    }
+
+    return true;
+}
+
+void debugger_close() {
+    if (!session.open) {
+        return;
+    }
+
+    drop_client();
+    if (session.listener >= 0) {
+        close(session.listener);
+        session.listener = -1;
+        unlink(session.socket_path);
+    }
+
+    session.open = false;
+}
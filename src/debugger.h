@@ -0,0 +1,41 @@
+#ifndef DEBUGGER_H
+#define DEBUGGER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Breakpoints, watchpoints and stepping driven by a line-based command
+// interface on stdin or a Unix socket. Nothing is checked per access: armed
+// pages are removed from the memory map so only accesses to them reach the
+// slow path, where debugger_fetch() and debugger_access() are called.
+
+enum watch_type {
+    WATCH_READ    = 1 << 0,
+    WATCH_WRITE   = 1 << 1,
+    WATCH_EXECUTE = 1 << 2,
+};
+
+struct debugger {
+    // Something needs fetches from masked pages to be checked
+    bool armed;
+
+    // At least one read or write watchpoint on CPU memory
+    bool watching;
+
+    bool paused;
+};
+
+extern struct debugger debugger;
+
+bool debugger_open(const char *socket_path);
+void debugger_close();
+
+// Reads and runs pending commands, waiting up to timeout_ms for input
+void debugger_poll(int timeout_ms);
+
+void debugger_mask_pages();
+bool debugger_fetch(uint16_t pc);
+void debugger_access(uint16_t address, enum watch_type type);
+void debugger_ppu_access(uint16_t address, enum watch_type type);
+
+#endif
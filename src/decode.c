@@ -0,0 +1,498 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "nes.h"
+#include "decode.h"
+
+
+// One decoded instruction. Static operands are resolved once, the other modes
+// still go through read_operand() when the instruction runs.
+struct op {
+    uint8_t name;
+    uint8_t mode;
+    uint8_t cycles;
+    uint8_t length;
+    bool dynamic;
+    uint16_t address;
+
+    // Where a taken branch goes
+    uint16_t target;
+};
+
+enum fusion {
+    FUSION_NONE,
+    FUSION_LOAD_STORE,      // LDA/LDX/LDY then STA/STX/STY
+    FUSION_COMPARE_BRANCH,  // CMP/CPX/CPY then a branch
+    FUSION_COUNT_BRANCH,    // INX/INY/DEX/DEY then a branch
+    FUSION_TEST_BRANCH,     // LDA/LDX/LDY/BIT then a branch, mostly polling loops
+    FUSION_STEP_LOAD,       // INC/DEC then LDA/LDX/LDY
+    FUSION_COUNT,
+};
+
+const char *FUSION_STRING[] = {
+    "none", "load/store", "compare/branch", "count/branch", "test/branch", "inc-dec/load",
+};
+
+struct decoded {
+    bool valid;
+
+    // Left to execute_next(), for undocumented opcodes and unmapped code
+    bool interpret;
+
+    uint8_t fusion;
+    struct op first;
+    struct op second;
+};
+
+// Decoded PRG at $8000-$FFFF, RAM is never cached because it can be rewritten
+struct {
+    uint32_t generation;
+    struct decoded cache[0x8000];
+
+    uint64_t instructions;
+    uint64_t hits[FUSION_COUNT];
+} decoder = { 0 };
+
+
+static bool decode_op(uint16_t pc, struct op *op) {
+    uint8_t bytes[3] = { 0 };
+    uint8_t *page = memory_map.fetch[pc >> 8];
+    if (pc < 0x8000 || page == NULL) {
+        return false;
+    }
+
+    bytes[0] = page[pc & 0xff];
+    if (INSTRUCTION_LOOKUP[bytes[0]] == INSTRUCTION_NONE) {
+        return false;
+    }
+
+    op->name = INSTRUCTION_LOOKUP[bytes[0]];
+    op->mode = ADDRESS_MODE_LOOKUP[bytes[0]];
+    op->length = instruction_length(op->mode);
+    op->cycles = INSTRUCTION_CYCLES[op->name] + ADDRESS_MODE_CYCLES[op->mode];
+
+    for (uint16_t i = 1; i < op->length; i++) {
+        uint16_t address = pc + i;
+        if (address < 0x8000 || memory_map.fetch[address >> 8] == NULL) {
+            return false;
+        }
+        bytes[i] = memory_map.fetch[address >> 8][address & 0xff];
+    }
+
+    op->dynamic = false;
+    op->target = pc + 2 + (int8_t)bytes[1];
+
+    switch (op->mode) {
+        case IMPLICIT:
+        case ACCUMULATOR:
+            op->address = 0;
+            break;
+        case IMMEDIATE:
+        case RELATIVE:
+            op->address = pc + 1;
+            break;
+        case ZERO_PAGE:
+            op->address = bytes[1];
+            break;
+        case ABSOLUTE:
+            op->address = bytes[1] | bytes[2] << 8;
+            break;
+        default:
+            op->dynamic = true;
+            break;
+    }
+
+    return true;
+}
+
+static bool is_branch(enum instruction_name name) {
+    switch (name) {
+        case BCC: case BCS: case BEQ: case BMI: case BNE: case BPL: case BVC: case BVS:
+            return true;
+        default:
+            return false;
+    }
+}
+
+static enum fusion find_fusion(const struct op *first, const struct op *second) {
+    bool static_operand = first->mode == IMMEDIATE || first->mode == ZERO_PAGE || first->mode == ABSOLUTE;
+    bool static_load = (second->name == LDA || second->name == LDX || second->name == LDY) &&
+                       (second->mode == IMMEDIATE || second->mode == ZERO_PAGE || second->mode == ABSOLUTE);
+
+    switch (first->name) {
+        case LDA: case LDX: case LDY:
+            if (static_operand && (second->name == STA || second->name == STX || second->name == STY) &&
+                (second->mode == ZERO_PAGE || second->mode == ABSOLUTE)) {
+                return FUSION_LOAD_STORE;
+            }
+            return static_operand && is_branch(second->name) ? FUSION_TEST_BRANCH : FUSION_NONE;
+        case BIT:
+            return is_branch(second->name) ? FUSION_TEST_BRANCH : FUSION_NONE;
+        case CMP: case CPX: case CPY:
+            return static_operand && is_branch(second->name) ? FUSION_COMPARE_BRANCH : FUSION_NONE;
+        case INX: case INY: case DEX: case DEY:
+            return is_branch(second->name) ? FUSION_COUNT_BRANCH : FUSION_NONE;
+        case INC: case DEC:
+            return static_operand && static_load ? FUSION_STEP_LOAD : FUSION_NONE;
+        default:
+            return FUSION_NONE;
+    }
+}
+
+static void decode(uint16_t pc, struct decoded *decoded) {
+    memset(decoded, 0, sizeof(*decoded));
+    decoded->valid = true;
+
+    if (!decode_op(pc, &decoded->first)) {
+        decoded->interpret = true;
+        return;
+    }
+
+    // The second instruction keeps its own entry too, for jumps straight to it
+    if (decode_op(pc + decoded->first.length, &decoded->second)) {
+        decoded->fusion = find_fusion(&decoded->first, &decoded->second);
+    }
+}
+
+static const struct decoded *lookup(uint16_t pc) {
+    if (pc < 0x8000) {
+        return NULL;
+    }
+
+    if (decoder.generation != memory_map.generation) {
+        memset(decoder.cache, 0, sizeof(decoder.cache));
+        decoder.generation = memory_map.generation;
+    }
+
+    struct decoded *decoded = &decoder.cache[pc - 0x8000];
+    if (!decoded->valid) {
+        decode(pc, decoded);
+    }
+
+    return decoded->interpret ? NULL : decoded;
+}
+
+
+// Registers decode_run() keeps in locals for a whole batch. They are written back to
+// nes.cpu only at sync points: around instructions left to the interpreter, before
+// slow-path memory accesses that log the PC, and when the batch ends.
+struct registers {
+    uint16_t pc;
+    uint8_t a, x, y, p;
+};
+
+static void sync_out(const struct registers *r) {
+    nes.cpu.pc = r->pc;
+    nes.cpu.a = r->a;
+    nes.cpu.x = r->x;
+    nes.cpu.y = r->y;
+    nes.cpu.p = r->p;
+}
+
+static void sync_in(struct registers *r) {
+    r->pc = nes.cpu.pc;
+    r->a = nes.cpu.a;
+    r->x = nes.cpu.x;
+    r->y = nes.cpu.y;
+    r->p = nes.cpu.p;
+}
+
+static uint8_t *op_register(struct registers *r, enum instruction_name name) {
+    switch (name) {
+        case LDX: case STX: case CPX: case INX: case DEX: case TAX:
+            return &r->x;
+        case LDY: case STY: case CPY: case INY: case DEY: case TAY:
+            return &r->y;
+        default:
+            return &r->a;
+    }
+}
+
+static void set_nz(struct registers *r, uint8_t value) {
+    r->p = (r->p & ~((1 << NEGATIVE) | (1 << ZERO))) | (value & (1 << NEGATIVE)) | (value == 0 ? 1 << ZERO : 0);
+}
+
+static void set_bit(struct registers *r, enum flag flag, bool value) {
+    r->p = (r->p & ~(1 << flag)) | (value ? 1 << flag : 0);
+}
+
+static bool get_bit(const struct registers *r, enum flag flag) {
+    return r->p >> flag & 1;
+}
+
+// The slow paths only look at the PC for their log messages, so that is all they get
+static uint8_t load(const struct registers *r, uint16_t address) {
+    uint8_t *page = memory_map.read[address >> 8];
+    if (page != NULL) {
+        return page[address & 0xff];
+    }
+    nes.cpu.pc = r->pc;
+    return cpu_read_8(address);
+}
+
+static void store(const struct registers *r, uint16_t address, uint8_t value) {
+    nes.cpu.pc = r->pc;
+    cpu_write_8(address, value);
+}
+
+static bool branch_taken(const struct registers *r, enum instruction_name name) {
+    switch (name) {
+        case BCC: return !get_bit(r, CARRY);
+        case BCS: return get_bit(r, CARRY);
+        case BEQ: return get_bit(r, ZERO);
+        case BNE: return !get_bit(r, ZERO);
+        case BMI: return get_bit(r, NEGATIVE);
+        case BPL: return !get_bit(r, NEGATIVE);
+        case BVC: return !get_bit(r, OVERFLOW);
+        default: return get_bit(r, OVERFLOW);
+    }
+}
+
+// Same timing as the interpreter's branches, BEQ included, and the same step past branches to themselves
+static int run_branch(const struct op *op, struct registers *r) {
+    uint16_t pc = r->pc;
+    if (!branch_taken(r, op->name)) {
+        r->pc = pc + 2;
+        return op->cycles;
+    }
+
+    int cycles = op->cycles + 1;
+    if (op->name != BEQ && op->target >> 8 != pc >> 8) {
+        cycles += 2;
+    }
+
+    r->pc = op->target == pc ? pc + 2 : op->target;
+    return cycles;
+}
+
+// Runs a single decoded instruction exactly like execute_next()
+static int run_op(const struct op *op) {
+    uint16_t pc = nes.cpu.pc;
+    uint16_t address = op->dynamic ? read_operand(op->mode) : op->address;
+
+    int cycles = op->cycles + INSTRUCTION_FUNCTIONS[op->name](op->mode, address);
+
+    if (nes.cpu.pc == pc) {
+        nes.cpu.pc += op->length;
+    }
+
+    return cycles;
+}
+
+// The common instructions with static operands, on the cached registers. Returns 0 for
+// anything else, which then goes through run_op() after a sync.
+static int run_cached(const struct op *op, struct registers *r) {
+    uint8_t *reg = op_register(r, op->name);
+    uint8_t value;
+    int result;
+
+    if (op->dynamic) {
+        return 0;
+    }
+
+    switch (op->name) {
+        case LDA: case LDX: case LDY:
+            *reg = load(r, op->address);
+            set_nz(r, *reg);
+            break;
+        case STA: case STX: case STY:
+            store(r, op->address, *reg);
+            break;
+        case AND:
+            r->a &= load(r, op->address);
+            set_nz(r, r->a);
+            break;
+        case ORA:
+            r->a |= load(r, op->address);
+            set_nz(r, r->a);
+            break;
+        case EOR:
+            r->a ^= load(r, op->address);
+            set_nz(r, r->a);
+            break;
+        case ADC: case SBC:
+            value = load(r, op->address);
+            value = op->name == SBC ? ~value : value;
+            result = r->a + value + get_bit(r, CARRY);
+            set_bit(r, CARRY, result > 0xff);
+            set_bit(r, OVERFLOW, ~(r->a ^ value) & (r->a ^ result) & 0x80);
+            r->a = result;
+            set_nz(r, r->a);
+            break;
+        case CMP: case CPX: case CPY:
+            value = load(r, op->address);
+            set_bit(r, CARRY, *reg >= value);
+            set_nz(r, *reg - value);
+            break;
+        case INX: case INY:
+            set_nz(r, ++*reg);
+            break;
+        case DEX: case DEY:
+            set_nz(r, --*reg);
+            break;
+        case TAX: case TAY:
+            *reg = r->a;
+            set_nz(r, *reg);
+            break;
+        case TXA:
+            r->a = r->x;
+            set_nz(r, r->a);
+            break;
+        case TYA:
+            r->a = r->y;
+            set_nz(r, r->a);
+            break;
+        case CLC: case SEC:
+            set_bit(r, CARRY, op->name == SEC);
+            break;
+        case CLI: case SEI:
+            set_bit(r, INTERRUPT, op->name == SEI);
+            break;
+        case CLD: case SED:
+            set_bit(r, DECIMAL, op->name == SED);
+            break;
+        case CLV:
+            set_bit(r, OVERFLOW, false);
+            break;
+        case NOP:
+            if (op->mode != IMPLICIT) {
+                return 0;
+            }
+            break;
+        case JMP:
+            r->pc = op->address == r->pc ? r->pc + op->length : op->address;
+            return op->cycles;
+        case BCC: case BCS: case BEQ: case BMI: case BNE: case BPL: case BVC: case BVS:
+            return run_branch(op, r);
+        default:
+            return 0;
+    }
+
+    r->pc += op->length;
+    return op->cycles;
+}
+
+// Both instructions of a pair in one handler. The first has no extra cycles with a static
+// operand, and the PC moves to the second before its memory access for the slow path's logging.
+static int run_fused(const struct decoded *decoded, struct registers *r) {
+    const struct op *first = &decoded->first;
+    const struct op *second = &decoded->second;
+    uint16_t second_pc = r->pc + first->length;
+    uint8_t *reg = op_register(r, first->name);
+    uint8_t value;
+
+    switch (decoded->fusion) {
+        case FUSION_LOAD_STORE:
+            value = load(r, first->address);
+            *reg = value;
+            set_nz(r, value);
+
+            r->pc = second_pc;
+            store(r, second->address, *op_register(r, second->name));
+            r->pc = second_pc + second->length;
+            return first->cycles + second->cycles;
+
+        case FUSION_COMPARE_BRANCH:
+            value = load(r, first->address);
+            set_bit(r, CARRY, *reg >= value);
+            set_nz(r, *reg - value);
+            r->pc = second_pc;
+            return first->cycles + run_branch(second, r);
+
+        case FUSION_COUNT_BRANCH:
+            *reg += first->name == INX || first->name == INY ? 1 : -1;
+            set_nz(r, *reg);
+            r->pc = second_pc;
+            return first->cycles + run_branch(second, r);
+
+        case FUSION_TEST_BRANCH:
+            value = load(r, first->address);
+            if (first->name == BIT) {
+                set_bit(r, ZERO, (r->a & value) == 0);
+                set_bit(r, OVERFLOW, value & (1 << OVERFLOW));
+                set_bit(r, NEGATIVE, value & (1 << NEGATIVE));
+            } else {
+                *reg = value;
+                set_nz(r, value);
+            }
+            r->pc = second_pc;
+            return first->cycles + run_branch(second, r);
+
+        default:
+            value = load(r, first->address) + (first->name == INC ? 1 : -1);
+            set_nz(r, value);
+            store(r, first->address, value);
+
+            r->pc = second_pc;
+            value = load(r, second->address);
+            *op_register(r, second->name) = value;
+            set_nz(r, value);
+            r->pc = second_pc + second->length;
+            return first->cycles + second->cycles;
+    }
+}
+
+
+int decode_step() {
+    const struct decoded *decoded = lookup(nes.cpu.pc);
+    if (decoded == NULL) {
+        return execute_next();
+    }
+    return run_op(&decoded->first);
+}
+
+int decode_run(int budget, uint32_t *instructions) {
+    struct registers r;
+    int cycles = 0;
+    uint32_t count = 0;
+
+    sync_in(&r);
+
+    do {
+        const struct decoded *decoded = lookup(r.pc);
+        int executed;
+
+        if (decoded != NULL && decoded->fusion != FUSION_NONE) {
+            cycles += run_fused(decoded, &r);
+            count += 2;
+            decoder.hits[decoded->fusion]++;
+            continue;
+        }
+
+        if (decoded != NULL && (executed = run_cached(&decoded->first, &r)) != 0) {
+            cycles += executed;
+            count++;
+            continue;
+        }
+
+        // Everything else reads and writes nes.cpu directly
+        sync_out(&r);
+        executed = decoded == NULL ? execute_next() : run_op(&decoded->first);
+        sync_in(&r);
+
+        if (executed == 0) {
+            break;
+        }
+        cycles += executed;
+        count++;
+    } while (cycles < budget);
+
+    sync_out(&r);
+
+    decoder.instructions += count;
+    if (instructions != NULL) {
+        *instructions = count;
+    }
+
+    return cycles;
+}
+
+void decode_report(FILE *f) {
+    fprintf(f, "fused pairs over %lu instructions:\n", decoder.instructions);
+
+    for (int i = FUSION_NONE + 1; i < FUSION_COUNT; i++) {
+        double share = decoder.instructions > 0 ? 200.0 * decoder.hits[i] / decoder.instructions : 0;
+        fprintf(f, "  %-16s %12lu  %5.1f%% of instructions\n", FUSION_STRING[i], decoder.hits[i], share);
+    }
+}
@@ -0,0 +1,18 @@
+#ifndef DECODE_H
+#define DECODE_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+// Pre-decoding interpreter. PRG instructions are decoded once into a cache and
+// common pairs such as LDA/STA, CMP/BNE and DEX/BNE are fused so decode_run()
+// dispatches them as one handler. decode_step() never fuses, so cnes-lockstep
+// checks single instructions and --blocks checks the fused pairs.
+
+int decode_step();
+int decode_run(int budget, uint32_t *instructions);
+
+// Prints how often each fused pair ran
+void decode_report(FILE *f);
+
+#endif
@@ -0,0 +1,393 @@
+#include <ctype.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "nes.h"
+#include "instructions.h"
+#include "codemap.h"
+
+
+#define DISASM_LINE_LENGTH 512
+
+const uint16_t PRG_START = 0x8000;
+
+// Number of data bytes per .byte line in the listing
+const int DATA_PER_LINE = 8;
+
+
+struct {
+    uint8_t *map;
+    uint32_t prg_length;
+
+    // Listing base, NROM-128 is shown at $C000 where its vectors live
+    uint16_t origin;
+
+    bool labels[0x10000];
+
+    uint16_t *work;
+    uint32_t work_count;
+    uint32_t work_capacity;
+
+    uint32_t conflicts;
+    uint32_t invalid;
+} disasm = { 0 };
+
+
+static uint32_t prg_offset(uint16_t address) {
+    return (address - PRG_START) & (disasm.prg_length - 1);
+}
+
+static uint8_t prg_byte(uint16_t address) {
+    return cartridge.prg_rom[prg_offset(address)];
+}
+
+static void push(uint16_t address) {
+    if (address < PRG_START) {
+        return;
+    }
+
+    if (disasm.work_count == disasm.work_capacity) {
+        disasm.work_capacity = disasm.work_capacity > 0 ? disasm.work_capacity * 2 : 1024;
+        disasm.work = realloc(disasm.work, disasm.work_capacity * sizeof(uint16_t));
+        if (disasm.work == NULL) {
+            fprintf(stderr, "Unable to allocate work list\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    disasm.work[disasm.work_count++] = address;
+}
+
+static void mark_data(uint16_t address, uint32_t length) {
+    for (uint32_t i = 0; i < length; i++) {
+        if (address + i >= PRG_START) {
+            disasm.map[prg_offset(address + i)] |= CODE_MAP_DATA;
+        }
+    }
+}
+
+// Follows one path of execution until it leaves PRG, returns or meets known code
+static void trace_path(uint16_t address) {
+    for (;;) {
+        if (address < PRG_START) {
+            return;
+        }
+
+        uint8_t *flags = &disasm.map[prg_offset(address)];
+        if (*flags & CODE_MAP_OPCODE) {
+            return;
+        }
+        if (*flags & CODE_MAP_CODE) {
+            // Jumping into the middle of another instruction, either a trick or a wrong guess
+            disasm.conflicts++;
+            return;
+        }
+
+        uint8_t opcode = prg_byte(address);
+        enum instruction_name name = INSTRUCTION_LOOKUP[opcode];
+        enum address_mode mode = ADDRESS_MODE_LOOKUP[opcode];
+
+        if (name == INSTRUCTION_NONE) {
+            disasm.invalid++;
+            return;
+        }
+
+        uint16_t length = instruction_length(mode);
+        for (uint16_t i = 0; i < length; i++) {
+            disasm.map[prg_offset(address + i)] |= CODE_MAP_CODE;
+        }
+        *flags |= CODE_MAP_OPCODE;
+
+        uint16_t operand = length == 3 ? prg_byte(address + 1) | (prg_byte(address + 2) << 8) : prg_byte(address + 1);
+        uint16_t next = address + length;
+
+        if (mode == RELATIVE) {
+            uint16_t target = next + (int8_t)operand;
+            disasm.labels[target] = true;
+            push(target);
+        } else if (name == JSR || (name == JMP && mode == ABSOLUTE)) {
+            disasm.labels[operand] = true;
+            push(operand);
+        } else if (name == JMP && mode == INDIRECT && operand >= PRG_START) {
+            // The pointer sits in ROM so the target is known, the 6502 does not carry into the high byte
+            uint16_t high = (operand & 0xff00) | ((operand + 1) & 0x00ff);
+            uint16_t target = prg_byte(operand) | (prg_byte(high) << 8);
+            mark_data(operand, 1);
+            mark_data(high, 1);
+            disasm.labels[target] = true;
+            push(target);
+        }
+
+        if (name == JMP || name == RTS || name == RTI || name == BRK) {
+            return;
+        }
+
+        address = next;
+    }
+}
+
+static void run_work() {
+    while (disasm.work_count > 0) {
+        trace_path(disasm.work[--disasm.work_count]);
+    }
+}
+
+
+// Lines of a --debug trace start with the PC of an executed instruction
+static uint32_t load_trace(const char *filename) {
+    FILE *f = fopen(filename, "r");
+    if (f == NULL) {
+        fprintf(stderr, "Unable to open trace %s\n", filename);
+        exit(EXIT_FAILURE);
+    }
+
+    uint32_t count = 0;
+    char line[DISASM_LINE_LENGTH];
+
+    while (fgets(line, sizeof(line), f) != NULL) {
+        bool hex = true;
+        for (int i = 0; i < 4; i++) {
+            hex = hex && isxdigit((unsigned char)line[i]);
+        }
+        if (!hex || line[4] != ' ' || line[5] != ' ') {
+            continue;
+        }
+
+        uint16_t pc = strtoul(line, NULL, 16);
+        if (pc >= PRG_START && !(disasm.map[prg_offset(pc)] & CODE_MAP_OPCODE)) {
+            push(pc);
+            count++;
+        }
+    }
+
+    fclose(f);
+    return count;
+}
+
+// An existing map, from an earlier run of this tool or FCEUX, contributes its code and data bits
+static void load_map(const char *filename) {
+    size_t length = 0;
+    uint8_t *data = read_file(filename, &length);
+    if (data == NULL) {
+        fprintf(stderr, "Unable to read code map %s\n", filename);
+        exit(EXIT_FAILURE);
+    }
+
+    for (uint32_t i = 0; i < disasm.prg_length && i < length; i++) {
+        disasm.map[i] |= data[i] & CODE_MAP_DATA;
+
+        if (data[i] & CODE_MAP_OPCODE) {
+            push(disasm.origin + i);
+        } else if ((data[i] & CODE_MAP_CODE) && (i == 0 || !(data[i - 1] & CODE_MAP_CODE))) {
+            // FCEUX has no opcode bit, the start of each run of code bytes is the best guess
+            push(disasm.origin + i);
+        }
+    }
+
+    free(data);
+}
+
+
+static void format_operand(char *text, size_t size, uint16_t address, enum address_mode mode) {
+    uint8_t low = prg_byte(address + 1);
+    uint16_t word = low | (prg_byte(address + 2) << 8);
+
+    char target[16];
+    snprintf(target, sizeof(target), disasm.labels[word] && word >= PRG_START ? "L%04X" : "$%04X", word);
+
+    switch (mode) {
+        case IMPLICIT: snprintf(text, size, "%s", ""); break;
+        case ACCUMULATOR: snprintf(text, size, "A"); break;
+        case IMMEDIATE: snprintf(text, size, "#$%02X", low); break;
+        case ZERO_PAGE: snprintf(text, size, "$%02X", low); break;
+        case ZERO_PAGE_X: snprintf(text, size, "$%02X,X", low); break;
+        case ZERO_PAGE_Y: snprintf(text, size, "$%02X,Y", low); break;
+        case ABSOLUTE: snprintf(text, size, "%s", target); break;
+        case ABSOLUTE_X: snprintf(text, size, "%s,X", target); break;
+        case ABSOLUTE_Y: snprintf(text, size, "%s,Y", target); break;
+        case INDIRECT: snprintf(text, size, "(%s)", target); break;
+        case INDEXED_INDIRECT: snprintf(text, size, "($%02X,X)", low); break;
+        case INDIRECT_INDEXED: snprintf(text, size, "($%02X),Y", low); break;
+        case RELATIVE: {
+            uint16_t destination = address + 2 + (int8_t)low;
+            snprintf(text, size, "L%04X", destination);
+            break;
+        }
+        default: snprintf(text, size, "?"); break;
+    }
+}
+
+static void write_listing(FILE *f) {
+    uint32_t length = disasm.prg_length < 0x8000 ? disasm.prg_length : 0x8000;
+    uint32_t i = 0;
+
+    while (i < length) {
+        uint16_t address = disasm.origin + i;
+        uint8_t flags = disasm.map[i];
+
+        if (disasm.labels[address]) {
+            fprintf(f, "L%04X:\n", address);
+        }
+
+        if (flags & CODE_MAP_OPCODE) {
+            uint8_t opcode = prg_byte(address);
+            enum address_mode mode = ADDRESS_MODE_LOOKUP[opcode];
+            uint16_t size = instruction_length(mode);
+
+            char bytes[16] = "";
+            for (uint16_t j = 0; j < size; j++) {
+                snprintf(bytes + j * 3, sizeof(bytes) - j * 3, "%02X ", prg_byte(address + j));
+            }
+
+            char operand[32];
+            format_operand(operand, sizeof(operand), address, mode);
+            fprintf(f, "    %04X  %-9s  %s%s%s\n", address, bytes, INSTRUCTION_NAME_STRING[INSTRUCTION_LOOKUP[opcode]], operand[0] != '\0' ? " " : "", operand);
+
+            i += size;
+            continue;
+        }
+
+        // Runs of non-code bytes, split at labels so every target gets its own line
+        fprintf(f, "    %04X  .byte ", address);
+        int count = 0;
+        do {
+            fprintf(f, "%s$%02X", count > 0 ? "," : "", cartridge.prg_rom[i]);
+            i++;
+            count++;
+        } while (i < length && count < DATA_PER_LINE && !(disasm.map[i] & CODE_MAP_OPCODE) && !disasm.labels[disasm.origin + i]);
+
+        fprintf(f, "%s\n", (flags & CODE_MAP_DATA) ? "" : "    ; unreached");
+    }
+}
+
+static void write_map(const char *filename) {
+    FILE *f = fopen(filename, "wb");
+    if (f == NULL) {
+        fprintf(stderr, "Unable to write code map %s\n", filename);
+        exit(EXIT_FAILURE);
+    }
+
+    // CHR is part of the .cdl layout, this tool leaves it unmarked
+    fwrite(disasm.map, 1, disasm.prg_length, f);
+    for (uint32_t i = 0; i < cartridge.header.chr_size * 0x2000u; i++) {
+        fputc(0, f);
+    }
+
+    fclose(f);
+}
+
+
+int main(int argc, char **argv) {
+    atexit(cleanup_nes);
+
+    const char *rom = NULL;
+    const char *map_out = NULL;
+    const char *listing_out = "-";
+    const char *traces[argc];
+    const char *maps[argc];
+    int trace_count = 0, map_count = 0;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--trace") == 0 && i + 1 < argc) {
+            traces[trace_count++] = argv[++i];
+        } else if (strcmp(argv[i], "--cdl") == 0 && i + 1 < argc) {
+            maps[map_count++] = argv[++i];
+        } else if (strcmp(argv[i], "--map") == 0 && i + 1 < argc) {
+            map_out = argv[++i];
+        } else if (strcmp(argv[i], "--listing") == 0 && i + 1 < argc) {
+            listing_out = argv[++i];
+        } else if (rom == NULL && argv[i][0] != '-') {
+            rom = argv[i];
+        } else {
+            rom = NULL;
+            break;
+        }
+    }
+
+    if (rom == NULL) {
+        fprintf(stderr, "Usage: %s ROM [--trace FILE]... [--cdl FILE]... [--map OUT.cdl] [--listing OUT]\n", argv[0]);
+        fprintf(stderr, "Traces are cnes --debug output, --cdl merges existing FCEUX or cnes code maps\n");
+        exit(EXIT_FAILURE);
+    }
+
+    state.filedata = read_file(rom, &state.filesize);
+    if (state.filedata == NULL) {
+        fprintf(stderr, "Unable to read %s\n", rom);
+        exit(EXIT_FAILURE);
+    }
+    if (!load_cartridge()) {
+        exit(EXIT_FAILURE);
+    }
+    if (cartridge.mapper != 0 || cartridge.header.prg_size > 2) {
+        fprintf(stderr, "Only NROM images are supported, %s uses mapper %u\n", rom, cartridge.mapper);
+        exit(EXIT_FAILURE);
+    }
+
+    disasm.prg_length = cartridge.header.prg_size * 0x4000;
+    disasm.origin = disasm.prg_length == 0x4000 ? 0xc000 : PRG_START;
+    disasm.map = calloc(disasm.prg_length, 1);
+    if (disasm.map == NULL) {
+        fprintf(stderr, "Unable to allocate code map\n");
+        exit(EXIT_FAILURE);
+    }
+
+    const uint16_t vectors[] = { RESET_VECTOR, NMI_VECTOR, IRQ_VECTOR };
+    for (int i = 0; i < 3; i++) {
+        uint16_t target = prg_byte(vectors[i]) | (prg_byte(vectors[i] + 1) << 8);
+        mark_data(vectors[i], 2);
+        disasm.labels[target] = true;
+        push(target);
+    }
+    run_work();
+
+    uint32_t static_code = 0;
+    for (uint32_t i = 0; i < disasm.prg_length; i++) {
+        static_code += (disasm.map[i] & CODE_MAP_CODE) != 0;
+    }
+
+    for (int i = 0; i < map_count; i++) {
+        load_map(maps[i]);
+        run_work();
+    }
+
+    uint32_t traced = 0;
+    for (int i = 0; i < trace_count; i++) {
+        traced += load_trace(traces[i]);
+        run_work();
+    }
+
+    uint32_t code = 0, data = 0;
+    for (uint32_t i = 0; i < disasm.prg_length; i++) {
+        code += (disasm.map[i] & CODE_MAP_CODE) != 0;
+        data += (disasm.map[i] & (CODE_MAP_CODE | CODE_MAP_DATA)) == CODE_MAP_DATA;
+    }
+
+    fprintf(stderr, "%u bytes of PRG: %u code (%u from vectors, %u from %u traced entry points), %u data, %u unknown\n",
+            disasm.prg_length, code, static_code, code - static_code, traced, data, disasm.prg_length - code - data);
+    if (disasm.conflicts > 0 || disasm.invalid > 0) {
+        fprintf(stderr, "%u jumps into the middle of instructions, %u paths reached undocumented opcodes\n", disasm.conflicts, disasm.invalid);
+    }
+
+    if (map_out != NULL) {
+        write_map(map_out);
+    }
+
+    if (strcmp(listing_out, "-") == 0) {
+        write_listing(stdout);
+    } else if (listing_out[0] != '\0') {
+        FILE *f = fopen(listing_out, "w");
+        if (f == NULL) {
+            fprintf(stderr, "Unable to write listing %s\n", listing_out);
+            exit(EXIT_FAILURE);
+        }
+        write_listing(f);
+        fclose(f);
+    }
+
+    free(disasm.map);
+    free(disasm.work);
+
+    return EXIT_SUCCESS;
+}
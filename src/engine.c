@@ -0,0 +1,29 @@
+#include <stddef.h>
+#include <string.h>
+#include "nes.h"
+#include "engine.h"
+#include "decode.h"
+#include "jit.h"
+
+
+// The first entry is the reference implementation
+const struct engine ENGINES[] = {
+    { "switch", execute_next, NULL, NULL },
+    { "fused", decode_step, decode_run, decode_report },
+#ifdef JIT_SUPPORTED
+    { "jit", jit_step, jit_run, NULL },
+#endif
+    { NULL, NULL, NULL, NULL },
+};
+
+const struct engine *current_engine = &ENGINES[0];
+
+
+const struct engine *find_engine(const char *name) {
+    for (const struct engine *engine = ENGINES; engine->name != NULL; engine++) {
+        if (strcmp(engine->name, name) == 0) {
+            return engine;
+        }
+    }
+    return NULL;
+}
@@ -0,0 +1,30 @@
+#ifndef ENGINE_H
+#define ENGINE_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+// CPU implementations that can stand in for each other. Each step executes
+// exactly one instruction on the global machine and returns its cycles, so
+// engines can be compared instruction by instruction with cnes-lockstep.
+
+struct engine {
+    const char *name;
+    int (*step)();
+
+    // Runs whole blocks until at least budget cycles have passed and returns the
+    // cycles, counting instructions when asked. NULL for engines that only step.
+    int (*run)(int budget, uint32_t *instructions);
+
+    // Prints the engine's own counters, NULL when it keeps none
+    void (*report)(FILE *f);
+};
+
+extern const struct engine ENGINES[];
+
+// Used by run_frame(), the reference implementation unless --engine picks another
+extern const struct engine *current_engine;
+
+const struct engine *find_engine(const char *name);
+
+#endif
@@ -0,0 +1,355 @@
+#define _POSIX_C_SOURCE 200112L
+
+#include <assert.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include "batch.h"
+#include "env.h"
+#include "nes.h"
+
+
+struct env_worker {
+    struct env *env;
+    int index;
+    pthread_t thread;
+};
+
+struct env {
+    struct env_config config;
+    struct snapshot start;
+
+    // Bytes per observation, and a byte of luma for each palette index
+    size_t observation_size;
+    uint8_t luma[64];
+
+    // Instance i is lane i % BATCH_LANES of group i / BATCH_LANES
+    struct batch *groups;
+    int group_count;
+
+    // Per instance, the reward counters as of the last step and the steps since a reset
+    uint32_t (*counters)[ENV_MAX_REWARDS];
+    uint32_t *steps;
+
+    // The call being handed out, every thread takes every thread_count'th group
+    bool resetting;
+    const uint8_t *actions;
+    uint8_t *observations;
+    float *rewards;
+    uint8_t *dones;
+
+    // The calling thread works too, so there are thread_count - 1 workers
+    struct env_worker *workers;
+    int thread_count;
+    pthread_mutex_t lock;
+    pthread_cond_t work;
+    pthread_cond_t finished;
+    uint64_t generation;
+    int pending;
+    bool stopping;
+};
+
+
+static uint8_t peek(const struct batch *b, int lane, uint16_t address) {
+    if (address < 0x2000) {
+        return b->ram[address & 0x07ff][lane];
+    } else if (address >= 0x6000 && address < 0x8000) {
+        return b->prg_ram[address - 0x6000][lane];
+    }
+
+    return 0;
+}
+
+static uint32_t read_counter(const struct batch *b, int lane, const struct env_reward *reward) {
+    uint32_t value = 0;
+    uint32_t weight = 1;
+
+    for (int i = 0; i < reward->bytes && i < 4; i++) {
+        uint8_t data = peek(b, lane, reward->address + i);
+
+        if (reward->bcd) {
+            value += ((data >> 4) * 10 + (data & 0x0f)) * weight;
+            weight *= 100;
+        } else {
+            value |= (uint32_t)data << (8 * i);
+        }
+    }
+
+    return value;
+}
+
+static bool episode_over(const struct env *env, const struct batch *b, int lane) {
+    if (b->halted[lane]) {
+        return true;
+    }
+
+    uint8_t mask = env->config.done_mask;
+    return mask != 0 && (peek(b, lane, env->config.done_address) & mask) == env->config.done_value;
+}
+
+static void observe(const struct env *env, const struct batch *b, int lane, uint8_t *observation) {
+    if (env->config.observation == ENV_OBSERVE_RAM) {
+        for (size_t i = 0; i < env->observation_size; i++) {
+            observation[i] = b->ram[i][lane];
+        }
+        return;
+    }
+
+    ppu_draw(&b->ppu[lane], observation, env->config.downsample);
+
+    if (env->config.observation == ENV_OBSERVE_GRAYSCALE) {
+        for (size_t i = 0; i < env->observation_size; i++) {
+            observation[i] = env->luma[observation[i] & 0x3f];
+        }
+    }
+}
+
+// Loads the start state into a lane, with its cycles moved up to the group's frame
+static void reset_lane(struct env *env, struct batch *b, int lane, int instance) {
+    batch_load_lane(b, lane, &env->start);
+    b->cycles[lane] += (b->frames - env->start.frames) * CPU_CYCLES_PER_FRAME;
+
+    for (int r = 0; r < env->config.reward_count; r++) {
+        env->counters[instance][r] = read_counter(b, lane, &env->config.rewards[r]);
+    }
+    env->steps[instance] = 0;
+}
+
+static void run_group(struct env *env, int group) {
+    struct batch *b = &env->groups[group];
+    int first = group * BATCH_LANES;
+
+    if (env->resetting) {
+        for (int lane = 0; lane < b->lanes; lane++) {
+            reset_lane(env, b, lane, first + lane);
+            if (env->observations != NULL) {
+                observe(env, b, lane, env->observations + (size_t)(first + lane) * env->observation_size);
+            }
+        }
+        return;
+    }
+
+    bool done[BATCH_LANES] = { false };
+
+    for (int lane = 0; lane < b->lanes; lane++) {
+        batch_set_buttons(b, lane, 0, env->actions[first + lane]);
+    }
+
+    // A lane that finishes early keeps running to the end of the step and is reset after
+    for (int frame = 0; frame < env->config.frame_skip; frame++) {
+        batch_run_frame(b);
+
+        for (int lane = 0; lane < b->lanes; lane++) {
+            done[lane] = done[lane] || episode_over(env, b, lane);
+        }
+    }
+
+    for (int lane = 0; lane < b->lanes; lane++) {
+        int instance = first + lane;
+        float reward = 0;
+
+        for (int r = 0; r < env->config.reward_count; r++) {
+            const struct env_reward *counter = &env->config.rewards[r];
+            uint32_t value = read_counter(b, lane, counter);
+
+            reward += counter->scale * (float)((int64_t)value - env->counters[instance][r]);
+            env->counters[instance][r] = value;
+        }
+
+        env->steps[instance]++;
+        if (env->config.max_steps > 0 && env->steps[instance] >= env->config.max_steps) {
+            done[lane] = true;
+        }
+
+        if (done[lane]) {
+            reset_lane(env, b, lane, instance);
+        }
+
+        if (env->rewards != NULL) {
+            env->rewards[instance] = reward;
+        }
+        if (env->dones != NULL) {
+            env->dones[instance] = done[lane];
+        }
+        if (env->observations != NULL) {
+            observe(env, b, lane, env->observations + (size_t)instance * env->observation_size);
+        }
+    }
+}
+
+static void run_share(struct env *env, int index) {
+    for (int group = index; group < env->group_count; group += env->thread_count) {
+        run_group(env, group);
+    }
+}
+
+static void *run_worker(void *argument) {
+    struct env_worker *worker = argument;
+    struct env *env = worker->env;
+    uint64_t seen = 0;
+
+    pthread_mutex_lock(&env->lock);
+    for (;;) {
+        while (env->generation == seen && !env->stopping) {
+            pthread_cond_wait(&env->work, &env->lock);
+        }
+
+        if (env->stopping) {
+            break;
+        }
+        seen = env->generation;
+
+        pthread_mutex_unlock(&env->lock);
+        run_share(env, worker->index);
+        pthread_mutex_lock(&env->lock);
+
+        if (--env->pending == 0) {
+            pthread_cond_signal(&env->finished);
+        }
+    }
+    pthread_mutex_unlock(&env->lock);
+
+    return NULL;
+}
+
+// Runs the call set up in env on every thread and waits for all of them
+static void dispatch(struct env *env) {
+    if (env->thread_count == 1) {
+        run_share(env, 0);
+        return;
+    }
+
+    pthread_mutex_lock(&env->lock);
+    env->generation++;
+    env->pending = env->thread_count - 1;
+    pthread_cond_broadcast(&env->work);
+    pthread_mutex_unlock(&env->lock);
+
+    run_share(env, 0);
+
+    pthread_mutex_lock(&env->lock);
+    while (env->pending > 0) {
+        pthread_cond_wait(&env->finished, &env->lock);
+    }
+    pthread_mutex_unlock(&env->lock);
+}
+
+
+struct env *env_create(const struct env_config *config) {
+    if (config->instances < 1 || config->reward_count < 0 || config->reward_count > ENV_MAX_REWARDS
+        || config->observation < ENV_OBSERVE_GRAYSCALE || config->observation > ENV_OBSERVE_RAM) {
+        return NULL;
+    }
+
+    struct env *env = calloc(1, sizeof(struct env));
+    assert(env != NULL);
+
+    env->config = *config;
+    if (env->config.frame_skip < 1) {
+        env->config.frame_skip = 1;
+    }
+    if (env->config.downsample < 1) {
+        env->config.downsample = 1;
+    }
+
+    if (env->config.observation == ENV_OBSERVE_RAM) {
+        env->observation_size = 0x800;
+    } else {
+        int step = env->config.downsample;
+        env->observation_size = (size_t)((PPU_WIDTH + step - 1) / step) * ((PPU_HEIGHT + step - 1) / step);
+    }
+
+    for (int i = 0; i < 64; i++) {
+        double y = 0.299 * PALETTE[i][0] + 0.587 * PALETTE[i][1] + 0.114 * PALETTE[i][2];
+        env->luma[i] = (uint8_t)(y + 0.5);
+    }
+    save_snapshot(&env->start);
+
+    env->group_count = (config->instances + BATCH_LANES - 1) / BATCH_LANES;
+    void *groups = NULL;
+    int code = posix_memalign(&groups, 64, env->group_count * sizeof(struct batch));
+    assert(code == 0);
+    env->groups = groups;
+
+    for (int group = 0; group < env->group_count; group++) {
+        int lanes = config->instances - group * BATCH_LANES;
+        batch_init(&env->groups[group], lanes < BATCH_LANES ? lanes : BATCH_LANES);
+    }
+
+    env->counters = calloc(config->instances, sizeof(*env->counters));
+    env->steps = calloc(config->instances, sizeof(*env->steps));
+    assert(env->counters != NULL && env->steps != NULL);
+
+    int threads = config->threads > 0 ? config->threads : (int)sysconf(_SC_NPROCESSORS_ONLN);
+    env->thread_count = threads < 1 ? 1 : threads > env->group_count ? env->group_count : threads;
+
+    pthread_mutex_init(&env->lock, NULL);
+    pthread_cond_init(&env->work, NULL);
+    pthread_cond_init(&env->finished, NULL);
+
+    env->workers = calloc(env->thread_count, sizeof(struct env_worker));
+    assert(env->workers != NULL);
+    for (int i = 1; i < env->thread_count; i++) {
+        env->workers[i].env = env;
+        env->workers[i].index = i;
+        code = pthread_create(&env->workers[i].thread, NULL, run_worker, &env->workers[i]);
+        assert(code == 0);
+    }
+
+    env_reset(env, NULL);
+    return env;
+}
+
+void env_destroy(struct env *env) {
+    if (env == NULL) return;
+
+    pthread_mutex_lock(&env->lock);
+    env->stopping = true;
+    pthread_cond_broadcast(&env->work);
+    pthread_mutex_unlock(&env->lock);
+
+    for (int i = 1; i < env->thread_count; i++) {
+        pthread_join(env->workers[i].thread, NULL);
+    }
+
+    pthread_cond_destroy(&env->finished);
+    pthread_cond_destroy(&env->work);
+    pthread_mutex_destroy(&env->lock);
+
+    free(env->workers);
+    free(env->steps);
+    free(env->counters);
+    free(env->groups);
+    free(env);
+}
+
+
+void env_reset(struct env *env, uint8_t *observations) {
+    env->resetting = true;
+    env->observations = observations;
+    dispatch(env);
+}
+
+void env_step(struct env *env, const uint8_t *actions, uint8_t *observations, float *rewards, uint8_t *dones) {
+    env->resetting = false;
+    env->actions = actions;
+    env->observations = observations;
+    env->rewards = rewards;
+    env->dones = dones;
+    dispatch(env);
+}
+
+size_t env_observation_size(const struct env *env) {
+    return env->observation_size;
+}
+
+uint64_t env_instructions(const struct env *env) {
+    uint64_t instructions = 0;
+    for (int group = 0; group < env->group_count; group++) {
+        instructions += env->groups[group].instructions;
+    }
+    return instructions;
+}
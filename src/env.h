@@ -0,0 +1,91 @@
+#ifndef ENV_H
+#define ENV_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "cnes.h"
+
+// Vectorised environment for reinforcement learning. One call steps every instance
+// with its own action and writes observations, rewards and done flags into arrays the
+// caller allocated once. Instances are copies of the machine at the time env_create()
+// was called. They run in groups of BATCH_LANES through the batch engine, and the
+// groups are spread over a pool of threads.
+//
+// An instance that is done goes back to the start on the same step. Its observation is
+// then the start state, as in the usual vector environment convention.
+
+#define ENV_MAX_REWARDS 4
+
+// What an observation holds. Frames are the background as the PPU shows it, drawn
+// from each instance's own nametables, and are kept to every downsample'th pixel
+// across and down.
+enum env_observation {
+    // One byte of BT.601 luma per pixel
+    ENV_OBSERVE_GRAYSCALE,
+
+    // The palette index of each pixel, 0-63, as in the framebuffer
+    ENV_OBSERVE_PALETTE,
+
+    // The 2KiB of CPU RAM
+    ENV_OBSERVE_RAM,
+};
+
+// Reward is scale times how much a little-endian counter of 1 to 4 bytes changed since
+// the last step. A BCD counter is read as two decimal digits per byte. Addresses can be
+// in RAM or PRG RAM.
+struct env_reward {
+    uint16_t address;
+    int bytes;
+    bool bcd;
+    float scale;
+};
+
+struct env_config {
+    int instances;
+
+    // 0 means one per online CPU
+    int threads;
+
+    // Frames run per step with the same action, at least 1
+    int frame_skip;
+
+    enum env_observation observation;
+
+    // 0 or 1 keeps every pixel, 2 halves the frame both ways, and so on
+    int downsample;
+
+    struct env_reward rewards[ENV_MAX_REWARDS];
+    int reward_count;
+
+    // Done once (RAM[done_address] & done_mask) == done_value, or when the CPU stops
+    // at an undocumented opcode. A zero mask never ends an episode early.
+    uint16_t done_address;
+    uint8_t done_mask;
+    uint8_t done_value;
+
+    // Ends an episode after this many steps, 0 for no limit
+    uint32_t max_steps;
+};
+
+struct env;
+
+// Takes the machine as it is now as every instance's start state, so load the ROM
+// and run it to the point training should start first
+CNES_API struct env *env_create(const struct env_config *config);
+CNES_API void env_destroy(struct env *env);
+
+// Bytes in one instance's observation. The observations of all instances follow each
+// other in one array of instances * env_observation_size() bytes.
+CNES_API size_t env_observation_size(const struct env *env);
+
+// Puts every instance back at the start. observations may be NULL.
+CNES_API void env_reset(struct env *env, uint8_t *observations);
+
+// actions holds one controller 1 byte per instance, CNES_BUTTON_* bits
+CNES_API void env_step(struct env *env, const uint8_t *actions, uint8_t *observations, float *rewards, uint8_t *dones);
+
+// Instructions run by all instances since env_create(), for benchmarks
+CNES_API uint64_t env_instructions(const struct env *env);
+
+#endif
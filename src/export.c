@@ -0,0 +1,190 @@
+#define _DEFAULT_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "export.h"
+#include "nes.h"
+
+
+#define EXPORT_COMMAND_LENGTH 128
+
+struct export export = { 0 };
+
+struct {
+    struct export_shared *shared;
+    const char *shm_name;
+
+    int control;
+    const char *control_path;
+} publisher = { .control = -1 };
+
+
+static bool open_shared(const char *name) {
+    int fd = shm_open(name, O_RDWR | O_CREAT, 0600);
+    if (fd < 0) {
+        logf_error("Unable to create shared memory %s\n", name);
+        return false;
+    }
+
+    if (ftruncate(fd, sizeof(struct export_shared)) != 0) {
+        logf_error("Unable to size shared memory %s\n", name);
+        close(fd);
+        shm_unlink(name);
+        return false;
+    }
+
+    void *shared = mmap(NULL, sizeof(struct export_shared), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (shared == MAP_FAILED) {
+        logf_error("Unable to map shared memory %s\n", name);
+        shm_unlink(name);
+        return false;
+    }
+
+    publisher.shared = shared;
+    publisher.shm_name = name;
+
+    // Readers check the magic last, so it goes in after the rest of the header
+    memset(publisher.shared, 0, sizeof(struct export_shared));
+    publisher.shared->version = EXPORT_VERSION;
+    publisher.shared->size = sizeof(struct export_shared);
+    memcpy(publisher.shared->palette, PALETTE, sizeof(publisher.shared->palette));
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    memcpy(publisher.shared->magic, EXPORT_MAGIC, sizeof(EXPORT_MAGIC));
+    return true;
+}
+
+static bool open_control(const char *path) {
+    struct sockaddr_un address = { .sun_family = AF_UNIX };
+    if (strlen(path) >= sizeof(address.sun_path)) {
+        logf_error("Control socket path is too long: %s\n", path);
+        return false;
+    }
+    strcpy(address.sun_path, path);
+
+    publisher.control = socket(AF_UNIX, SOCK_DGRAM | SOCK_NONBLOCK, 0);
+    unlink(path);
+    if (publisher.control < 0 || bind(publisher.control, (struct sockaddr *)&address, sizeof(address)) != 0) {
+        logf_error("Unable to bind control socket %s\n", path);
+        if (publisher.control >= 0) {
+            close(publisher.control);
+            publisher.control = -1;
+        }
+        return false;
+    }
+
+    publisher.control_path = path;
+    return true;
+}
+
+bool export_open(const char *shm_name, const char *control_socket) {
+    export_close();
+
+    if (shm_name != NULL && !open_shared(shm_name)) {
+        return false;
+    }
+
+    if (control_socket != NULL && !open_control(control_socket)) {
+        export_close();
+        return false;
+    }
+
+    memset(export.buttons, 0, sizeof(export.buttons));
+    export.open = true;
+    return true;
+}
+
+void export_close() {
+    if (publisher.shared != NULL) {
+        munmap(publisher.shared, sizeof(struct export_shared));
+        shm_unlink(publisher.shm_name);
+        publisher.shared = NULL;
+    }
+
+    if (publisher.control >= 0) {
+        close(publisher.control);
+        unlink(publisher.control_path);
+        publisher.control = -1;
+    }
+
+    export.open = false;
+}
+
+
+static void run_command(char *line) {
+    int port, mask;
+
+    if (sscanf(line, "buttons %d %i", &port, &mask) == 2 && port >= 0 && port <= 1) {
+        export.buttons[port] = mask;
+    } else {
+        line[strcspn(line, "\n")] = '\0';
+        logf_warning("Unknown control command: %s\n", line);
+    }
+}
+
+void export_poll() {
+    if (publisher.control < 0) return;
+
+    char line[EXPORT_COMMAND_LENGTH];
+    for (;;) {
+        ssize_t length = recv(publisher.control, line, sizeof(line) - 1, 0);
+        if (length < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+
+        line[length] = '\0';
+        run_command(line);
+    }
+}
+
+void export_publish() {
+    struct export_shared *shared = publisher.shared;
+    if (shared == NULL) return;
+
+    uint32_t sequence = shared->sequence;
+    __atomic_store_n(&shared->sequence, sequence + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+
+    shared->frame = state.frames;
+    shared->cpu = (struct export_cpu) {
+        .cycles = nes.cpu.cycles,
+        .pc = nes.cpu.pc,
+        .a = nes.cpu.a,
+        .x = nes.cpu.x,
+        .y = nes.cpu.y,
+        .s = nes.cpu.s,
+        .p = nes.cpu.p,
+    };
+    shared->buttons[0] = nes.controllers[0].buttons;
+    shared->buttons[1] = nes.controllers[1].buttons;
+    memcpy(shared->ram, nes.cpu.ram, sizeof(shared->ram));
+    memcpy(shared->prg_ram, cartridge.prg_ram, sizeof(shared->prg_ram));
+    memcpy(shared->framebuffer, nes.ppu.framebuffer, sizeof(shared->framebuffer));
+
+    __atomic_store_n(&shared->sequence, sequence + 2, __ATOMIC_RELEASE);
+}
+
+
+// The fence keeps reads of the frame before a check made after them
+uint32_t export_sequence(const struct export_shared *shared) {
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    return __atomic_load_n(&shared->sequence, __ATOMIC_ACQUIRE);
+}
+
+bool export_read(const struct export_shared *shared, struct export_shared *copy) {
+    uint32_t before = export_sequence(shared);
+    if (before & 1) return false;
+
+    memcpy(copy, shared, sizeof(*copy));
+    return export_sequence(shared) == before;
+}
@@ -0,0 +1,82 @@
+#ifndef EXPORT_H
+#define EXPORT_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "cnes.h"
+
+// Publishes the machine to other processes, such as bots, overlays and recorders. A POSIX
+// shared memory object holds the framebuffer, RAM and registers. It is rewritten after
+// every frame under a seqlock, so readers never block the emulator. A reader copies
+// what it needs, or uses it in place, and then checks that the sequence did not move.
+//
+// A Unix datagram socket takes one text command per datagram:
+//
+//   buttons PORT MASK    hold CNES_BUTTON_* bits on a controller, on top of the keyboard
+//
+// Commands are read between frames and never waited for.
+
+#define EXPORT_MAGIC "CNESSHM"
+#define EXPORT_VERSION 1
+
+struct export_cpu {
+    uint64_t cycles;
+    uint16_t pc;
+    uint8_t a;
+    uint8_t x;
+    uint8_t y;
+    uint8_t s;
+    uint8_t p;
+    uint8_t padding;
+};
+
+// Layout of the shared object, fixed-width fields only so any language can map it
+struct export_shared {
+    char magic[8];
+    uint32_t version;
+    uint32_t size;
+
+    // Odd while a frame is being written
+    uint32_t sequence;
+    uint32_t padding;
+
+    uint64_t frame;
+    struct export_cpu cpu;
+
+    // As applied to the frame just run
+    uint8_t buttons[2];
+    uint8_t padding_buttons[6];
+
+    uint8_t ram[0x800];
+    uint8_t prg_ram[0x2000];
+
+    // One palette index per pixel, and the RGB triples for them
+    uint8_t framebuffer[CNES_WIDTH * CNES_HEIGHT];
+    uint8_t palette[64][3];
+};
+
+struct export {
+    bool open;
+
+    // Held by the control socket, the frontend ORs them into its input
+    uint8_t buttons[2];
+};
+
+extern struct export export;
+
+// Either name may be NULL to skip that half
+CNES_API bool export_open(const char *shm_name, const char *control_socket);
+CNES_API void export_close();
+
+// Reads pending control commands
+CNES_API void export_poll();
+
+// Writes the machine as it is at the end of a frame
+CNES_API void export_publish();
+
+// For readers: copies the shared object and returns false if a frame was being written
+// meanwhile. Readers working in place check export_sequence() before and after instead.
+CNES_API bool export_read(const struct export_shared *shared, struct export_shared *copy);
+CNES_API uint32_t export_sequence(const struct export_shared *shared);
+
+#endif
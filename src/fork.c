@@ -0,0 +1,164 @@
+#include <assert.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "fork.h"
+#include "journal.h"
+#include "nes.h"
+
+
+#define RAM_OFFSET offsetof(struct nes, cpu.ram)
+#define RAM_END (RAM_OFFSET + sizeof(nes.cpu.ram))
+
+// The PPU's memory pages end the struct, past them is only padding
+#define PPU_MEMORY_OFFSET offsetof(struct nes, ppu.nametables)
+
+struct fork_page {
+    int references;
+    uint8_t data[256];
+};
+
+struct fork_node {
+    int references;
+    uint64_t frames;
+
+    // struct nes apart from RAM and PPU memory, which live in the pages
+    uint8_t before_ram[RAM_OFFSET];
+    uint8_t after_ram[PPU_MEMORY_OFFSET - RAM_END];
+
+    struct fork_page *pages[DIRTY_PAGES];
+};
+
+struct {
+    // The live machine's clean pages still match this node's
+    struct fork_node *base;
+
+    struct fork_usage usage;
+} forks = { 0 };
+
+
+// Without a base every page counts as changed, and starting to track marks them all too
+static bool unchanged(int index) {
+    return forks.base != NULL && !(peek_dirty_pages(DIRTY_FORK) & 1ull << index);
+}
+
+static void release_page(struct fork_page *page) {
+    if (--page->references > 0) return;
+
+    free(page);
+    forks.usage.pages--;
+    forks.usage.bytes -= sizeof(struct fork_page);
+}
+
+// Makes node the base, after the machine was brought in line with it
+static void rebase(struct fork_node *node) {
+    fork_retain(node);
+    if (forks.base != NULL) {
+        fork_release(forks.base);
+    }
+    forks.base = node;
+
+    if (!(dirty_pages.trackers & 1u << DIRTY_FORK)) {
+        track_dirty_pages(DIRTY_FORK, true);
+    }
+    take_dirty_pages(DIRTY_FORK);
+}
+
+
+struct fork_node *fork_capture() {
+    struct fork_node *node = calloc(1, sizeof(struct fork_node));
+    assert(node != NULL);
+
+    node->references = 1;
+    node->frames = state.frames;
+    memcpy(node->before_ram, &nes, sizeof(node->before_ram));
+    memcpy(node->after_ram, (uint8_t *)&nes + RAM_END, sizeof(node->after_ram));
+
+    for (int i = 0; i < DIRTY_PAGES; i++) {
+        if (unchanged(i)) {
+            node->pages[i] = forks.base->pages[i];
+            node->pages[i]->references++;
+            continue;
+        }
+
+        struct fork_page *page = malloc(sizeof(struct fork_page));
+        assert(page != NULL);
+
+        page->references = 1;
+        memcpy(page->data, dirty_page_memory(i), sizeof(page->data));
+        node->pages[i] = page;
+
+        forks.usage.pages++;
+        forks.usage.bytes += sizeof(struct fork_page);
+    }
+
+    forks.usage.nodes++;
+    forks.usage.bytes += sizeof(struct fork_node);
+
+    rebase(node);
+    return node;
+}
+
+// Like load_snapshot() the current framebuffer pointer is kept
+void fork_restore(struct fork_node *node) {
+    uint8_t *framebuffer = nes.ppu.framebuffer;
+    uint64_t copied = 0;
+
+    for (int i = 0; i < DIRTY_PAGES; i++) {
+        if (!unchanged(i) || forks.base->pages[i] != node->pages[i]) {
+            memcpy(dirty_page_memory(i), node->pages[i]->data, sizeof(node->pages[i]->data));
+            copied |= 1ull << i;
+        }
+    }
+
+    // Other trackers, such as the state hash, need to see the copies
+    mark_pages_written(copied);
+
+    memcpy(&nes, node->before_ram, sizeof(node->before_ram));
+    memcpy((uint8_t *)&nes + RAM_END, node->after_ram, sizeof(node->after_ram));
+    nes.ppu.framebuffer = framebuffer;
+    state.frames = node->frames;
+
+    rebase(node);
+    journal_restored();
+}
+
+void fork_retain(struct fork_node *node) {
+    node->references++;
+}
+
+void fork_release(struct fork_node *node) {
+    if (--node->references > 0) return;
+
+    for (int i = 0; i < DIRTY_PAGES; i++) {
+        release_page(node->pages[i]);
+    }
+    free(node);
+
+    forks.usage.nodes--;
+    forks.usage.bytes -= sizeof(struct fork_node);
+}
+
+void fork_close() {
+    if (forks.base != NULL) {
+        fork_release(forks.base);
+        forks.base = NULL;
+    }
+
+    track_dirty_pages(DIRTY_FORK, false);
+}
+
+
+struct fork_usage fork_usage() {
+    return forks.usage;
+}
+
+void fork_report(FILE *f) {
+    struct fork_usage usage = forks.usage;
+    double per_node = usage.nodes > 0 ? (double)usage.bytes / usage.nodes : 0;
+
+    fprintf(f, "fork: %lu nodes sharing %lu pages, %lu bytes, %.0f bytes per node against %zu for a snapshot\n",
+            usage.nodes, usage.pages, usage.bytes, per_node, sizeof(struct snapshot));
+}
@@ -0,0 +1,37 @@
+#ifndef FORK_H
+#define FORK_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+// Copy-on-write machine states for tree search. A node keeps the registers and
+// refcounted 256-byte pages of RAM and PRG RAM. The machine's dirty page tracking
+// records which pages were written since the last capture or restore. Only those pages
+// are copied into the next node, and the rest are shared with the node the machine came
+// from. A search tree therefore costs memory in proportion to how far its branches
+// diverge. Restoring copies back only the pages that differ from the live machine.
+//
+// Nodes are tied to the loaded cartridge. Call fork_close() before loading another.
+
+struct fork_node;
+
+struct fork_usage {
+    uint64_t nodes;
+    uint64_t pages;
+    uint64_t bytes;
+};
+
+// The returned node holds one reference for the caller
+struct fork_node *fork_capture();
+void fork_restore(struct fork_node *node);
+
+void fork_retain(struct fork_node *node);
+void fork_release(struct fork_node *node);
+
+// Stops tracking and drops the reference kept on the last captured or restored node
+void fork_close();
+
+struct fork_usage fork_usage();
+void fork_report(FILE *f);
+
+#endif
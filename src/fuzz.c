@@ -0,0 +1,263 @@
+#define _POSIX_C_SOURCE 199309L
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "nes.h"
+
+
+// libFuzzer entry point for the cartridge loader and the CPU core. 'make fuzz'
+// builds it with clang -fsanitize=fuzzer, the gcc tools build adds a main()
+// that replays inputs from files and measures executions per second.
+//
+// The first input byte picks the target:
+//   even: the rest is an iNES image for load_cartridge(), which then runs
+//   odd:  6 register bytes (A X Y S P and the PC page), 2KiB of RAM, then PRG
+
+
+const uint32_t PRG_SIZE = 0x8000;
+const uint16_t PRG_START = 0x8000;
+
+// Bounded so every input finishes quickly, infinite loops are the common case
+const int FUZZ_INSTRUCTIONS = 256;
+
+const size_t REGISTER_BYTES = 6;
+
+
+// Guest coverage, one counter per PRG byte. libFuzzer picks up counters in this
+// section on its own and treats new guest PCs like new host edges.
+uint8_t fuzz_coverage[0x8000] __attribute__((used, section("__libfuzzer_extra_counters")));
+
+// Machine right after poweron(), restored instead of re-running init for every input
+struct {
+    bool ready;
+    struct snapshot snapshot;
+    struct cartridge cartridge;
+    uint8_t *filedata;
+    size_t filesize;
+    uint32_t dirty_prg;
+} base = { 0 };
+
+
+void fuzz_init() {
+    state.quiet = true;
+
+    state.filesize = 16 + PRG_SIZE;
+    state.filedata = calloc(state.filesize, 1);
+    if (state.filedata == NULL) {
+        log_error("Failed to allocate fuzzing image\n");
+        exit(EXIT_FAILURE);
+    }
+
+    memcpy(state.filedata, "NES\x1A", 4);
+    state.filedata[4] = PRG_SIZE / 0x4000;
+
+    load_cartridge();
+    init_memory();
+    poweron();
+
+    save_snapshot(&base.snapshot);
+    base.cartridge = cartridge;
+    base.filedata = state.filedata;
+    base.filesize = state.filesize;
+    base.ready = true;
+}
+
+void run_instructions() {
+    for (int i = 0; i < FUZZ_INSTRUCTIONS; i++) {
+        if (nes.cpu.pc >= PRG_START) {
+            fuzz_coverage[nes.cpu.pc - PRG_START]++;
+        }
+
+        // Undocumented opcodes halt the core with exit(), which libFuzzer would report as a crash
+        if (INSTRUCTION_LOOKUP[cpu_read_8(nes.cpu.pc)] == INSTRUCTION_NONE) {
+            return;
+        }
+
+        nes.cpu.cycles += execute_next();
+    }
+}
+
+void fuzz_loader(const uint8_t *data, size_t size) {
+    // An exact-size copy lets the sanitizers catch any read past the end of the image
+    uint8_t *image = malloc(size > 0 ? size : 1);
+    if (image == NULL) {
+        return;
+    }
+    memcpy(image, data, size);
+
+    state.filedata = image;
+    state.filesize = size;
+
+    if (load_cartridge()) {
+        map_memory();
+        load_snapshot(&base.snapshot);
+        nes.cpu.pc = cpu_read_16(RESET_VECTOR);
+        run_instructions();
+    }
+
+    free(image);
+    cartridge = base.cartridge;
+    state.filedata = base.filedata;
+    state.filesize = base.filesize;
+    map_memory();
+}
+
+void fuzz_cpu(const uint8_t *data, size_t size) {
+    load_snapshot(&base.snapshot);
+
+    uint8_t registers[6] = { 0 };
+    size_t length = size < REGISTER_BYTES ? size : REGISTER_BYTES;
+    memcpy(registers, data, length);
+    data += length;
+    size -= length;
+
+    nes.cpu.a = registers[0];
+    nes.cpu.x = registers[1];
+    nes.cpu.y = registers[2];
+    nes.cpu.s = registers[3];
+    nes.cpu.p = registers[4] | (1 << ONE);
+    nes.cpu.pc = PRG_START | (registers[5] << 8);
+
+    length = size < 2048 ? size : 2048;
+    memcpy(nes.cpu.ram, data, length);
+    data += length;
+    size -= length;
+
+    // Only the part of PRG the previous input wrote needs clearing
+    length = size < PRG_SIZE ? size : PRG_SIZE;
+    memcpy(cartridge.prg_rom, data, length);
+    if (base.dirty_prg > length) {
+        memset(cartridge.prg_rom + length, 0, base.dirty_prg - length);
+    }
+    base.dirty_prg = length;
+
+    run_instructions();
+}
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
+    if (!base.ready) {
+        fuzz_init();
+    }
+
+    if (size == 0) {
+        return 0;
+    }
+
+    if (data[0] & 1) {
+        fuzz_cpu(data + 1, size - 1);
+    } else {
+        fuzz_loader(data + 1, size - 1);
+    }
+
+    return 0;
+}
+
+
+#ifndef CNES_LIBFUZZER
+
+uint64_t now_ns() {
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return time.tv_sec * 1000000000ull + time.tv_nsec;
+}
+
+// xorshift64*, only used to generate inputs for --iterations
+uint64_t next_random(uint64_t *rng) {
+    *rng ^= *rng >> 12;
+    *rng ^= *rng << 25;
+    *rng ^= *rng >> 27;
+    return *rng * 0x2545f4914f6cdd1dull;
+}
+
+void write_coverage(const char *filename) {
+    uint8_t bitmap[0x8000 / 8] = { 0 };
+    for (uint32_t i = 0; i < PRG_SIZE; i++) {
+        if (fuzz_coverage[i] != 0) {
+            bitmap[i / 8] |= 1 << (i % 8);
+        }
+    }
+
+    FILE *f = fopen(filename, "wb");
+    if (f == NULL) {
+        fprintf(stderr, "Unable to write %s\n", filename);
+        exit(EXIT_FAILURE);
+    }
+    fwrite(bitmap, sizeof(bitmap), 1, f);
+    fclose(f);
+}
+
+int main(int argc, char **argv) {
+    const char *coverage = NULL;
+    long iterations = 0;
+    int inputs = 0;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--coverage") == 0 && i + 1 < argc) {
+            coverage = argv[++i];
+        } else if (strcmp(argv[i], "--iterations") == 0 && i + 1 < argc) {
+            iterations = atol(argv[++i]);
+        } else if (argv[i][0] == '-') {
+            fprintf(stderr, "Usage: %s [--coverage FILE] [--iterations N] [INPUT...]\n", argv[0]);
+            fprintf(stderr, "Replays INPUT files through the fuzz target, --iterations runs random inputs for timing\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--coverage") == 0 || strcmp(argv[i], "--iterations") == 0) {
+            i++;
+            continue;
+        }
+
+        size_t size = 0;
+        uint8_t *data = read_file(argv[i], &size);
+        if (data == NULL) {
+            fprintf(stderr, "Unable to read %s\n", argv[i]);
+            exit(EXIT_FAILURE);
+        }
+
+        LLVMFuzzerTestOneInput(data, size);
+        free(data);
+        inputs++;
+    }
+
+    if (iterations > 0) {
+        static uint8_t input[1 + 6 + 2048 + 0x8000];
+        uint64_t rng = 1;
+        for (size_t j = 0; j < sizeof(input); j++) {
+            input[j] = next_random(&rng);
+        }
+
+        // Only the selector, registers and length change per iteration so generation stays out of the timing
+        uint64_t start = now_ns();
+
+        for (long i = 0; i < iterations; i++) {
+            uint64_t bits = next_random(&rng);
+            memcpy(input, &bits, 7);
+            size_t size = 1 + next_random(&rng) % (sizeof(input) - 1);
+            LLVMFuzzerTestOneInput(input, size);
+        }
+
+        double seconds = (now_ns() - start) / 1e9;
+        printf("%ld random inputs in %.3fs, %.0f execs/s\n", iterations, seconds, iterations / seconds);
+        inputs += iterations;
+    }
+
+    uint32_t covered = 0;
+    for (uint32_t i = 0; i < PRG_SIZE; i++) {
+        covered += fuzz_coverage[i] != 0;
+    }
+    printf("%d inputs, %u PRG bytes executed\n", inputs, covered);
+
+    if (coverage != NULL) {
+        write_coverage(coverage);
+    }
+
+    return EXIT_SUCCESS;
+}
+
+#endif
@@ -0,0 +1,45 @@
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include "hash.h"
+
+
+const uint64_t HASH_PRIME_1 = 0x9e3779b185ebca87;
+const uint64_t HASH_PRIME_2 = 0xc2b2ae3d27d4eb4f;
+const uint64_t HASH_PRIME_3 = 0x165667b19e3779f9;
+
+
+static uint64_t rotate_left(uint64_t x, int bits) {
+    return (x << bits) | (x >> (64 - bits));
+}
+
+uint64_t hash_bytes(const void *data, size_t length, uint64_t seed) {
+    const uint8_t *bytes = data;
+    uint64_t hash = seed + HASH_PRIME_3 + length;
+
+    while (length >= 8) {
+        uint64_t word;
+        memcpy(&word, bytes, 8);
+
+        word *= HASH_PRIME_2;
+        word = rotate_left(word, 31) * HASH_PRIME_1;
+        hash = rotate_left(hash ^ word, 27) * HASH_PRIME_1 + HASH_PRIME_3;
+
+        bytes += 8;
+        length -= 8;
+    }
+
+    while (length > 0) {
+        hash = rotate_left(hash ^ (*bytes * HASH_PRIME_3), 11) * HASH_PRIME_1;
+        bytes++;
+        length--;
+    }
+
+    hash ^= hash >> 33;
+    hash *= HASH_PRIME_2;
+    hash ^= hash >> 29;
+    hash *= HASH_PRIME_3;
+    hash ^= hash >> 32;
+
+    return hash;
+}
@@ -0,0 +1,10 @@
+#ifndef HASH_H
+#define HASH_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Fast non-cryptographic 64-bit hash (xxHash64-style single lane)
+uint64_t hash_bytes(const void *data, size_t length, uint64_t seed);
+
+#endif
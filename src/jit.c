@@ -0,0 +1,771 @@
+#define _DEFAULT_SOURCE
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include "nes.h"
+#include "jit.h"
+
+#ifdef JIT_SUPPORTED
+
+
+// Generated code keeps the 6502 registers in struct nes and only caches pointers:
+//   r12  &nes
+//   r13  nz_flags
+//   ebx  cycles that depend on runtime state, added to the block's static count on exit
+// Loads, stores, ALU, flag and register instructions with a static operand are emitted
+// inline. Everything else sets the PC and calls INSTRUCTION_FUNCTIONS, so the two engines
+// share the interpreter's definition of the complicated instructions.
+//
+// Blocks never start outside PRG ROM, so stores can't modify translated code. Absolute
+// accesses to registers at $2000-$5FFF end the block and run in the interpreter.
+// The code buffer is mapped read and write, and every translation flips the pages it
+// wrote to read and execute, so no page is ever writable and executable at once.
+
+
+#define JIT_CODE_SIZE (4 << 20)
+#define JIT_MAX_BLOCKS 65536
+#define JIT_BANK_SIZE 0x2000
+#define JIT_BANKS 4
+#define JIT_BLOCK_LENGTH 64
+
+// Cold code is interpreted until the start of its block has been reached this often
+#define JIT_HOT_THRESHOLD 8
+
+// More than the longest sequence emitted for a single instruction, block exits included
+#define JIT_INSTRUCTION_BYTES 128
+
+const uint16_t IO_START = 0x2000;
+const uint16_t IO_END = 0x6000;
+
+enum host_register {
+    AL = 0,
+    CL = 1,
+    DL = 2,
+};
+
+struct jit_block {
+    uint8_t *code;
+    uint16_t instructions;
+};
+
+// Translations for one 8KiB window of PRG, valid while the same ROM is mapped there
+struct jit_bank {
+    uint8_t *rom;
+    struct jit_block *blocks[JIT_BANK_SIZE];
+    uint8_t heat[JIT_BANK_SIZE];
+};
+
+struct jit_cache {
+    int max_instructions;
+    uint8_t threshold;
+    struct jit_bank banks[JIT_BANKS];
+};
+
+struct {
+    bool ready;
+    uint32_t generation;
+
+    uint8_t *code;
+    size_t used;
+    uint8_t *at;
+    size_t page_size;
+
+    struct jit_block blocks[JIT_MAX_BLOCKS];
+    int block_count;
+
+    // jit_run() translates whole basic blocks, jit_step() single instructions
+    struct jit_cache run;
+    struct jit_cache step;
+} jit = {
+    .run = { .max_instructions = JIT_BLOCK_LENGTH, .threshold = JIT_HOT_THRESHOLD },
+    .step = { .max_instructions = 1, .threshold = 0 },
+};
+
+// Marks block starts that are always interpreted
+struct jit_block untranslatable = { 0 };
+
+// NEGATIVE and ZERO for every result, so setting them takes one table load
+uint8_t nz_flags[256];
+
+
+static void emit_8(uint8_t data) {
+    *jit.at++ = data;
+}
+
+static void emit_16(uint16_t data) {
+    emit_8(data & 0xff);
+    emit_8(data >> 8);
+}
+
+static void emit_32(uint32_t data) {
+    emit_16(data & 0xffff);
+    emit_16(data >> 16);
+}
+
+static void emit_64(uint64_t data) {
+    emit_32(data & 0xffffffff);
+    emit_32(data >> 32);
+}
+
+static void emit(int count, const uint8_t *bytes) {
+    memcpy(jit.at, bytes, count);
+    jit.at += count;
+}
+
+#define EMIT(...) do { const uint8_t bytes[] = { __VA_ARGS__ }; emit(sizeof(bytes), bytes); } while (0)
+
+// Emits a short jump and returns where its offset goes, for patch_jump() to fill in
+static uint8_t *emit_jump(uint8_t opcode) {
+    emit_8(opcode);
+    emit_8(0);
+    return jit.at - 1;
+}
+
+static void patch_jump(uint8_t *offset) {
+    ptrdiff_t distance = jit.at - (offset + 1);
+    assert(distance <= 127);
+    *offset = distance;
+}
+
+
+static uint8_t cpu_field(enum instruction_name name) {
+    switch (name) {
+        case LDX: case STX: case CPX: case INX: case DEX: case TXA: case TXS:
+            return offsetof(struct nes, cpu.x);
+        case LDY: case STY: case CPY: case INY: case DEY: case TYA:
+            return offsetof(struct nes, cpu.y);
+        case TSX:
+            return offsetof(struct nes, cpu.s);
+        default:
+            return offsetof(struct nes, cpu.a);
+    }
+}
+
+static const uint8_t PC = offsetof(struct nes, cpu.pc);
+static const uint8_t P = offsetof(struct nes, cpu.p);
+
+// mov reg, [r12 + field]
+static void emit_load(enum host_register reg, uint8_t field) {
+    EMIT(0x41, 0x8a, 0x44 | reg << 3, 0x24, field);
+}
+
+// mov [r12 + field], al
+static void emit_store(uint8_t field) {
+    EMIT(0x41, 0x88, 0x44, 0x24, field);
+}
+
+// mov word [r12 + pc], address
+static void emit_set_pc(uint16_t address) {
+    EMIT(0x66, 0x41, 0xc7, 0x44, 0x24, PC);
+    emit_16(address);
+}
+
+static void emit_clear_flags(uint8_t mask) {
+    EMIT(0x41, 0x80, 0x64, 0x24, P, (uint8_t)~mask);
+}
+
+static void emit_set_flags(uint8_t mask) {
+    EMIT(0x41, 0x80, 0x4c, 0x24, P, mask);
+}
+
+// or [r12 + p], dl
+static void emit_or_flags() {
+    EMIT(0x41, 0x08, 0x54, 0x24, P);
+}
+
+// Sets NEGATIVE and ZERO from al, clobbers ecx
+static void emit_nz() {
+    EMIT(0x0f, 0xb6, 0xc8);
+    emit_clear_flags((1 << NEGATIVE) | (1 << ZERO));
+    EMIT(0x41, 0x8a, 0x4c, 0x0d, 0x00);
+    EMIT(0x41, 0x08, 0x4c, 0x24, P);
+}
+
+// movabs rdx, pointer
+static void emit_pointer(const void *pointer) {
+    EMIT(0x48, 0xba);
+    emit_64((uintptr_t)pointer);
+}
+
+// movabs rax, function; call rax
+static void emit_call(uint64_t function) {
+    EMIT(0x48, 0xb8);
+    emit_64(function);
+    EMIT(0xff, 0xd0);
+}
+
+static void emit_prologue() {
+    EMIT(0x53, 0x41, 0x54, 0x41, 0x55);
+    EMIT(0x49, 0xbc);
+    emit_64((uintptr_t)&nes);
+    EMIT(0x49, 0xbd);
+    emit_64((uintptr_t)nz_flags);
+    EMIT(0x31, 0xdb);
+}
+
+// Returns the block's cycles: lea eax, [rbx + cycles], then restores the saved registers
+static void emit_exit(int cycles) {
+    EMIT(0x8d, 0x83);
+    emit_32(cycles);
+    EMIT(0x41, 0x5d, 0x41, 0x5c, 0x5b, 0xc3);
+}
+
+
+// Loads an IMMEDIATE, ZERO_PAGE or ABSOLUTE operand into reg, false when it has to be read at runtime
+static bool emit_operand(enum address_mode mode, uint16_t operand, enum host_register reg) {
+    if (mode == IMMEDIATE) {
+        EMIT(0xb0 + reg, operand);
+        return true;
+    }
+
+    if (mode != ZERO_PAGE && mode != ABSOLUTE) {
+        return false;
+    }
+
+    uint8_t *page = memory_map.read[operand >> 8];
+    if (page == NULL) {
+        return false;
+    }
+
+    // Read-only PRG is folded into the code, the block is dropped if the mapping changes
+    if (operand >= 0x8000 && memory_map.write[operand >> 8] == NULL) {
+        EMIT(0xb0 + reg, page[operand & 0xff]);
+        return true;
+    }
+
+    emit_pointer(page + (operand & 0xff));
+    EMIT(0x8a, 0x02 | reg << 3);
+    return true;
+}
+
+// Writes al to a static address. RAM and PRG RAM go through the page's write entry, read
+// at run time because copy-on-write tracking clears it to catch the first write to a page.
+static void emit_write(uint16_t pc, uint16_t address) {
+    bool plain = address < 0x2000 || (address >= 0x6000 && address < 0x8000);
+    uint8_t *logged = NULL;
+    uint8_t *unmapped = NULL;
+    uint8_t *done = NULL;
+
+    if (plain) {
+        emit_pointer(&write_log.enabled);
+        EMIT(0x80, 0x3a, 0x00);
+        logged = emit_jump(0x75);
+        emit_pointer(&memory_map.write[address >> 8]);
+        EMIT(0x48, 0x8b, 0x12);
+        EMIT(0x48, 0x85, 0xd2);
+        unmapped = emit_jump(0x74);
+        EMIT(0x88, 0x82);
+        emit_32(address & 0xff);
+        done = emit_jump(0xeb);
+        patch_jump(logged);
+        patch_jump(unmapped);
+    }
+
+    emit_set_pc(pc);
+    EMIT(0x0f, 0xb6, 0xf0);
+    EMIT(0xbf);
+    emit_32(address);
+    emit_call((uintptr_t)cpu_write_8);
+
+    if (done != NULL) {
+        patch_jump(done);
+    }
+}
+
+// Runs the interpreter's version of the instruction with the PC it expects
+static void emit_function(uint16_t pc, enum instruction_name name, enum address_mode mode, uint16_t operand) {
+    emit_set_pc(pc);
+
+    switch (mode) {
+        case IMPLICIT:
+        case ACCUMULATOR:
+            EMIT(0xbe);
+            emit_32(0);
+            break;
+        case IMMEDIATE:
+        case RELATIVE:
+            EMIT(0xbe);
+            emit_32((uint16_t)(pc + 1));
+            break;
+        case ZERO_PAGE:
+        case ABSOLUTE:
+            EMIT(0xbe);
+            emit_32(operand);
+            break;
+        default:
+            EMIT(0xbf);
+            emit_32(mode);
+            emit_call((uintptr_t)read_operand);
+            EMIT(0x0f, 0xb7, 0xf0);
+            break;
+    }
+
+    EMIT(0xbf);
+    emit_32(mode);
+    emit_call((uintptr_t)INSTRUCTION_FUNCTIONS[name]);
+    EMIT(0x0f, 0xb6, 0xc0, 0x01, 0xc3);
+}
+
+static bool ends_block(enum instruction_name name) {
+    switch (name) {
+        case BCC: case BCS: case BEQ: case BMI: case BNE: case BPL: case BVC: case BVS:
+        case JMP: case JSR: case RTS: case RTI: case BRK:
+            return true;
+        default:
+            return false;
+    }
+}
+
+static void emit_branch(uint16_t pc, enum instruction_name name, int8_t offset, int cycles) {
+    uint8_t flag;
+    bool when_set;
+
+    switch (name) {
+        case BCC: flag = CARRY; when_set = false; break;
+        case BCS: flag = CARRY; when_set = true; break;
+        case BEQ: flag = ZERO; when_set = true; break;
+        case BNE: flag = ZERO; when_set = false; break;
+        case BMI: flag = NEGATIVE; when_set = true; break;
+        case BPL: flag = NEGATIVE; when_set = false; break;
+        case BVC: flag = OVERFLOW; when_set = false; break;
+        default: flag = OVERFLOW; when_set = true; break;
+    }
+
+    // Same timing as the interpreter, including BEQ not charging for page crossings
+    uint16_t target = pc + 2 + offset;
+    int taken_cycles = cycles + 1;
+    if (name != BEQ && target >> 8 != pc >> 8) {
+        taken_cycles += 2;
+    }
+
+    // execute_next() moves past branches that land on themselves
+    if (target == pc) {
+        target = pc + 2;
+    }
+
+    EMIT(0x41, 0xf6, 0x44, 0x24, P, 1 << flag);
+    uint8_t *not_taken = emit_jump(when_set ? 0x74 : 0x75);
+    emit_set_pc(target);
+    emit_exit(taken_cycles);
+
+    patch_jump(not_taken);
+    emit_set_pc(pc + 2);
+    emit_exit(cycles);
+}
+
+// Emits one instruction and adds its static cycles, returns true when it ended the block
+static bool emit_instruction(uint16_t pc, const uint8_t *bytes, int *cycles) {
+    enum instruction_name name = INSTRUCTION_LOOKUP[bytes[0]];
+    enum address_mode mode = ADDRESS_MODE_LOOKUP[bytes[0]];
+    uint16_t length = instruction_length(mode);
+    uint16_t operand = length == 3 ? bytes[1] | bytes[2] << 8 : bytes[1];
+
+    *cycles += INSTRUCTION_CYCLES[name] + ADDRESS_MODE_CYCLES[mode];
+
+    switch (name) {
+        case LDA: case LDX: case LDY:
+            if (emit_operand(mode, operand, AL)) {
+                emit_store(cpu_field(name));
+                emit_nz();
+                return false;
+            }
+            break;
+
+        case STA: case STX: case STY:
+            if (mode == ZERO_PAGE || mode == ABSOLUTE) {
+                emit_load(AL, cpu_field(name));
+                emit_write(pc, operand);
+                return false;
+            }
+            break;
+
+        case AND: case ORA: case EOR:
+            if (emit_operand(mode, operand, CL)) {
+                emit_load(AL, cpu_field(name));
+                EMIT(name == AND ? 0x20 : name == ORA ? 0x08 : 0x30, 0xc8);
+                emit_store(cpu_field(name));
+                emit_nz();
+                return false;
+            }
+            break;
+
+        case ADC: case SBC:
+            if (emit_operand(mode, operand, CL)) {
+                if (name == SBC) {
+                    EMIT(0xf6, 0xd1);
+                }
+                // Carry into CF, then adc sets CF and OF exactly like the 6502 sets C and V
+                emit_load(DL, P);
+                EMIT(0xd0, 0xea);
+                emit_load(AL, cpu_field(name));
+                EMIT(0x10, 0xc8, 0x0f, 0x92, 0xc2, 0x0f, 0x90, 0xc1);
+                emit_store(cpu_field(name));
+                EMIT(0xc0, 0xe1, OVERFLOW, 0x08, 0xca);
+                emit_clear_flags((1 << CARRY) | (1 << OVERFLOW));
+                emit_or_flags();
+                emit_nz();
+                return false;
+            }
+            break;
+
+        case CMP: case CPX: case CPY:
+            if (emit_operand(mode, operand, CL)) {
+                emit_load(AL, cpu_field(name));
+                EMIT(0x28, 0xc8, 0x0f, 0x93, 0xc2);
+                emit_clear_flags(1 << CARRY);
+                emit_or_flags();
+                emit_nz();
+                return false;
+            }
+            break;
+
+        case BIT:
+            if (emit_operand(mode, operand, CL)) {
+                emit_load(AL, cpu_field(name));
+                EMIT(0x84, 0xc8, 0x0f, 0x94, 0xc2, 0xd0, 0xe2, 0x80, 0xe1, 0xc0, 0x08, 0xca);
+                emit_clear_flags((1 << NEGATIVE) | (1 << OVERFLOW) | (1 << ZERO));
+                emit_or_flags();
+                return false;
+            }
+            break;
+
+        case ASL: case LSR: case ROL: case ROR:
+            if (mode == ACCUMULATOR) {
+                if (name == ROL || name == ROR) {
+                    emit_load(DL, P);
+                    EMIT(0xd0, 0xea);
+                }
+                emit_load(AL, cpu_field(name));
+                EMIT(0xd0, name == ASL ? 0xe0 : name == LSR ? 0xe8 : name == ROL ? 0xd0 : 0xd8);
+                EMIT(0x0f, 0x92, 0xc2);
+                emit_store(cpu_field(name));
+                emit_clear_flags(1 << CARRY);
+                emit_or_flags();
+                emit_nz();
+                return false;
+            }
+            break;
+
+        case TAX: case TAY: case TSX: case TXA: case TYA:
+            emit_load(AL, name == TAX || name == TAY ? offsetof(struct nes, cpu.a) : cpu_field(name));
+            emit_store(name == TAX || name == TSX ? offsetof(struct nes, cpu.x) :
+                       name == TAY ? offsetof(struct nes, cpu.y) : offsetof(struct nes, cpu.a));
+            emit_nz();
+            return false;
+
+        case TXS:
+            emit_load(AL, cpu_field(name));
+            emit_store(offsetof(struct nes, cpu.s));
+            return false;
+
+        case INX: case INY: case DEX: case DEY:
+            emit_load(AL, cpu_field(name));
+            EMIT(0xfe, name == INX || name == INY ? 0xc0 : 0xc8);
+            emit_store(cpu_field(name));
+            emit_nz();
+            return false;
+
+        case CLC: emit_clear_flags(1 << CARRY); return false;
+        case CLD: emit_clear_flags(1 << DECIMAL); return false;
+        case CLI: emit_clear_flags(1 << INTERRUPT); return false;
+        case CLV: emit_clear_flags(1 << OVERFLOW); return false;
+        case SEC: emit_set_flags(1 << CARRY); return false;
+        case SED: emit_set_flags(1 << DECIMAL); return false;
+        case SEI: emit_set_flags(1 << INTERRUPT); return false;
+        case NOP: return false;
+
+        case BCC: case BCS: case BEQ: case BMI: case BNE: case BPL: case BVC: case BVS:
+            emit_branch(pc, name, operand, *cycles);
+            return true;
+
+        case JMP:
+            if (mode == ABSOLUTE) {
+                emit_set_pc(operand == pc ? pc + length : operand);
+                emit_exit(*cycles);
+                return true;
+            }
+            break;
+
+        default:
+            break;
+    }
+
+    emit_function(pc, name, mode, operand);
+
+    if (!ends_block(name)) {
+        return false;
+    }
+
+    // execute_next() moves past jumps that land on themselves
+    EMIT(0x66, 0x41, 0x81, 0x7c, 0x24, PC);
+    emit_16(pc);
+    uint8_t *moved = emit_jump(0x75);
+    emit_set_pc(pc + length);
+    patch_jump(moved);
+
+    emit_exit(*cycles);
+    return true;
+}
+
+
+// Reads the instruction at pc if it can be part of a block starting in the same window
+static bool fetch_instruction(uint16_t start, uint16_t pc, uint8_t *bytes) {
+    if (pc < 0x8000 || (pc ^ start) & ~(JIT_BANK_SIZE - 1)) {
+        return false;
+    }
+
+    uint8_t *page = memory_map.fetch[pc >> 8];
+    if (page == NULL || INSTRUCTION_LOOKUP[page[pc & 0xff]] == INSTRUCTION_NONE) {
+        return false;
+    }
+
+    enum address_mode mode = ADDRESS_MODE_LOOKUP[page[pc & 0xff]];
+    uint16_t length = instruction_length(mode);
+    uint16_t last = pc + length - 1;
+    if (last < pc || (last ^ start) & ~(JIT_BANK_SIZE - 1) || memory_map.fetch[last >> 8] == NULL) {
+        return false;
+    }
+
+    for (uint16_t i = 0; i < length; i++) {
+        bytes[i] = memory_map.fetch[(pc + i) >> 8][(pc + i) & 0xff];
+    }
+
+    // Registers are left to the interpreter, jumps only use the address as a target
+    enum instruction_name name = INSTRUCTION_LOOKUP[bytes[0]];
+    uint16_t operand = bytes[1] | bytes[2] << 8;
+    if (mode == ABSOLUTE && name != JMP && name != JSR && operand >= IO_START && operand < IO_END) {
+        return false;
+    }
+
+    return true;
+}
+
+static void flush() {
+    jit.used = 0;
+    jit.block_count = 0;
+    jit.generation = memory_map.generation;
+    memset(jit.run.banks, 0, sizeof(jit.run.banks));
+    memset(jit.step.banks, 0, sizeof(jit.step.banks));
+}
+
+static struct jit_block *emit_block(struct jit_cache *cache, uint16_t start) {
+    uint8_t *code = jit.code + jit.used;
+    jit.at = code;
+    emit_prologue();
+
+    uint16_t pc = start;
+    int count = 0;
+    int cycles = 0;
+    bool ended = false;
+
+    while (!ended && count < cache->max_instructions) {
+        uint8_t bytes[3] = { 0 };
+        if (!fetch_instruction(start, pc, bytes)) {
+            break;
+        }
+
+        ended = emit_instruction(pc, bytes, &cycles);
+        pc += instruction_length(ADDRESS_MODE_LOOKUP[bytes[0]]);
+        count++;
+    }
+
+    if (count == 0) {
+        return &untranslatable;
+    }
+
+    if (!ended) {
+        emit_set_pc(pc);
+        emit_exit(cycles);
+    }
+
+    jit.used = jit.at - jit.code;
+    assert(jit.used <= JIT_CODE_SIZE);
+
+    struct jit_block *block = &jit.blocks[jit.block_count++];
+    block->code = code;
+    block->instructions = count;
+    return block;
+}
+
+// Sets the protection of the whole pages covering length bytes of code from start
+static bool protect(uint8_t *start, size_t length, int protection) {
+    uintptr_t page = jit.page_size;
+    uintptr_t first = (uintptr_t)start & ~(page - 1);
+    uintptr_t end = ((uintptr_t)start + length + page - 1) & ~(page - 1);
+    if (end > (uintptr_t)jit.code + JIT_CODE_SIZE) {
+        end = (uintptr_t)jit.code + JIT_CODE_SIZE;
+    }
+
+    return mprotect((void *)first, end - first, protection) == 0;
+}
+
+// Without a way to make code executable again everything is interpreted
+static struct jit_block *disable() {
+    log_warning("Unable to change the protection of JIT code, falling back to the interpreter\n");
+    munmap(jit.code, JIT_CODE_SIZE);
+    jit.code = NULL;
+    flush();
+    return &untranslatable;
+}
+
+// Code is never writable and executable at once. The pages a block can reach are made
+// writable while it is emitted, then executable again.
+static struct jit_block *translate(struct jit_cache *cache, uint16_t start) {
+    size_t reserve = (cache->max_instructions + 1) * JIT_INSTRUCTION_BYTES;
+    if (jit.used + reserve > JIT_CODE_SIZE || jit.block_count == JIT_MAX_BLOCKS) {
+        flush();
+    }
+
+    uint8_t *code = jit.code + jit.used;
+    if (!protect(code, reserve, PROT_READ | PROT_WRITE)) {
+        return disable();
+    }
+
+    struct jit_block *block = emit_block(cache, start);
+
+    if (!protect(code, reserve, PROT_READ | PROT_EXEC)) {
+        return disable();
+    }
+    __builtin___clear_cache((char *)code, (char *)jit.at);
+
+    return block;
+}
+
+static void init() {
+    jit.ready = true;
+
+    for (int i = 0; i < 256; i++) {
+        nz_flags[i] = (i & (1 << NEGATIVE)) | (i == 0 ? 1 << ZERO : 0);
+    }
+
+    jit.page_size = sysconf(_SC_PAGESIZE);
+    jit.code = mmap(NULL, JIT_CODE_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (jit.code == MAP_FAILED) {
+        log_warning("Unable to map memory for JIT code, the JIT falls back to the interpreter\n");
+        jit.code = NULL;
+    }
+
+    flush();
+}
+
+// Returns the translation starting at pc, NULL when the interpreter should run it
+static struct jit_block *find_block(struct jit_cache *cache, uint16_t pc) {
+    if (!jit.ready) {
+        init();
+    }
+
+    if (jit.code == NULL || pc < 0x8000) {
+        return NULL;
+    }
+
+    if (jit.generation != memory_map.generation) {
+        flush();
+    }
+
+    int window = (pc - 0x8000) / JIT_BANK_SIZE;
+    struct jit_bank *bank = &cache->banks[window];
+
+    // A different bank in the window invalidates only this window's translations
+    uint8_t *rom = memory_map.fetch[(0x8000 + window * JIT_BANK_SIZE) >> 8];
+    if (bank->rom != rom) {
+        memset(bank, 0, sizeof(*bank));
+        bank->rom = rom;
+    }
+    if (rom == NULL) {
+        return NULL;
+    }
+
+    uint16_t offset = pc % JIT_BANK_SIZE;
+    struct jit_block *block = bank->blocks[offset];
+
+    if (block == NULL) {
+        if (bank->heat[offset] < cache->threshold) {
+            bank->heat[offset]++;
+            return NULL;
+        }
+
+        // Translation may flush every cache, bank included
+        block = translate(cache, pc);
+        bank->rom = rom;
+        bank->blocks[offset] = block;
+    }
+
+    return block == &untranslatable ? NULL : block;
+}
+
+static int run_block(const struct jit_block *block) {
+    int (*code)();
+    memcpy(&code, &block->code, sizeof(code));
+    return code();
+}
+
+// Interprets up to the end of a basic block, so cold code still warms up block starts only
+static int interpret_block(uint32_t *instructions) {
+    int cycles = 0;
+
+    for (int i = 0; i < JIT_BLOCK_LENGTH; i++) {
+        uint8_t *page = memory_map.fetch[nes.cpu.pc >> 8];
+        enum instruction_name name = page != NULL ? INSTRUCTION_LOOKUP[page[nes.cpu.pc & 0xff]] : INSTRUCTION_NONE;
+
+        // Undocumented opcodes halt the interpreter, only run one when it is the first instruction
+        if (i > 0 && name == INSTRUCTION_NONE) {
+            break;
+        }
+
+        int executed = execute_next();
+        if (executed == 0) {
+            break;
+        }
+        cycles += executed;
+        (*instructions)++;
+
+        if (name == INSTRUCTION_NONE || ends_block(name)) {
+            break;
+        }
+    }
+
+    return cycles;
+}
+
+
+int jit_step() {
+    struct jit_block *block = find_block(&jit.step, nes.cpu.pc);
+    if (block == NULL) {
+        return execute_next();
+    }
+    return run_block(block);
+}
+
+int jit_run(int budget, uint32_t *instructions) {
+    int cycles = 0;
+    uint32_t count = 0;
+
+    do {
+        struct jit_block *block = find_block(&jit.run, nes.cpu.pc);
+        if (block != NULL) {
+            cycles += run_block(block);
+            count += block->instructions;
+            continue;
+        }
+
+        int interpreted = interpret_block(&count);
+        if (interpreted == 0) {
+            break;
+        }
+        cycles += interpreted;
+    } while (cycles < budget);
+
+    if (instructions != NULL) {
+        *instructions = count;
+    }
+
+    return cycles;
+}
+
+#endif
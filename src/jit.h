@@ -0,0 +1,21 @@
+#ifndef JIT_H
+#define JIT_H
+
+#include <stdint.h>
+
+// Dynamic recompiler from 6502 basic blocks in PRG ROM to x86-64. Blocks are
+// translated once their start has run often enough, cached per PRG bank and
+// run from jit_run() until a cycle budget is used up. Everything else, code in
+// RAM included, goes through execute_next().
+
+#if defined(__x86_64__) && !defined(_WIN32)
+#define JIT_SUPPORTED
+
+// Executes exactly one instruction, each translated on its own so it can be checked against execute_next()
+int jit_step();
+
+int jit_run(int budget, uint32_t *instructions);
+
+#endif
+
+#endif
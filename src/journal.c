@@ -0,0 +1,210 @@
+#include <stdbool.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "journal.h"
+#include "nes.h"
+#include "instructions.h"
+
+
+struct journal journal = { 0 };
+
+struct {
+    FILE *file;
+    uint64_t offset;
+
+    // Where the open chunk's keyframe left the machine
+    uint64_t chunk_cycle;
+    uint64_t instructions;
+
+    // Without instructions a chunk waits for the next record after a frame ends, so its
+    // keyframe comes after vertical blank has started
+    bool keyframe_due;
+
+    struct journal_index_entry *index;
+    uint64_t chunks;
+    uint64_t capacity;
+
+    // Built here rather than on the stack, a snapshot is over 10KB
+    struct journal_chunk chunk;
+} recording = { 0 };
+
+
+static void write_bytes(const void *data, size_t size) {
+    if (size > 0 && fwrite(data, size, 1, recording.file) != 1) {
+        log_error("Unable to write to the journal, it stops here\n");
+        journal.enabled = false;
+        journal.instructions = false;
+    }
+    recording.offset += size;
+}
+
+static void write_padding(size_t size) {
+    static const uint8_t zeroes[16] = { 0 };
+    write_bytes(zeroes, size);
+}
+
+static void start_chunk() {
+    if (recording.chunks == recording.capacity) {
+        uint64_t capacity = recording.capacity == 0 ? 256 : recording.capacity * 2;
+        struct journal_index_entry *index = realloc(recording.index, capacity * sizeof(*index));
+        if (index == NULL) {
+            log_error("Out of memory for the journal index\n");
+            exit(EXIT_FAILURE);
+        }
+        recording.index = index;
+        recording.capacity = capacity;
+    }
+
+    recording.index[recording.chunks++] = (struct journal_index_entry){
+        .offset = recording.offset,
+        .cycle = nes.cpu.cycles,
+        .frame = state.frames,
+        .instruction = recording.instructions,
+    };
+
+    struct journal_chunk *chunk = &recording.chunk;
+    memset(chunk, 0, sizeof(*chunk));
+    chunk->type = JOURNAL_CHUNK;
+    chunk->cycle = nes.cpu.cycles;
+    chunk->frame = state.frames;
+    chunk->instruction = recording.instructions;
+    save_snapshot(&chunk->keyframe);
+    chunk->keyframe.nes.ppu.framebuffer = NULL;
+
+    write_bytes(chunk, sizeof(*chunk));
+    write_padding(JOURNAL_CHUNK_SIZE - sizeof(*chunk));
+    recording.chunk_cycle = nes.cpu.cycles;
+}
+
+// Through the memory map only, a bus read could have side effects such as shifting a controller
+static uint8_t peek(uint16_t address) {
+    uint8_t *page = memory_map.read[address >> 8];
+    return page != NULL ? page[address & 0xff] : 0;
+}
+
+static void write_record(struct journal_record *record) {
+    if (recording.keyframe_due) {
+        recording.keyframe_due = false;
+        start_chunk();
+    }
+
+    record->cycle = nes.cpu.cycles - recording.chunk_cycle;
+    record->pc = nes.cpu.pc;
+    record->a = nes.cpu.a;
+    record->x = nes.cpu.x;
+    record->y = nes.cpu.y;
+    record->s = nes.cpu.s;
+    record->p = nes.cpu.p;
+    write_bytes(record, sizeof(*record));
+}
+
+
+bool journal_open(const char *filename, bool instructions) {
+    journal_close();
+
+    if (state.filedata == NULL) {
+        log_error("A journal needs a loaded ROM\n");
+        return false;
+    }
+
+    recording.file = fopen(filename, "wb");
+    if (recording.file == NULL) {
+        logf_error("Unable to open journal %s\n", filename);
+        return false;
+    }
+
+    recording.offset = 0;
+    recording.instructions = 0;
+    recording.chunks = 0;
+    recording.keyframe_due = false;
+    journal.enabled = true;
+    journal.instructions = instructions;
+
+    struct journal_header header = {
+        .magic = JOURNAL_MAGIC,
+        .version = JOURNAL_VERSION,
+        .record_size = sizeof(struct journal_record),
+        .chunk_size = JOURNAL_CHUNK_SIZE,
+        .flags = instructions ? JOURNAL_INSTRUCTIONS : 0,
+        .rom_size = state.filesize,
+    };
+    write_bytes(&header, sizeof(header));
+    write_bytes(state.filedata, state.filesize);
+    write_padding(-recording.offset % sizeof(struct journal_record));
+
+    start_chunk();
+    fflush(recording.file);
+    return journal.enabled;
+}
+
+void journal_close() {
+    if (recording.file == NULL) return;
+
+    if (journal.enabled) {
+        struct journal_trailer trailer = {
+            .magic = JOURNAL_INDEX_MAGIC,
+            .index_offset = recording.offset,
+            .chunks = recording.chunks,
+        };
+        write_bytes(recording.index, recording.chunks * sizeof(*recording.index));
+        write_bytes(&trailer, sizeof(trailer));
+    }
+
+    logf_info("Journal holds %lu instructions in %lu chunks, %lu bytes\n", recording.instructions, recording.chunks, recording.offset);
+
+    fclose(recording.file);
+    recording.file = NULL;
+    free(recording.index);
+    recording.index = NULL;
+    recording.capacity = 0;
+    journal.enabled = false;
+    journal.instructions = false;
+}
+
+
+// Called before the instruction at the PC runs
+void journal_instruction() {
+    if (nes.cpu.cycles - recording.chunk_cycle >= JOURNAL_INTERVAL) {
+        start_chunk();
+    }
+
+    struct journal_record record = { .type = JOURNAL_STEP };
+    record.bytes[0] = peek(nes.cpu.pc);
+    int length = instruction_length(ADDRESS_MODE_LOOKUP[record.bytes[0]]);
+    for (int i = 1; i < length; i++) {
+        record.bytes[i] = peek(nes.cpu.pc + i);
+    }
+
+    write_record(&record);
+    recording.instructions++;
+}
+
+void journal_input(int port, uint8_t buttons) {
+    struct journal_record record = { .type = JOURNAL_INPUT, .bytes = { port, buttons } };
+    write_record(&record);
+}
+
+// Keeps a crash from losing more than the frame in progress
+void journal_end_frame() {
+    struct journal_record record = { .type = JOURNAL_FRAME };
+    write_record(&record);
+
+    if (!journal.instructions && nes.cpu.cycles - recording.chunk_cycle >= JOURNAL_INTERVAL) {
+        recording.keyframe_due = true;
+    }
+
+    fflush(recording.file);
+}
+
+// Where run_frame() stopped the engine for it, which depends on the engine
+void journal_end_vblank() {
+    struct journal_record record = { .type = JOURNAL_VBLANK };
+    write_record(&record);
+}
+
+void journal_keyframe() {
+    recording.keyframe_due = false;
+    start_chunk();
+}
@@ -0,0 +1,123 @@
+#ifndef JOURNAL_H
+#define JOURNAL_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "cnes.h"
+#include "nes.h"
+
+// A binary record of a session that can be opened at any cycle without reading what
+// came before. The file is a header carrying the ROM, then chunks. Each chunk starts
+// with a keyframe, a full snapshot, and holds fixed-size records from there: every
+// instruction with the registers before it, controller input, frame ends and the ends
+// of vertical blank. A chunk starts once JOURNAL_INTERVAL cycles have passed and
+// whenever the machine is restored, so a seek replays a few frames at most and never
+// through a rollback or loaded state.
+//
+// Closing appends an index of the chunks by cycle and frame and a trailer pointing at
+// it. A file cut short by a crash has neither, and readers find the chunks by walking
+// the records instead. Everything is in host byte order, and keyframes are only
+// readable by the same build, like snapshots.
+//
+// Recording every instruction runs the machine on execute_next(). Without them only
+// keyframes, input, frame ends and vertical blank ends are written, which is still
+// enough to replay the session, leaves the engine alone and takes a small fraction of
+// the space. Chunks then start with the first record after the end of a frame.
+
+#define JOURNAL_MAGIC "CNESJRN1"
+#define JOURNAL_INDEX_MAGIC "CNESJIDX"
+#define JOURNAL_VERSION 2
+
+// About nine frames
+#define JOURNAL_INTERVAL (1 << 18)
+
+enum journal_type {
+    JOURNAL_CHUNK = 1,
+    JOURNAL_STEP,
+    JOURNAL_INPUT,
+    JOURNAL_FRAME,
+    JOURNAL_VBLANK,
+};
+
+struct journal_header {
+    char magic[8];
+    uint32_t version;
+    uint32_t record_size;
+    uint32_t chunk_size;
+    uint32_t flags;
+    uint64_t rom_size;
+    // The iNES image follows, padded to a multiple of the record size
+};
+
+#define JOURNAL_INSTRUCTIONS 1
+
+// Where the chunk's keyframe leaves the machine
+struct journal_chunk {
+    uint8_t type;
+    uint8_t padding[7];
+    uint64_t cycle;
+    uint64_t frame;
+    // Instructions recorded in the file before this chunk, 0 without them
+    uint64_t instruction;
+    struct snapshot keyframe;
+};
+
+// On disk a chunk header takes this much, the struct padded to a multiple of 16
+#define JOURNAL_CHUNK_SIZE ((sizeof(struct journal_chunk) + 15) & ~(size_t)15)
+
+struct journal_record {
+    uint8_t type;
+    // JOURNAL_STEP: the instruction bytes. JOURNAL_INPUT: the port, then the buttons.
+    uint8_t bytes[3];
+    // Cycles since the chunk's keyframe
+    uint32_t cycle;
+    uint16_t pc;
+    uint8_t a;
+    uint8_t x;
+    uint8_t y;
+    uint8_t s;
+    uint8_t p;
+    uint8_t padding;
+};
+
+struct journal_index_entry {
+    uint64_t offset;
+    uint64_t cycle;
+    uint64_t frame;
+    uint64_t instruction;
+};
+
+struct journal_trailer {
+    char magic[8];
+    uint64_t index_offset;
+    uint64_t chunks;
+};
+
+struct journal {
+    bool enabled;
+    bool instructions;
+};
+
+extern struct journal journal;
+
+#define journal_step() do { if (journal.instructions) journal_instruction(); } while (0)
+#define journal_buttons(port, buttons) do { if (journal.enabled) journal_input(port, buttons); } while (0)
+#define journal_frame() do { if (journal.enabled) journal_end_frame(); } while (0)
+#define journal_vblank() do { if (journal.enabled) journal_end_vblank(); } while (0)
+#define journal_restored() do { if (journal.enabled) journal_keyframe(); } while (0)
+
+// Starts with a keyframe of the machine as it is, which needs a loaded ROM
+CNES_API bool journal_open(const char *filename, bool instructions);
+
+// Writes the index, the file is complete without it but slower to open
+CNES_API void journal_close();
+
+void journal_instruction();
+void journal_input(int port, uint8_t buttons);
+void journal_end_frame();
+void journal_end_vblank();
+
+// Starts a new chunk at once, for when the machine jumps to another state
+void journal_keyframe();
+
+#endif
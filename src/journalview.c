@@ -0,0 +1,368 @@
+#define _DEFAULT_SOURCE
+
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "journal.h"
+#include "nes.h"
+
+
+struct {
+    const uint8_t *data;
+    size_t size;
+    const struct journal_header *header;
+
+    // Chunks in file order, pointing into the mapping when the file has an index
+    const struct journal_index_entry *index;
+    uint64_t chunks;
+    bool indexed;
+
+    // Where the records stop, the index or the end of the last whole record
+    uint64_t end;
+} file = { 0 };
+
+// Where the replay is, and how it compares with the recorded instructions
+struct {
+    uint64_t chunk;
+    const struct journal_record *next;
+    const struct journal_record *end;
+
+    // A recorded instruction was checked and has not been run yet
+    bool pending;
+
+    uint64_t checked;
+    uint64_t diverged;
+    uint64_t first_divergence;
+} replay = { 0 };
+
+
+static const struct journal_chunk *chunk_at(uint64_t index) {
+    return (const struct journal_chunk *)(file.data + file.index[index].offset);
+}
+
+static uint64_t chunk_end(uint64_t index) {
+    return index + 1 < file.chunks ? file.index[index + 1].offset : file.end;
+}
+
+static bool read_trailer() {
+    if (file.size < sizeof(struct journal_trailer)) return false;
+
+    const struct journal_trailer *trailer = (const struct journal_trailer *)(file.data + file.size - sizeof(*trailer));
+    if (memcmp(trailer->magic, JOURNAL_INDEX_MAGIC, sizeof(trailer->magic)) != 0) return false;
+    if (trailer->index_offset + trailer->chunks * sizeof(struct journal_index_entry) + sizeof(*trailer) != file.size) return false;
+
+    file.index = (const struct journal_index_entry *)(file.data + trailer->index_offset);
+    file.chunks = trailer->chunks;
+    file.end = trailer->index_offset;
+    file.indexed = true;
+    return true;
+}
+
+// Without an index, as after a crash, the chunks are found by walking every record
+static void scan_chunks(uint64_t offset) {
+    struct journal_index_entry *index = NULL;
+    uint64_t capacity = 0;
+
+    while (offset + sizeof(struct journal_record) <= file.size) {
+        uint8_t type = file.data[offset];
+        if (type == JOURNAL_CHUNK) {
+            if (offset + JOURNAL_CHUNK_SIZE > file.size) break;
+
+            if (file.chunks == capacity) {
+                capacity = capacity == 0 ? 256 : capacity * 2;
+                index = realloc(index, capacity * sizeof(*index));
+                if (index == NULL) {
+                    fprintf(stderr, "Out of memory for the journal index\n");
+                    exit(EXIT_FAILURE);
+                }
+            }
+
+            const struct journal_chunk *chunk = (const struct journal_chunk *)(file.data + offset);
+            index[file.chunks++] = (struct journal_index_entry){ offset, chunk->cycle, chunk->frame, chunk->instruction };
+            offset += JOURNAL_CHUNK_SIZE;
+        } else if (type == JOURNAL_STEP || type == JOURNAL_INPUT || type == JOURNAL_FRAME || type == JOURNAL_VBLANK) {
+            offset += sizeof(struct journal_record);
+        } else {
+            break;
+        }
+    }
+
+    file.index = index;
+    file.end = offset;
+}
+
+static void open_journal(const char *filename) {
+    int fd = open(filename, O_RDONLY);
+    struct stat info;
+    if (fd < 0 || fstat(fd, &info) != 0) {
+        fprintf(stderr, "Unable to open %s\n", filename);
+        exit(EXIT_FAILURE);
+    }
+
+    file.size = info.st_size;
+    file.data = file.size > 0 ? mmap(NULL, file.size, PROT_READ, MAP_PRIVATE, fd, 0) : MAP_FAILED;
+    close(fd);
+    if (file.data == MAP_FAILED) {
+        fprintf(stderr, "Unable to map %s\n", filename);
+        exit(EXIT_FAILURE);
+    }
+
+    file.header = (const struct journal_header *)file.data;
+    if (file.size < sizeof(*file.header) || memcmp(file.header->magic, JOURNAL_MAGIC, sizeof(file.header->magic)) != 0) {
+        fprintf(stderr, "%s is not a cnes journal\n", filename);
+        exit(EXIT_FAILURE);
+    }
+
+    if (file.header->version != JOURNAL_VERSION || file.header->record_size != sizeof(struct journal_record) || file.header->chunk_size != JOURNAL_CHUNK_SIZE) {
+        fprintf(stderr, "%s was written by another build of cnes\n", filename);
+        exit(EXIT_FAILURE);
+    }
+
+    uint64_t records = sizeof(*file.header) + file.header->rom_size;
+    records += -records % sizeof(struct journal_record);
+    if (records > file.size) {
+        fprintf(stderr, "%s is cut short before its first chunk\n", filename);
+        exit(EXIT_FAILURE);
+    }
+
+    if (!read_trailer()) {
+        scan_chunks(records);
+    }
+
+    if (file.chunks == 0) {
+        fprintf(stderr, "%s holds no chunks\n", filename);
+        exit(EXIT_FAILURE);
+    }
+}
+
+static void load_rom() {
+    state.filesize = file.header->rom_size;
+    state.filedata = malloc(state.filesize > 0 ? state.filesize : 1);
+    if (state.filedata == NULL) {
+        fprintf(stderr, "Out of memory for the ROM\n");
+        exit(EXIT_FAILURE);
+    }
+    memcpy(state.filedata, file.data + sizeof(*file.header), state.filesize);
+
+    if (!load_cartridge()) {
+        exit(EXIT_FAILURE);
+    }
+    init_memory();
+}
+
+
+static bool same_machine(const struct snapshot *keyframe) {
+    return keyframe->nes.cpu.pc == nes.cpu.pc && keyframe->nes.cpu.a == nes.cpu.a &&
+            keyframe->nes.cpu.x == nes.cpu.x && keyframe->nes.cpu.y == nes.cpu.y &&
+            keyframe->nes.cpu.s == nes.cpu.s && keyframe->nes.cpu.p == nes.cpu.p &&
+            memcmp(keyframe->nes.cpu.ram, nes.cpu.ram, sizeof(nes.cpu.ram)) == 0 &&
+            memcmp(keyframe->prg_ram, cartridge.prg_ram, sizeof(keyframe->prg_ram)) == 0;
+}
+
+static void diverged() {
+    if (replay.diverged++ == 0) {
+        replay.first_divergence = nes.cpu.cycles;
+    }
+}
+
+// A chunk that carries on from the replay checks it, one after a restore replaces it
+static void enter_chunk(uint64_t index, bool continued) {
+    const struct journal_chunk *chunk = chunk_at(index);
+    if (continued && chunk->cycle == nes.cpu.cycles && !same_machine(&chunk->keyframe)) {
+        diverged();
+    }
+
+    load_snapshot(&chunk->keyframe);
+
+    replay.chunk = index;
+    replay.next = (const struct journal_record *)((const uint8_t *)chunk + JOURNAL_CHUNK_SIZE);
+    replay.end = (const struct journal_record *)(file.data + chunk_end(index));
+    replay.pending = false;
+}
+
+static void apply(const struct journal_record *record) {
+    switch (record->type) {
+        case JOURNAL_STEP:
+            replay.checked++;
+            if (record->pc != nes.cpu.pc || record->a != nes.cpu.a || record->x != nes.cpu.x ||
+                    record->y != nes.cpu.y || record->s != nes.cpu.s || record->p != nes.cpu.p) {
+                diverged();
+            }
+            replay.pending = true;
+            break;
+        case JOURNAL_INPUT:
+            set_buttons(record->bytes[0] & 1, record->bytes[1]);
+            break;
+        case JOURNAL_FRAME:
+            // As at the end of run_frame()
+            state.frames++;
+            start_vblank();
+            break;
+        case JOURNAL_VBLANK:
+            end_vblank();
+            break;
+    }
+}
+
+// Applies every record due by the current cycle, moving into the next chunk once this one
+// is used up. Returns false at the end of the journal.
+static bool catch_up() {
+    for (;;) {
+        uint64_t base = chunk_at(replay.chunk)->cycle;
+        while (replay.next < replay.end && base + replay.next->cycle <= nes.cpu.cycles) {
+            apply(replay.next++);
+        }
+
+        if (replay.next < replay.end) return true;
+
+        // The last recorded instruction runs before whatever ended the chunk
+        if (replay.pending) return true;
+        if (replay.chunk + 1 == file.chunks) return false;
+        enter_chunk(replay.chunk + 1, true);
+    }
+}
+
+static void run_instruction() {
+    nes.cpu.cycles += execute_next();
+    replay.pending = false;
+}
+
+
+// The last chunk reaching the target without a later chunk in file order reaching it
+// first. After a rollback the same cycle is reached again, and the latest time wins.
+static uint64_t find_chunk(bool by_frame, uint64_t target) {
+    uint64_t found = 0;
+    for (uint64_t i = 0; i < file.chunks; i++) {
+        uint64_t at = by_frame ? file.index[i].frame : file.index[i].cycle;
+        uint64_t next = i + 1 < file.chunks ? (by_frame ? file.index[i + 1].frame : file.index[i + 1].cycle) : UINT64_MAX;
+        if (at <= target && next > target) {
+            found = i;
+        }
+    }
+    return found;
+}
+
+static bool seek(bool by_frame, uint64_t target) {
+    enter_chunk(find_chunk(by_frame, target), false);
+
+    for (;;) {
+        if (!catch_up()) return false;
+        if (by_frame ? state.frames >= target : nes.cpu.cycles >= target) return true;
+        run_instruction();
+    }
+}
+
+
+static void print_summary(const char *filename) {
+    const struct journal_index_entry *last = &file.index[file.chunks - 1];
+    uint64_t instructions = last->instruction;
+    uint64_t last_cycle = last->cycle;
+    uint64_t frames = last->frame;
+
+    for (const struct journal_record *record = (const struct journal_record *)(file.data + last->offset + JOURNAL_CHUNK_SIZE);
+            record < (const struct journal_record *)(file.data + file.end); record++) {
+        last_cycle = last->cycle + record->cycle;
+        instructions += record->type == JOURNAL_STEP;
+        frames += record->type == JOURNAL_FRAME;
+    }
+
+    printf("%s: %lu bytes, %lu byte ROM, %lu chunks%s\n", filename, file.size, file.header->rom_size, file.chunks,
+            file.indexed ? "" : ", no index (found by scanning)");
+    printf("cycles %lu to %lu, frames %lu to %lu", file.index[0].cycle, last_cycle, file.index[0].frame, frames);
+    if (file.header->flags & JOURNAL_INSTRUCTIONS) {
+        printf(", %lu instructions\n", instructions);
+    } else {
+        printf(", keyframes and input only\n");
+    }
+}
+
+static void print_ram() {
+    for (int row = 0; row < 0x800; row += 16) {
+        printf("%04X:", row);
+        for (int i = 0; i < 16; i++) {
+            printf(" %02X", nes.cpu.ram[row + i]);
+        }
+        printf("\n");
+    }
+}
+
+
+int main(int argc, char **argv) {
+    const char *filename = NULL;
+    bool by_frame = false;
+    bool seeking = false;
+    uint64_t target = 0;
+    int lines = 1;
+    bool dump = false;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--cycle") == 0 && i + 1 < argc) {
+            seeking = true;
+            by_frame = false;
+            target = strtoull(argv[++i], NULL, 0);
+        } else if (strcmp(argv[i], "--frame") == 0 && i + 1 < argc) {
+            seeking = true;
+            by_frame = true;
+            target = strtoull(argv[++i], NULL, 0);
+        } else if (strcmp(argv[i], "--lines") == 0 && i + 1 < argc) {
+            lines = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--ram") == 0) {
+            dump = true;
+        } else if (filename == NULL && argv[i][0] != '-') {
+            filename = argv[i];
+        } else {
+            filename = NULL;
+            break;
+        }
+    }
+
+    if (filename == NULL) {
+        fprintf(stderr, "Usage: %s [--cycle CYCLE | --frame FRAME] [--lines COUNT] [--ram] JOURNAL\n", argv[0]);
+        fprintf(stderr, "Summarises a --journal file, or rebuilds the machine at a cycle or the start of a frame\n");
+        fprintf(stderr, "from the nearest keyframe and traces the instructions from there\n");
+        exit(EXIT_FAILURE);
+    }
+
+    open_journal(filename);
+    print_summary(filename);
+    if (!seeking) {
+        return EXIT_SUCCESS;
+    }
+
+    load_rom();
+    uint64_t start = file.index[find_chunk(by_frame, target)].cycle;
+    if (!seek(by_frame, target)) {
+        fprintf(stderr, "The journal ends before %s %lu\n", by_frame ? "frame" : "cycle", target);
+        exit(EXIT_FAILURE);
+    }
+
+    printf("frame %lu cycle %lu, replayed %lu cycles from a keyframe\n", state.frames, nes.cpu.cycles, nes.cpu.cycles - start);
+    if (dump) {
+        print_ram();
+    }
+
+    state.debug = true;
+    for (int i = 0; i < lines && catch_up(); i++) {
+        run_instruction();
+    }
+    state.debug = false;
+
+    if (replay.diverged > 0) {
+        printf("replay diverged from the journal %lu times, first at cycle %lu\n", replay.diverged, replay.first_divergence);
+        cleanup_nes();
+        return EXIT_FAILURE;
+    }
+
+    if (replay.checked > 0) {
+        printf("replay matched %lu recorded instructions\n", replay.checked);
+    }
+
+    cleanup_nes();
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,666 @@
+#include <stdbool.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/wait.h>
+#include "nes.h"
+#include "instructions.h"
+#include "engine.h"
+#include "batch.h"
+#include "workers.h"
+
+
+#define LOCKSTEP_PATH_LENGTH 1024
+#define LOCKSTEP_MESSAGE_LENGTH (2 * LOCKSTEP_PATH_LENGTH)
+
+// With --batch the lanes are compared after every slice of this many cycles
+#define BATCH_SLICE_CYCLES 64
+
+const uint32_t PRG_SIZE = 0x8000;
+const uint16_t PRG_START = 0x8000;
+
+const char REPRODUCER_MAGIC[8] = "CNESLS2";
+
+
+// Everything needed to run the diverging instruction again
+struct reproducer {
+    char magic[8];
+    uint64_t seed;
+    uint64_t instruction;
+    struct snapshot snapshot;
+    uint8_t prg[0x8000];
+};
+
+// What one engine did to the machine during one instruction, or one block with --blocks
+struct step {
+    struct snapshot after;
+    int cycles;
+    int write_count;
+    struct {
+        uint16_t address;
+        uint8_t data;
+    } writes[WRITE_LOG_SIZE];
+};
+
+// Lives in shared memory so forked workers can report back
+struct outcome {
+    bool done;
+    bool diverged;
+    uint64_t executed;
+    char message[LOCKSTEP_MESSAGE_LENGTH];
+};
+
+struct {
+    const struct engine *engines[2];
+    const char *rom;
+    const char *out;
+    uint64_t first_seed;
+    uint64_t instructions;
+    int seeds;
+    int jobs;
+    int batch;
+    bool blocks;
+    bool verbose;
+} options = { .out = ".", .first_seed = 1, .instructions = 100000, .seeds = 64, .jobs = 0 };
+
+struct outcome *outcomes = NULL;
+
+struct batch batch __attribute__((aligned(64)));
+
+uint8_t rom_prg[0x8000];
+bool have_rom = false;
+
+
+// xorshift64*, seeded per test so every seed reproduces on its own
+uint64_t next_random(uint64_t *rng) {
+    *rng ^= *rng >> 12;
+    *rng ^= *rng << 25;
+    *rng ^= *rng >> 27;
+    return *rng * 0x2545f4914f6cdd1dull;
+}
+
+// Random code made only of documented opcodes, undocumented ones halt the core
+void random_program(uint64_t *rng, uint8_t *prg) {
+    uint8_t opcodes[256];
+    int count = 0;
+    for (int i = 0; i < 256; i++) {
+        if (INSTRUCTION_LOOKUP[i] != INSTRUCTION_NONE) {
+            opcodes[count++] = i;
+        }
+    }
+
+    for (uint32_t i = 0; i < PRG_SIZE;) {
+        uint8_t opcode = opcodes[next_random(rng) % count];
+        prg[i++] = opcode;
+
+        for (int j = 1; j < instruction_length(ADDRESS_MODE_LOOKUP[opcode]) && i < PRG_SIZE; j++) {
+            prg[i++] = next_random(rng);
+        }
+    }
+
+    for (uint16_t vector = NMI_VECTOR; vector != 0; vector += 2) {
+        uint16_t target = PRG_START + next_random(rng) % (PRG_SIZE - 6);
+        prg[vector - PRG_START] = target & 0xff;
+        prg[vector - PRG_START + 1] = target >> 8;
+    }
+}
+
+// Builds an NROM-256 image around prg and powers the memory up
+void load_prg(const uint8_t *prg) {
+    cleanup_nes();
+
+    state.filesize = 16 + PRG_SIZE;
+    state.filedata = calloc(state.filesize, 1);
+    if (state.filedata == NULL) {
+        log_error("Failed to allocate lockstep image\n");
+        exit(EXIT_FAILURE);
+    }
+
+    memcpy(state.filedata, "NES\x1A", 4);
+    state.filedata[4] = PRG_SIZE / 0x4000;
+    memcpy(state.filedata + 16, prg, PRG_SIZE);
+
+    load_cartridge();
+    init_memory();
+}
+
+void randomize_machine(uint64_t *rng, uint8_t *prg) {
+    if (have_rom) {
+        memcpy(prg, rom_prg, PRG_SIZE);
+    } else {
+        random_program(rng, prg);
+    }
+    load_prg(prg);
+
+    for (int i = 0; i < 2048; i++) {
+        nes.cpu.ram[i] = next_random(rng);
+    }
+    for (uint32_t i = 0; i < PRG_RAM_SIZE; i++) {
+        cartridge.prg_ram[i] = next_random(rng);
+    }
+
+    poweron();
+    nes.cpu.a = next_random(rng);
+    nes.cpu.x = next_random(rng);
+    nes.cpu.y = next_random(rng);
+    nes.cpu.s = next_random(rng);
+    nes.cpu.p = next_random(rng);
+    set_flag(ONE, true);
+}
+
+
+// Runs that many instructions, or a block of engine->run() when instructions is 0, and returns how many ran
+uint32_t run_step(const struct engine *engine, struct step *step, uint32_t instructions) {
+    write_log.enabled = true;
+    write_log.count = 0;
+
+    step->cycles = 0;
+    if (instructions == 0) {
+        step->cycles = engine->run(1, &instructions);
+    } else {
+        for (uint32_t i = 0; i < instructions; i++) {
+            step->cycles += engine->step();
+        }
+    }
+    nes.cpu.cycles += step->cycles;
+
+    write_log.enabled = false;
+    step->write_count = write_log.count;
+    for (int i = 0; i < write_log.count && i < WRITE_LOG_SIZE; i++) {
+        step->writes[i].address = write_log.writes[i].address;
+        step->writes[i].data = write_log.writes[i].data;
+    }
+
+    save_snapshot(&step->after);
+    return instructions;
+}
+
+// Describes the first difference between the two steps, returns false when they agree
+bool describe_difference(const struct step *a, const struct step *b, char *message, size_t length) {
+    const char *names[2] = { options.engines[0]->name, options.batch > 0 ? "batch" : options.engines[1]->name };
+
+    #define REGISTER(field, format) \
+        if (a->after.field != b->after.field) { \
+            snprintf(message, length, #field " %s=" format " %s=" format, names[0], a->after.field, names[1], b->after.field); \
+            return true; \
+        }
+
+    REGISTER(nes.cpu.pc, "$%04X")
+    REGISTER(nes.cpu.a, "$%02X")
+    REGISTER(nes.cpu.x, "$%02X")
+    REGISTER(nes.cpu.y, "$%02X")
+    REGISTER(nes.cpu.s, "$%02X")
+    REGISTER(nes.cpu.p, "$%02X")
+    REGISTER(nes.controller_strobe, "%d")
+    #undef REGISTER
+
+    if (a->cycles != b->cycles) {
+        snprintf(message, length, "cycles %s=%d %s=%d", names[0], a->cycles, names[1], b->cycles);
+        return true;
+    }
+
+    if (a->write_count != b->write_count) {
+        snprintf(message, length, "write count %s=%d %s=%d", names[0], a->write_count, names[1], b->write_count);
+        return true;
+    }
+
+    for (int i = 0; i < a->write_count && i < WRITE_LOG_SIZE; i++) {
+        if (a->writes[i].address != b->writes[i].address || a->writes[i].data != b->writes[i].data) {
+            snprintf(message, length, "write %d %s=$%04X<-$%02X %s=$%04X<-$%02X", i,
+                     names[0], a->writes[i].address, a->writes[i].data, names[1], b->writes[i].address, b->writes[i].data);
+            return true;
+        }
+    }
+
+    // Catches engines that touch memory without going through cpu_write_8()
+    if (memcmp(a->after.nes.cpu.ram, b->after.nes.cpu.ram, sizeof(a->after.nes.cpu.ram)) == 0 && memcmp(a->after.prg_ram, b->after.prg_ram, sizeof(a->after.prg_ram)) == 0) {
+        return false;
+    }
+
+    for (int i = 0; i < 2048; i++) {
+        if (a->after.nes.cpu.ram[i] != b->after.nes.cpu.ram[i]) {
+            snprintf(message, length, "ram $%04X %s=$%02X %s=$%02X", i, names[0], a->after.nes.cpu.ram[i], names[1], b->after.nes.cpu.ram[i]);
+            return true;
+        }
+    }
+    for (uint32_t i = 0; i < PRG_RAM_SIZE; i++) {
+        if (a->after.prg_ram[i] != b->after.prg_ram[i]) {
+            snprintf(message, length, "prg ram $%04X %s=$%02X %s=$%02X", 0x6000 + i, names[0], a->after.prg_ram[i], names[1], b->after.prg_ram[i]);
+            return true;
+        }
+    }
+
+    return false;
+}
+
+// Loads the reproducer's machine, remapping so engines drop anything cached from the old PRG
+void restore(const struct reproducer *reproducer) {
+    memcpy(cartridge.prg_rom, reproducer->prg, PRG_SIZE);
+    map_memory();
+    load_snapshot(&reproducer->snapshot);
+}
+
+// Runs the reproducer's instruction, or block with --blocks, on both engines from scratch
+bool replay(const struct reproducer *reproducer, char *message, size_t length) {
+    struct step a, b;
+
+    restore(reproducer);
+    uint32_t instructions = run_step(options.engines[1], &b, options.blocks ? 0 : 1);
+
+    restore(reproducer);
+    run_step(options.engines[0], &a, instructions);
+
+    return describe_difference(&a, &b, message, length);
+}
+
+// Clears every byte of memory the divergence does not depend on, coarse blocks first
+void minimize(struct reproducer *reproducer) {
+    char message[LOCKSTEP_MESSAGE_LENGTH];
+
+    struct {
+        uint8_t *data;
+        uint32_t size;
+    } regions[3] = {
+        { reproducer->snapshot.nes.cpu.ram, sizeof(reproducer->snapshot.nes.cpu.ram) },
+        { reproducer->snapshot.prg_ram, sizeof(reproducer->snapshot.prg_ram) },
+        { reproducer->prg, sizeof(reproducer->prg) },
+    };
+
+    uint8_t saved[256];
+
+    for (int r = 0; r < 3; r++) {
+        for (uint32_t block = 256; block >= 1; block /= 16) {
+            for (uint32_t start = 0; start < regions[r].size; start += block) {
+                uint8_t *data = regions[r].data + start;
+
+                bool zero = true;
+                for (uint32_t i = 0; i < block; i++) {
+                    zero = zero && data[i] == 0;
+                }
+                if (zero) {
+                    continue;
+                }
+
+                memcpy(saved, data, block);
+                memset(data, 0, block);
+
+                if (!replay(reproducer, message, sizeof(message))) {
+                    memcpy(data, saved, block);
+                }
+            }
+        }
+    }
+}
+
+void write_reproducer(const struct reproducer *reproducer, const char *filename) {
+    FILE *f = fopen(filename, "wb");
+    if (f == NULL) {
+        return;
+    }
+    fwrite(reproducer, sizeof(*reproducer), 1, f);
+    fclose(f);
+}
+
+bool read_reproducer(struct reproducer *reproducer, const char *filename) {
+    FILE *f = fopen(filename, "rb");
+    if (f == NULL) {
+        return false;
+    }
+    bool ok = fread(reproducer, sizeof(*reproducer), 1, f) == 1 && memcmp(reproducer->magic, REPRODUCER_MAGIC, sizeof(REPRODUCER_MAGIC)) == 0;
+    fclose(f);
+    return ok;
+}
+
+void print_reproducer(const struct reproducer *reproducer) {
+    char message[LOCKSTEP_MESSAGE_LENGTH];
+
+    load_prg(reproducer->prg);
+    bool diverged = replay(reproducer, message, sizeof(message));
+
+    printf("seed %lu instruction %lu\n", reproducer->seed, reproducer->instruction);
+
+    // print_next_instruction() disassembles at the current PC with the registers before the step
+    restore(reproducer);
+    print_next_instruction();
+
+    printf("%s\n", diverged ? message : "engines agree");
+
+    printf("non-zero memory:");
+    for (int i = 0; i < 2048; i++) {
+        if (reproducer->snapshot.nes.cpu.ram[i] != 0) {
+            printf(" $%04X=$%02X", i, reproducer->snapshot.nes.cpu.ram[i]);
+        }
+    }
+    for (uint32_t i = 0; i < PRG_RAM_SIZE; i++) {
+        if (reproducer->snapshot.prg_ram[i] != 0) {
+            printf(" $%04X=$%02X", 0x6000 + i, reproducer->snapshot.prg_ram[i]);
+        }
+    }
+    for (uint32_t i = 0; i < PRG_SIZE; i++) {
+        if (reproducer->prg[i] != 0) {
+            printf(" $%04X=$%02X", PRG_START + i, reproducer->prg[i]);
+        }
+    }
+    printf("\n");
+}
+
+
+void run_seed(uint64_t seed, struct outcome *outcome) {
+    static uint8_t prg[0x8000];
+    static struct step a, b;
+    static struct reproducer reproducer;
+
+    uint64_t rng = seed * 0x9e3779b97f4a7c15ull + 1;
+    randomize_machine(&rng, prg);
+
+    for (uint64_t i = 0; i < options.instructions;) {
+        // Undocumented opcodes halt the core, so execution moves on to a random PRG address instead
+        while (INSTRUCTION_LOOKUP[cpu_read_8(nes.cpu.pc)] == INSTRUCTION_NONE) {
+            nes.cpu.pc = PRG_START + next_random(&rng) % PRG_SIZE;
+        }
+
+        save_snapshot(&reproducer.snapshot);
+
+        // The second engine goes first so with --blocks the reference can run as many instructions
+        uint32_t instructions = run_step(options.engines[1], &b, options.blocks ? 0 : 1);
+
+        load_snapshot(&reproducer.snapshot);
+        run_step(options.engines[0], &a, instructions);
+
+        char difference[LOCKSTEP_MESSAGE_LENGTH / 4];
+        if (describe_difference(&a, &b, difference, sizeof(difference))) {
+            memcpy(reproducer.magic, REPRODUCER_MAGIC, sizeof(REPRODUCER_MAGIC));
+            reproducer.seed = seed;
+            reproducer.instruction = i;
+            memcpy(reproducer.prg, prg, PRG_SIZE);
+
+            minimize(&reproducer);
+
+            char filename[LOCKSTEP_PATH_LENGTH + 64];
+            snprintf(filename, sizeof(filename), "%s/lockstep-%lu.bin", options.out, seed);
+            write_reproducer(&reproducer, filename);
+
+            snprintf(outcome->message, sizeof(outcome->message), "%s (reproducer %s)", difference, filename);
+            outcome->diverged = true;
+            outcome->executed = i;
+            outcome->done = true;
+            return;
+        }
+
+        i += instructions;
+        outcome->executed = i;
+    }
+
+    outcome->done = true;
+}
+
+// Runs engines[0] the way batch_run() runs a lane, up to the cycle count or an undocumented opcode
+void run_reference(uint64_t until) {
+    while (nes.cpu.cycles < until) {
+        uint8_t *page = memory_map.fetch[nes.cpu.pc >> 8];
+        if (page != NULL && INSTRUCTION_LOOKUP[page[nes.cpu.pc & 0xff]] == INSTRUCTION_NONE) {
+            break;
+        }
+        // The batch fetches opcodes from PPU registers too, and stops after the read went through
+        if (page == NULL && nes.cpu.pc >= 0x2000 && nes.cpu.pc < 0x4000 &&
+                INSTRUCTION_LOOKUP[ppu_peek_register(&nes.ppu, nes.cpu.pc)] == INSTRUCTION_NONE) {
+            cpu_read_8(nes.cpu.pc);
+            break;
+        }
+        nes.cpu.cycles += options.engines[0]->step();
+    }
+}
+
+// Runs --batch machines on one random PRG through the batch engine, and checks every
+// lane against engines[0] running that machine alone
+void run_batch_seed(uint64_t seed, struct outcome *outcome) {
+    static uint8_t prg[0x8000];
+    static struct snapshot reference[BATCH_LANES];
+    static struct step a, b;
+
+    uint64_t rng = seed * 0x9e3779b97f4a7c15ull + 1;
+    randomize_machine(&rng, prg);
+
+    // The other lanes differ from the first in a few RAM bytes and their buttons, so they
+    // run together for a while and split apart on data now and then
+    save_snapshot(&reference[0]);
+    for (int lane = 1; lane < options.batch; lane++) {
+        reference[lane] = reference[0];
+        for (int i = 0; i < 4; i++) {
+            reference[lane].nes.cpu.ram[next_random(&rng) % 2048] = next_random(&rng);
+        }
+        reference[lane].nes.controllers[0].buttons = next_random(&rng);
+        reference[lane].nes.controllers[1].buttons = next_random(&rng);
+    }
+
+    batch_init(&batch, options.batch);
+    for (int lane = 0; lane < options.batch; lane++) {
+        batch_load_lane(&batch, lane, &reference[lane]);
+    }
+
+    uint64_t until = reference[0].nes.cpu.cycles;
+    for (uint64_t i = 0; i < options.instructions;) {
+        uint64_t before = batch.instructions;
+        until += BATCH_SLICE_CYCLES;
+        batch_run(&batch, until);
+
+        for (int lane = 0; lane < options.batch; lane++) {
+            uint64_t start = reference[lane].nes.cpu.cycles;
+
+            load_snapshot(&reference[lane]);
+            run_reference(until);
+            save_snapshot(&a.after);
+            batch_save_lane(&batch, lane, &b.after);
+            a.cycles = a.after.nes.cpu.cycles - start;
+            b.cycles = b.after.nes.cpu.cycles - start;
+
+            char difference[LOCKSTEP_MESSAGE_LENGTH / 4];
+            if (describe_difference(&a, &b, difference, sizeof(difference))) {
+                snprintf(outcome->message, sizeof(outcome->message), "lane %d: %s", lane, difference);
+                outcome->diverged = true;
+                outcome->executed = i;
+                outcome->done = true;
+                return;
+            }
+            reference[lane] = a.after;
+
+            // A lane stopped at an undocumented opcode moves on to a random PRG address on both sides
+            if (batch.halted[lane]) {
+                reference[lane].nes.cpu.pc = PRG_START + next_random(&rng) % PRG_SIZE;
+                batch_load_lane(&batch, lane, &reference[lane]);
+            }
+        }
+
+        i += batch.instructions - before;
+        outcome->executed = i;
+    }
+
+    outcome->done = true;
+}
+
+void run_job(int index, void *context) {
+    if (options.batch > 0) {
+        run_batch_seed(options.first_seed + index, &outcomes[index]);
+    } else {
+        run_seed(options.first_seed + index, &outcomes[index]);
+    }
+}
+
+
+void load_rom(const char *filename) {
+    state.filedata = read_file(filename, &state.filesize);
+    if (state.filedata == NULL) {
+        fprintf(stderr, "Unable to read %s\n", filename);
+        exit(EXIT_FAILURE);
+    }
+
+    if (!load_cartridge()) {
+        exit(EXIT_FAILURE);
+    }
+    if (cartridge.mapper != 0) {
+        fprintf(stderr, "Only NROM images are supported, %s uses mapper %u\n", filename, cartridge.mapper);
+        exit(EXIT_FAILURE);
+    }
+
+    // NROM-128 is mirrored so every image runs as NROM-256
+    for (uint32_t i = 0; i < PRG_SIZE; i++) {
+        rom_prg[i] = cartridge.prg_rom[i & (cartridge.header.prg_size == 1 ? 0x3fff : 0x7fff)];
+    }
+    have_rom = true;
+
+    cleanup_nes();
+}
+
+bool parse_engines(char *list) {
+    char *comma = strchr(list, ',');
+    if (comma == NULL) {
+        return false;
+    }
+    *comma = '\0';
+
+    options.engines[0] = find_engine(list);
+    options.engines[1] = find_engine(comma + 1);
+    return options.engines[0] != NULL && options.engines[1] != NULL;
+}
+
+void usage(const char *program) {
+    fprintf(stderr, "Usage: %s [--engines A,B] [--blocks] [--seeds N] [--first-seed N] [--instructions N] [--rom FILE] [--jobs N] [--out DIR] [--verbose]\n", program);
+    fprintf(stderr, "       %s [--engines A,B] [--blocks] --replay FILE\n", program);
+    fprintf(stderr, "       %s --batch K [--engines A,B] [--seeds N] [--first-seed N] [--instructions N] [--rom FILE] [--jobs N]\n", program);
+    fprintf(stderr, "Without --engines, A is %s and B each of the other engines in turn\n", ENGINES[0].name);
+    fprintf(stderr, "--blocks compares whole blocks of B against as many instructions of A\n");
+    fprintf(stderr, "--batch runs K machines on one PRG through the batch engine and checks each lane against A\n");
+    fprintf(stderr, "Engines:");
+    for (const struct engine *engine = ENGINES; engine->name != NULL; engine++) {
+        fprintf(stderr, " %s", engine->name);
+    }
+    fprintf(stderr, "\n");
+    exit(EXIT_FAILURE);
+}
+
+// Runs every seed against engines[1], or the batch engine with --batch, prints the
+// summary and returns how many seeds failed
+int compare(int *statuses) {
+    memset(outcomes, 0, options.seeds * sizeof(struct outcome));
+    workers_run(options.seeds, options.jobs, !options.verbose, run_job, NULL, statuses);
+
+    int failures = 0;
+    uint64_t executed = 0;
+
+    for (int i = 0; i < options.seeds; i++) {
+        const struct outcome *outcome = &outcomes[i];
+        executed += outcome->executed;
+
+        if (!outcome->done) {
+            printf("CRASH    seed %lu after %lu instructions (exit status %d)\n", options.first_seed + i, outcome->executed,
+                   WIFEXITED(statuses[i]) ? WEXITSTATUS(statuses[i]) : -1);
+            failures++;
+        } else if (outcome->diverged) {
+            printf("DIVERGED seed %lu at instruction %lu: %s\n", options.first_seed + i, outcome->executed, outcome->message);
+            failures++;
+        } else if (options.verbose) {
+            printf("OK       seed %lu, %lu instructions\n", options.first_seed + i, outcome->executed);
+        }
+    }
+
+    printf("%s vs %s: %d/%d seeds agree over %lu instructions\n", options.engines[0]->name, options.batch > 0 ? "batch" : options.engines[1]->name,
+           options.seeds - failures, options.seeds, executed);
+
+    return failures;
+}
+
+int main(int argc, char **argv) {
+    atexit(cleanup_nes);
+    state.quiet = true;
+
+    const char *replay_file = NULL;
+
+    // Without --engines the reference is compared with every other engine in turn, or
+    // with the first of them for --replay
+    options.engines[0] = &ENGINES[0];
+    options.engines[1] = &ENGINES[1];
+    bool every_engine = true;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--engines") == 0 && i + 1 < argc) {
+            if (!parse_engines(argv[++i])) {
+                usage(argv[0]);
+            }
+            every_engine = false;
+        } else if (strcmp(argv[i], "--seeds") == 0 && i + 1 < argc) {
+            options.seeds = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--first-seed") == 0 && i + 1 < argc) {
+            options.first_seed = strtoull(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--instructions") == 0 && i + 1 < argc) {
+            options.instructions = strtoull(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--rom") == 0 && i + 1 < argc) {
+            options.rom = argv[++i];
+        } else if (strcmp(argv[i], "--jobs") == 0 && i + 1 < argc) {
+            options.jobs = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--out") == 0 && i + 1 < argc) {
+            options.out = argv[++i];
+        } else if (strcmp(argv[i], "--replay") == 0 && i + 1 < argc) {
+            replay_file = argv[++i];
+        } else if (strcmp(argv[i], "--batch") == 0 && i + 1 < argc) {
+            options.batch = atoi(argv[++i]);
+            if (options.batch < 2 || options.batch > BATCH_LANES) {
+                usage(argv[0]);
+            }
+        } else if (strcmp(argv[i], "--blocks") == 0) {
+            options.blocks = true;
+        } else if (strcmp(argv[i], "--verbose") == 0) {
+            options.verbose = true;
+        } else {
+            usage(argv[0]);
+        }
+    }
+
+    if (options.batch > 0 && (options.blocks || replay_file != NULL)) {
+        usage(argv[0]);
+    }
+
+    if (options.blocks && options.engines[1]->run == NULL) {
+        fprintf(stderr, "Engine %s does not run blocks\n", options.engines[1]->name);
+        exit(EXIT_FAILURE);
+    }
+
+    if (replay_file != NULL) {
+        static struct reproducer reproducer;
+        if (!read_reproducer(&reproducer, replay_file)) {
+            fprintf(stderr, "Unable to read reproducer %s\n", replay_file);
+            exit(EXIT_FAILURE);
+        }
+        print_reproducer(&reproducer);
+        return EXIT_SUCCESS;
+    }
+
+    if (options.seeds <= 0) {
+        usage(argv[0]);
+    }
+
+    if (options.rom != NULL) {
+        load_rom(options.rom);
+    }
+
+    outcomes = workers_shared(options.seeds * sizeof(struct outcome));
+    int *statuses = calloc(options.seeds + 1, sizeof(int));
+    int failures = 0;
+
+    if (every_engine && options.batch == 0) {
+        for (const struct engine *engine = &ENGINES[1]; engine->name != NULL; engine++) {
+            if (options.blocks && engine->run == NULL) {
+                continue;
+            }
+
+            options.engines[1] = engine;
+            failures += compare(statuses);
+        }
+    } else {
+        failures = compare(statuses);
+    }
+
+    free(statuses);
+
+    return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
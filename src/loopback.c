@@ -0,0 +1,212 @@
+#define _DEFAULT_SOURCE
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include "nes.h"
+#include "engine.h"
+#include "netplay.h"
+#include "statehash.h"
+#include "workers.h"
+
+
+// After its last frame a peer keeps answering this long, for a peer still missing input
+#define LINGER_MS 2000
+
+// Scripted buttons are held for this many frames, long enough for prediction to pay off
+#define HOLD_FRAMES 6
+
+
+// Lives in shared memory so the forked peers can report back
+struct peer {
+    bool done;
+    uint64_t hash;
+    struct netplay stats;
+};
+
+struct {
+    const char *rom;
+    uint64_t frames;
+    int latency_ms;
+    int jitter_ms;
+    double loss;
+    int max_rollback;
+    int input_delay;
+    int fps;
+    int port;
+    uint64_t seed;
+    bool verbose;
+} options = { .frames = 600, .latency_ms = 50, .jitter_ms = 10, .loss = 0.05, .fps = 60, .port = 47100, .seed = 1 };
+
+struct peer *peers = NULL;
+
+struct snapshot start;
+
+
+uint64_t now_ns() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000ull + now.tv_nsec;
+}
+
+void sleep_until(uint64_t deadline) {
+    uint64_t now = now_ns();
+    if (deadline > now) {
+        usleep((deadline - now) / 1000);
+    }
+}
+
+// What a player presses when frame comes up on their side, a pure function so the reference can replay it
+uint8_t scripted_buttons(int player, uint64_t frame) {
+    uint64_t x = options.seed * 0x9e3779b97f4a7c15ull ^ (uint64_t)(player + 1) << 56 ^ frame / HOLD_FRAMES;
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdull;
+    x ^= x >> 33;
+    return x;
+}
+
+// Input sampled at frame f is used at frame f + input_delay
+uint8_t applied_buttons(int player, uint64_t frame) {
+    return frame < (uint64_t)options.input_delay ? 0 : scripted_buttons(player, frame - options.input_delay);
+}
+
+
+// The same inputs run without a network, which both peers must end up agreeing with
+uint64_t run_reference() {
+    load_snapshot(&start);
+
+    for (uint64_t frame = 0; frame < options.frames; frame++) {
+        set_buttons(0, applied_buttons(0, frame));
+        set_buttons(1, applied_buttons(1, frame));
+        run_frame();
+    }
+
+    return state_hash_update();
+}
+
+void run_peer(int player, void *context) {
+    struct peer *peer = &peers[player];
+    load_snapshot(&start);
+
+    struct netplay_config config = {
+        .player = player,
+        .local_port = options.port + player,
+        .remote_host = "127.0.0.1",
+        .remote_port = options.port + 1 - player,
+        .max_rollback = options.max_rollback,
+        .input_delay = options.input_delay,
+        .latency_ms = options.latency_ms,
+        .jitter_ms = options.jitter_ms,
+        .loss = options.loss,
+        .seed = options.seed * 2 + player + 1,
+    };
+
+    if (!netplay_open(&config)) {
+        return;
+    }
+
+    // Paced like a host running at fps, giving up well after the peer should have finished
+    uint64_t period = 1000000000ull / options.fps;
+    uint64_t next = now_ns();
+    uint64_t deadline = next + options.frames * period * 4 + 10000000000ull;
+
+    while (netplay.frame < options.frames && now_ns() < deadline) {
+        sleep_until(next);
+        next += period;
+        netplay_frame(scripted_buttons(player, netplay.frame));
+    }
+
+    uint64_t linger_end = now_ns() + LINGER_MS * 1000000ull;
+    while (netplay_confirmed() < options.frames || netplay.acknowledged < options.frames) {
+        if (now_ns() >= (netplay_confirmed() < options.frames ? deadline : linger_end)) break;
+
+        sleep_until(next);
+        next += period;
+        netplay_poll();
+    }
+
+    peer->done = netplay_confirmed() >= options.frames;
+    peer->hash = state_hash_update();
+    peer->stats = netplay;
+    netplay_close();
+}
+
+
+int main(int argc, char **argv) {
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--frames") == 0 && i + 1 < argc) {
+            options.frames = strtoull(argv[++i], NULL, 0);
+        } else if (strcmp(argv[i], "--latency") == 0 && i + 1 < argc) {
+            options.latency_ms = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--jitter") == 0 && i + 1 < argc) {
+            options.jitter_ms = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--loss") == 0 && i + 1 < argc) {
+            options.loss = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--rollback") == 0 && i + 1 < argc) {
+            options.max_rollback = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--delay") == 0 && i + 1 < argc) {
+            options.input_delay = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--fps") == 0 && i + 1 < argc) {
+            options.fps = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--port") == 0 && i + 1 < argc) {
+            options.port = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+            options.seed = strtoull(argv[++i], NULL, 0);
+        } else if (strcmp(argv[i], "--engine") == 0 && i + 1 < argc && find_engine(argv[i + 1]) != NULL) {
+            current_engine = find_engine(argv[++i]);
+        } else if (strcmp(argv[i], "--verbose") == 0) {
+            options.verbose = true;
+        } else if (options.rom == NULL && argv[i][0] != '-') {
+            options.rom = argv[i];
+        } else {
+            options.rom = NULL;
+            break;
+        }
+    }
+
+    if (options.rom == NULL || options.fps <= 0) {
+        fprintf(stderr, "Usage: %s [--frames N] [--latency MS] [--jitter MS] [--loss P] [--rollback N] [--delay N] [--fps N] [--port N] [--seed N] [--engine NAME] [--verbose] ROM\n", argv[0]);
+        fprintf(stderr, "Runs two netplay peers over the loopback interface and checks both against a run without the network\n");
+        exit(EXIT_FAILURE);
+    }
+
+    state.filedata = read_file(options.rom, &state.filesize);
+    if (state.filedata == NULL || !load_cartridge()) {
+        fprintf(stderr, "Unable to load %s\n", options.rom);
+        exit(EXIT_FAILURE);
+    }
+
+    init_memory();
+    poweron();
+    save_snapshot(&start);
+    state_hash_open();
+
+    uint64_t reference = run_reference();
+    printf("reference: %lu frames, state %016lx\n", options.frames, reference);
+
+    peers = workers_shared(2 * sizeof(struct peer));
+    int statuses[2] = { 0 };
+    workers_run(2, 2, !options.verbose, run_peer, NULL, statuses);
+
+    int failures = 0;
+    for (int player = 0; player < 2; player++) {
+        const struct peer *peer = &peers[player];
+        const struct netplay *stats = &peer->stats;
+        bool matches = peer->done && peer->hash == reference && stats->desyncs == 0;
+
+        printf("player %d: %s, state %016lx, %lu rollbacks, %lu frames resimulated, deepest %lu, %lu stalls, "
+                "%lu packets sent, %lu received, %lu dropped, %lu desyncs\n",
+                player, !peer->done ? "INCOMPLETE" : matches ? "PASS" : "FAIL", peer->hash,
+                stats->rollbacks, stats->resimulated, stats->deepest_rollback, stats->stalls,
+                stats->sent, stats->received, stats->dropped, stats->desyncs);
+
+        failures += !matches;
+    }
+
+    return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
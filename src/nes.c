@@ -0,0 +1,1533 @@
+#include <assert.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "nes.h"
+#include "profile.h"
+#include "sampler.h"
+#include "debugger.h"
+#include "engine.h"
+#include "statehash.h"
+#include "battery.h"
+#include "journal.h"
+
+
+const uint16_t NMI_VECTOR = 0xfffa;
+const uint16_t RESET_VECTOR = 0xfffc;
+const uint16_t IRQ_VECTOR = 0xfffe;
+
+const uint32_t SCREEN_WIDTH = PPU_WIDTH;
+const uint32_t SCREEN_HEIGHT = PPU_HEIGHT;
+
+const uint32_t SCANLINE_WIDTH = 341;
+const uint32_t SCANLINE_HEIGHT = 262;
+
+// 341 dots * 262 scanlines / 3 dots per CPU cycle, rounded up
+const uint32_t CPU_CYCLES_PER_FRAME = 29781;
+
+// 341 dots * 20 scanlines of vertical blank / 3 dots per CPU cycle
+const uint32_t CPU_CYCLES_PER_VBLANK = 2273;
+
+const uint32_t PRG_RAM_SIZE = 0x2000;
+
+// 2C02 NTSC palette as RGB
+const uint8_t PALETTE[64][3] = {
+    { 0x62, 0x62, 0x62 }, { 0x00, 0x1f, 0xb2 }, { 0x24, 0x04, 0xc8 }, { 0x52, 0x00, 0xb2 },
+    { 0x73, 0x00, 0x76 }, { 0x80, 0x00, 0x24 }, { 0x73, 0x0b, 0x00 }, { 0x52, 0x28, 0x00 },
+    { 0x24, 0x44, 0x00 }, { 0x00, 0x57, 0x00 }, { 0x00, 0x5c, 0x00 }, { 0x00, 0x53, 0x24 },
+    { 0x00, 0x3c, 0x76 }, { 0x00, 0x00, 0x00 }, { 0x00, 0x00, 0x00 }, { 0x00, 0x00, 0x00 },
+    { 0xab, 0xab, 0xab }, { 0x0d, 0x57, 0xff }, { 0x4b, 0x30, 0xff }, { 0x8a, 0x13, 0xff },
+    { 0xbc, 0x08, 0xd6 }, { 0xd2, 0x12, 0x69 }, { 0xc7, 0x2e, 0x00 }, { 0x9d, 0x54, 0x00 },
+    { 0x60, 0x7b, 0x00 }, { 0x20, 0x98, 0x00 }, { 0x00, 0xa3, 0x00 }, { 0x00, 0x99, 0x42 },
+    { 0x00, 0x7d, 0xb4 }, { 0x00, 0x00, 0x00 }, { 0x00, 0x00, 0x00 }, { 0x00, 0x00, 0x00 },
+    { 0xff, 0xff, 0xff }, { 0x53, 0xae, 0xff }, { 0x90, 0x85, 0xff }, { 0xd3, 0x65, 0xff },
+    { 0xff, 0x57, 0xff }, { 0xff, 0x5d, 0xcf }, { 0xff, 0x77, 0x57 }, { 0xfa, 0x9e, 0x00 },
+    { 0xbd, 0xc7, 0x00 }, { 0x7a, 0xe7, 0x00 }, { 0x43, 0xf6, 0x11 }, { 0x26, 0xef, 0x7e },
+    { 0x2c, 0xd5, 0xf6 }, { 0x4e, 0x4e, 0x4e }, { 0x00, 0x00, 0x00 }, { 0x00, 0x00, 0x00 },
+    { 0xff, 0xff, 0xff }, { 0xb6, 0xe1, 0xff }, { 0xce, 0xd1, 0xff }, { 0xe9, 0xc3, 0xff },
+    { 0xff, 0xbc, 0xff }, { 0xff, 0xbd, 0xf4 }, { 0xff, 0xc6, 0xc3 }, { 0xff, 0xd5, 0x9a },
+    { 0xe9, 0xe6, 0x81 }, { 0xce, 0xf4, 0x81 }, { 0xb6, 0xfb, 0x9a }, { 0xa9, 0xfa, 0xc3 },
+    { 0xa9, 0xf0, 0xf4 }, { 0xb8, 0xb8, 0xb8 }, { 0x00, 0x00, 0x00 }, { 0x00, 0x00, 0x00 },
+};
+
+
+struct cartridge cartridge = { 0 };
+
+struct nes nes __attribute__((aligned(64))) = { 0 };
+
+struct state state = { 0 };
+
+struct write_log write_log = { 0 };
+struct dirty_pages dirty_pages = { 0 };
+
+struct memory_map memory_map __attribute__((aligned(64))) = { 0 };
+
+
+uint8_t *read_file(const char *filename, size_t *length) {
+    FILE *f = fopen(filename, "rb");
+    if (f == NULL) return NULL;
+
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    rewind(f);
+
+    uint8_t *buffer = size > 0 ? malloc(size) : NULL;
+    if (buffer == NULL || fread(buffer, size, 1, f) != 1) {
+        free(buffer);
+        fclose(f);
+        return NULL;
+    }
+
+    fclose(f);
+    *length = size;
+    return buffer;
+}
+
+// Checks the header against state.filesize before any pointer into the image is formed
+bool load_cartridge() {
+    if (state.filesize < 16) {
+        logf_error("File too small for an iNES header: %zu bytes\n", state.filesize);
+        return false;
+    }
+
+    if (strncmp((char *)state.filedata, "NES\x1A", 4) != 0) {
+        logf_error("Invalid file magic: 0x%02X 0x%02X 0x%02X 0x%02X\n", state.filedata[0], state.filedata[1], state.filedata[2], state.filedata[3]);
+        return false;
+    }
+
+    if ((state.filedata[7] & 0x0c) == 0x08) {
+        log_error("iNES 2.0 is not supported.\n");
+        return false;
+    }
+
+    memcpy(cartridge.header.nes, state.filedata, 4);
+    cartridge.header.prg_size = state.filedata[4];
+    cartridge.header.chr_size = state.filedata[5];
+    cartridge.header.flags_6 = state.filedata[6];
+    cartridge.header.flags_7 = state.filedata[7];
+    memcpy(cartridge.header.padding, state.filedata + 8, 8);
+
+    bool trainer = cartridge.header.flags_6 & (1 << 3);
+    cartridge.battery = cartridge.header.flags_6 & (1 << 1);
+
+    // The CPU always sees 32KiB at $8000, NROM-128 is mirrored so a single bank is the minimum
+    size_t prg_length = cartridge.header.prg_size * 0x4000;
+    size_t chr_length = cartridge.header.chr_size * 0x2000;
+    size_t expected = 16 + (trainer ? 512 : 0) + prg_length + chr_length;
+
+    if (cartridge.header.prg_size == 0) {
+        log_error("Cartridge has no PRG ROM\n");
+        return false;
+    }
+
+    if (expected > state.filesize) {
+        logf_error("Header expects %zu bytes but the file has %zu\n", expected, state.filesize);
+        return false;
+    }
+
+    cartridge.prg_rom = state.filedata + 16 + (trainer ? 512 : 0);
+    cartridge.chr_rom = cartridge.prg_rom + prg_length;
+
+    cartridge.mapper = (cartridge.header.flags_7 & 0xf0) | (cartridge.header.flags_6 >> 4);
+
+    return true;
+}
+
+void print_header() {
+    printf("Magic: ");
+    for (int i = 0; i < 3; i++) {
+        printf("%c", cartridge.header.nes[i]);
+    }
+    printf(" 0x%02X\n", cartridge.header.nes[3]);
+
+    printf("PRG ROM size: %u * 16KiB\n", cartridge.header.prg_size);
+    printf("CHR ROM size: %u *  8KiB\n", cartridge.header.chr_size);
+
+    printf("Flags (6): 0x%02X\n", cartridge.header.flags_6);
+    printf("Flags (7): 0x%02X\n", cartridge.header.flags_7);
+
+    printf("Mapper: 0x%02X\n", cartridge.mapper);
+}
+
+
+void init_memory() {
+    memset(nes.cpu.ram, 0, sizeof(nes.cpu.ram));
+    for (int tracker = 0; tracker < DIRTY_TRACKERS; tracker++) {
+        dirty_pages.pending[tracker] = ALL_DIRTY_PAGES;
+    }
+
+    state.prg_ram = calloc(PRG_RAM_SIZE, 1);
+    assert(state.prg_ram != NULL);
+    cartridge.prg_ram = state.prg_ram;
+
+    state.framebuffer = calloc(SCREEN_WIDTH * SCREEN_HEIGHT, 1);
+    assert(state.framebuffer != NULL);
+    nes.ppu.framebuffer = state.framebuffer;
+    ppu_invalidate();
+
+    map_memory();
+}
+
+uint8_t *dirty_page_memory(int index) {
+    if (index >= PPU_DIRTY_PAGE) {
+        return nes.ppu.nametables + ((index - PPU_DIRTY_PAGE) << 8);
+    }
+    return index < 8 ? nes.cpu.ram + (index << 8) : cartridge.prg_ram + ((index - 8) << 8);
+}
+
+// Work RAM pages are set in every mirror, PPU pages have no entry
+static void set_dirty_page_entry(int index, uint8_t *entry) {
+    if (index < 8) {
+        for (int mirror = index; mirror < 0x20; mirror += 0x08) {
+            memory_map.write[mirror] = entry;
+        }
+    } else if (index < PPU_DIRTY_PAGE) {
+        memory_map.write[0x60 + index - 8] = entry;
+    }
+}
+
+static void protect_clean_pages() {
+    for (int index = 0; index < DIRTY_PAGES; index++) {
+        if (!(dirty_pages.dirty & 1ull << index)) {
+            set_dirty_page_entry(index, NULL);
+        }
+    }
+}
+
+// Maps the page again unless the debugger wants to see every write anyway
+static void mark_dirty_page(int index) {
+    if (dirty_pages.dirty & 1ull << index) return;
+
+    dirty_pages.dirty |= 1ull << index;
+    if (!debugger.armed && !debugger.watching) {
+        set_dirty_page_entry(index, dirty_page_memory(index));
+    }
+}
+
+static void mark_page_written(uint16_t address) {
+    mark_dirty_page(address < 0x2000 ? (address >> 8) & 0x07 : 8 + ((address - 0x6000) >> 8));
+}
+
+// Points every page backed by plain memory at it, everything else takes the slow path
+void map_memory() {
+    uint32_t generation = memory_map.generation + 1;
+    memset(&memory_map, 0, sizeof(memory_map));
+    memory_map.generation = generation;
+
+    for (int page = 0x00; page < 0x20; page++) {
+        memory_map.read[page] = nes.cpu.ram + ((page & 0x07) << 8);
+        memory_map.write[page] = memory_map.read[page];
+    }
+
+    for (int page = 0x60; page < 0x80; page++) {
+        memory_map.read[page] = cartridge.prg_ram + ((page - 0x60) << 8);
+        memory_map.write[page] = memory_map.read[page];
+    }
+
+    for (int page = 0x80; page < 0x100; page++) {
+        memory_map.read[page] = cartridge.prg_rom + (((page - 0x80) << 8) & (cartridge.header.prg_size == 1 ? 0x3fff : 0x7fff));
+    }
+
+    memcpy(memory_map.fetch, memory_map.read, sizeof(memory_map.fetch));
+
+    if (dirty_pages.trackers != 0) {
+        protect_clean_pages();
+    }
+
+    if (debugger.armed || debugger.watching) {
+        debugger_mask_pages();
+    }
+}
+
+// For code that copies into pages behind the trackers' backs
+void mark_pages_written(uint64_t pages) {
+    if (dirty_pages.trackers == 0) return;
+
+    for (int index = 0; index < DIRTY_PAGES; index++) {
+        if (pages & 1ull << index) {
+            mark_dirty_page(index);
+        }
+    }
+}
+
+void mark_ppu_written(const uint8_t *memory) {
+    if (dirty_pages.trackers != 0) {
+        mark_dirty_page(PPU_DIRTY_PAGE + (memory - nes.ppu.nametables) / 256);
+    }
+}
+
+void track_dirty_pages(enum dirty_tracker tracker, bool enabled) {
+    bool was_tracking = dirty_pages.trackers != 0;
+
+    if (enabled) {
+        dirty_pages.trackers |= 1u << tracker;
+        dirty_pages.pending[tracker] = ALL_DIRTY_PAGES;
+    } else {
+        dirty_pages.trackers &= ~(1u << tracker);
+        dirty_pages.pending[tracker] = 0;
+    }
+
+    if (was_tracking != (dirty_pages.trackers != 0)) {
+        dirty_pages.dirty = 0;
+        map_memory();
+    }
+}
+
+uint64_t peek_dirty_pages(enum dirty_tracker tracker) {
+    return dirty_pages.pending[tracker] | dirty_pages.dirty;
+}
+
+// Hands the pages written since the last protection to the other trackers, then protects
+// them again. Clean pages are still unmapped, and engines read write entries at run time,
+// so this needs no new map generation.
+uint64_t take_dirty_pages(enum dirty_tracker tracker) {
+    uint64_t written = dirty_pages.dirty;
+    uint64_t taken = dirty_pages.pending[tracker] | written;
+
+    for (int other = 0; other < DIRTY_TRACKERS; other++) {
+        if (dirty_pages.trackers & 1u << other) {
+            dirty_pages.pending[other] |= written;
+        }
+    }
+    dirty_pages.pending[tracker] = 0;
+
+    for (int index = 0; index < DIRTY_PAGES; index++) {
+        if (written & 1ull << index) {
+            set_dirty_page_entry(index, NULL);
+        }
+    }
+    dirty_pages.dirty = 0;
+
+    return taken;
+}
+
+void cleanup_nes() {
+    journal_close();
+    battery_close();
+
+    if (state.filedata != NULL) {
+        free(state.filedata);
+        state.filedata = NULL;
+    }
+
+    if (state.prg_ram != NULL) {
+        free(state.prg_ram);
+        state.prg_ram = NULL;
+    }
+
+    if (state.framebuffer != NULL) {
+        free(state.framebuffer);
+        state.framebuffer = NULL;
+    }
+}
+
+
+// Taken between instructions, pushed in the order _rti() pulls
+void perform_nmi() {
+    stack_push_16(nes.cpu.pc);
+    stack_push_8(nes.cpu.p & ~(1 << BREAK));
+    set_flag(INTERRUPT, true);
+    nes.cpu.pc = cpu_read_16(NMI_VECTOR);
+    sampler_call(nes.cpu.pc);
+}
+
+// Frames end as vertical blank starts, the picture is drawn and the NMI taken at once
+void start_vblank() {
+    bool timed = nes.ppu.framebuffer != NULL && state.render_begin != NULL;
+    if (timed) {
+        state.render_begin();
+    }
+    ppu_render();
+    if (timed) {
+        state.render_end();
+    }
+
+    if (ppu_start_vblank(&nes.ppu)) {
+        perform_nmi();
+        nes.cpu.cycles += 7;
+    }
+}
+
+// The pre-render line clears the vertical blank flag, whether or not PPUSTATUS was read
+void end_vblank() {
+    ppu_end_vblank(&nes.ppu);
+}
+
+
+void set_buttons(int port, uint8_t buttons) {
+    journal_buttons(port, buttons);
+    nes.controllers[port].buttons = buttons;
+
+    if (nes.controller_strobe) {
+        nes.controllers[port].shift = buttons;
+    }
+}
+
+uint8_t read_controller(int port) {
+    if (nes.controller_strobe) {
+        return nes.controllers[port].buttons & 1;
+    }
+
+    // Official controllers return 1 once all eight buttons have been shifted out
+    uint8_t data = nes.controllers[port].shift & 1;
+    nes.controllers[port].shift = (nes.controllers[port].shift >> 1) | 0x80;
+    return data;
+}
+
+
+uint8_t cpu_read_8(uint16_t address) {
+    uint8_t *page = memory_map.read[address >> 8];
+    if (page != NULL) {
+        return page[address & 0xff];
+    }
+
+    if (debugger.watching) {
+        debugger_access(address, WATCH_READ);
+    }
+
+    if (address < 0x2000) {
+        return nes.cpu.ram[address & 0x07ff];
+    } else if (address >= 0x8000) {
+        return cartridge.prg_rom[(address - 0x8000) & (cartridge.header.prg_size == 1 ? 0x3fff : 0xffff)];
+    } else if (address >= 0x6000) {
+        return cartridge.prg_ram[address - 0x6000];
+    } else if (address < 0x4000) {
+        if (debugger.watching && (address & 7) == 7) {
+            debugger_ppu_access(ppu_data_address(&nes.ppu), WATCH_READ);
+        }
+        return ppu_read_register(&nes.ppu, address);
+    } else if (address == 0x4016 || address == 0x4017) {
+        return 0x40 | read_controller(address - 0x4016);
+    }
+
+    logf_warning("Read from unmapped address: 0x%04X\n", address);
+    return 0;
+}
+
+uint16_t cpu_read_16(uint16_t address) {
+    return cpu_read_8(address) | (cpu_read_8(address + 1) << 8);
+}
+
+void cpu_write_8(uint16_t address, uint8_t data) {
+    if (write_log.enabled) {
+        if (write_log.count < WRITE_LOG_SIZE) {
+            write_log.writes[write_log.count].address = address;
+            write_log.writes[write_log.count].data = data;
+        }
+        write_log.count++;
+    }
+
+    uint8_t *page = memory_map.write[address >> 8];
+    if (page != NULL) {
+        page[address & 0xff] = data;
+        return;
+    }
+
+    if (debugger.watching) {
+        debugger_access(address, WATCH_WRITE);
+    }
+
+    if (address < 0x2000) {
+        if (dirty_pages.trackers != 0) mark_page_written(address);
+        nes.cpu.ram[address & 0x07ff] = data;
+    } else if (address >= 0x8000) {
+        // NROM has no registers, writes to ROM are dropped
+    } else if (address >= 0x6000) {
+        if (dirty_pages.trackers != 0) mark_page_written(address);
+        cartridge.prg_ram[address - 0x6000] = data;
+    } else if (address < 0x4000) {
+        if (debugger.watching && (address & 7) == 7) {
+            debugger_ppu_access(ppu_data_address(&nes.ppu), WATCH_WRITE);
+        }
+        ppu_write_register(&nes.ppu, address, data);
+    } else if (address == 0x4014) {
+        // OAM DMA, without the CPU stall
+        for (int i = 0; i < 256; i++) {
+            nes.ppu.oam[(nes.ppu.oam_address + i) & 0xff] = cpu_read_8(data << 8 | i);
+        }
+        mark_ppu_written(nes.ppu.oam);
+    } else if (address == 0x4016) {
+        nes.controller_strobe = data & 1;
+        if (nes.controller_strobe) {
+            nes.controllers[0].shift = nes.controllers[0].buttons;
+            nes.controllers[1].shift = nes.controllers[1].buttons;
+        }
+    } else {
+        logf_warning("Write to unmapped address: $%04X with data: #$%02X\n", address, data);
+    }
+}
+
+void cpu_write_16(uint16_t address, uint16_t data) {
+    cpu_write_8(address, data >> 8);
+    cpu_write_8(address + 1, data & 0xff);
+}
+
+void set_flag(enum flag f, bool set) {
+    if (set) {
+        nes.cpu.p |= 1 << f;
+    } else {
+        nes.cpu.p &= ~(1 << f);
+    }
+}
+
+uint8_t get_flag(enum flag f) {
+    if (nes.cpu.p & (1 << f)) {
+        return 1;
+    } else {
+        return 0;
+    }
+}
+
+void stack_push_8(uint8_t data) {
+    if (dirty_pages.trackers != 0) mark_page_written(0x0100);
+    nes.cpu.ram[0x0100 + nes.cpu.s--] = data;
+}
+
+void stack_push_16(uint16_t data) {
+    stack_push_8(data >> 8);
+    stack_push_8(data & 0xff);
+}
+
+uint8_t stack_pop_8() {
+    return nes.cpu.ram[0x0100 + ++nes.cpu.s];
+}
+
+uint16_t stack_pop_16() {
+    return stack_pop_8() | (stack_pop_8() << 8);
+}
+
+
+uint16_t instruction_length(enum address_mode mode) {
+    switch (mode) {
+        case IMPLICIT:
+        case ACCUMULATOR:
+            return 1;
+        case IMMEDIATE:
+        case RELATIVE:
+        case ZERO_PAGE:
+        case ZERO_PAGE_X:
+        case ZERO_PAGE_Y:
+        case INDEXED_INDIRECT:
+        case INDIRECT_INDEXED:
+            return 2;
+        case INDIRECT:
+        case ABSOLUTE:
+        case ABSOLUTE_X:
+        case ABSOLUTE_Y:
+            return 3;
+        default:
+            logf_error("Unable to find length of instruction with unknown addressing mode with id: %u\n", mode);
+            log_error("Halting execution\n");
+            exit(EXIT_FAILURE);
+    }
+}
+
+uint16_t read_operand(enum address_mode mode) {
+    uint8_t operand_8 = cpu_read_8(nes.cpu.pc + 1);
+    uint16_t operand_16 = cpu_read_16(nes.cpu.pc + 1);
+
+    switch (mode) {
+        case IMPLICIT:
+        case ACCUMULATOR:
+            return 0;
+        case IMMEDIATE:
+        case RELATIVE:
+            return nes.cpu.pc + 1;
+        case ZERO_PAGE:
+            return operand_8;
+        case ABSOLUTE:
+            return operand_16;
+        case INDIRECT:
+            return cpu_read_8(operand_16) + 256 * cpu_read_8((operand_16 & 0xff00) | (((operand_16 & 0xff) + 1) % 256));
+        case ZERO_PAGE_X:
+            return (operand_8 + nes.cpu.x) % 256;
+        case ZERO_PAGE_Y:
+            return (operand_8 + nes.cpu.y) % 256;
+        case ABSOLUTE_X:
+            return operand_16 + nes.cpu.x;
+        case ABSOLUTE_Y:
+            return operand_16 + nes.cpu.y;
+        case INDEXED_INDIRECT:
+            return cpu_read_8((operand_8 + nes.cpu.x) % 256) + 256 * cpu_read_8((operand_8 + nes.cpu.x + 1) % 256);
+        case INDIRECT_INDEXED:
+            return cpu_read_8(operand_8) + 256 * cpu_read_8((operand_8 + 1) % 256) + nes.cpu.y;
+        default:
+            logf_error("Unknown addressing mode with id: %u\n", mode);
+            log_error("Halting execution\n");
+            exit(EXIT_FAILURE);
+    }
+}
+
+bool page_cross(enum address_mode mode) {
+    switch (mode) {
+        case ABSOLUTE_X:
+            return (cpu_read_16(nes.cpu.pc + 1) & 0xff) + nes.cpu.x > 0xff;
+        case ABSOLUTE_Y:
+            return (cpu_read_16(nes.cpu.pc + 1) & 0xff) + nes.cpu.y > 0xff;
+        case INDIRECT_INDEXED:
+            return ((cpu_read_16(cpu_read_8(nes.cpu.pc + 1)) & 0xff) + nes.cpu.y) > 0xff;
+        default:
+            return 0;
+    }
+}
+
+// The value shown for an operand, a PPU register must not change because it was traced
+static uint8_t trace_read_8(uint16_t address) {
+    if (address >= 0x2000 && address < 0x4000 && memory_map.read[address >> 8] == NULL) {
+        return ppu_peek_register(&nes.ppu, address);
+    }
+    return cpu_read_8(address);
+}
+
+void print_next_instruction() {
+    uint8_t opcode = cpu_read_8(nes.cpu.pc);
+
+    enum instruction_name name = INSTRUCTION_LOOKUP[opcode];
+    enum address_mode mode = ADDRESS_MODE_LOOKUP[opcode];
+
+    uint16_t address = read_operand(mode);
+
+    printf("%04X ", nes.cpu.pc);
+    int indent = 5;
+    for (int i = 0; i < instruction_length(mode); i++) {
+        printf(" %02X", cpu_read_8(nes.cpu.pc + i));
+        indent += 3;
+    }
+    printf("%*c", 16 - indent, ' ');
+    indent = 16;
+    printf("%s ", INSTRUCTION_NAME_STRING[name]);
+
+    indent = 0;
+    switch (mode) {
+        case IMMEDIATE:
+            printf("#$%02X%n", cpu_read_8(address), &indent);
+            break;
+        case ACCUMULATOR:
+            printf("A");
+            indent = 1;
+            break;
+        case RELATIVE:
+            printf("$%04X%n", nes.cpu.pc + cpu_read_8(address) + 2, &indent);
+            break;
+        case ZERO_PAGE:
+            printf("$%02X%n", address, &indent);
+            break;
+        case ABSOLUTE:
+            printf("$%04X%n", address, &indent);
+            break;
+        case INDIRECT:
+            printf("($%04X) = %04X%n", cpu_read_16(nes.cpu.pc + 1), address, &indent);
+            break;
+        case ZERO_PAGE_X:
+            printf("$%02X,X @ %02X%n", cpu_read_8(nes.cpu.pc + 1), address, &indent);
+            break;
+        case ZERO_PAGE_Y:
+            printf("$%02X,Y @ %02X%n", cpu_read_8(nes.cpu.pc + 1), address, &indent);
+            break;
+        case ABSOLUTE_X:
+            printf("$%04X,X @ %04X%n", cpu_read_16(nes.cpu.pc + 1), address, &indent);
+            break;
+        case ABSOLUTE_Y:
+            printf("$%04X,Y @ %04X%n", cpu_read_16(nes.cpu.pc + 1), address, &indent);
+            break;
+        case INDEXED_INDIRECT:
+            printf("($%02X,X) @ %02X = %04X%n", cpu_read_8(nes.cpu.pc + 1), (uint8_t)(cpu_read_8(nes.cpu.pc + 1) + nes.cpu.x), address, &indent);
+            break;
+        case INDIRECT_INDEXED:
+            printf("($%02X),Y = %04X @ %04X%n", cpu_read_8(nes.cpu.pc + 1), cpu_read_8(cpu_read_8(nes.cpu.pc + 1)) + 256 * cpu_read_8((cpu_read_8(nes.cpu.pc + 1) + 1) % 256), address, &indent);
+            break;
+
+        case IMPLICIT:
+        default:
+            break;
+    }
+
+    if (mode != IMMEDIATE && mode != ACCUMULATOR) {
+        int store_add = 0;
+        if (name == STA || name == STX || name == STY ||
+                name == LDA || name == LDX || name == LDY ||
+                name == ORA || name == EOR || name == AND ||
+                name == ADC || name == SBC || name == BIT ||
+                name == CMP || name == CPX || name == CPY ||
+                name == LSR || name == ROR ||
+                name == ASL || name == ROL ||
+                name == INC || name == DEC
+           ) {
+            printf(" = %02X%n", trace_read_8(address), &store_add);
+        }
+        indent += store_add;
+    }
+
+    printf("%*cA:%02X X:%02X Y:%02X P:%02X SP:%02X CYC:%ld\n", 28 - indent, ' ', nes.cpu.a, nes.cpu.x, nes.cpu.y, nes.cpu.p, nes.cpu.s, nes.cpu.cycles);
+}
+
+
+uint8_t _adc(enum address_mode mode, uint16_t address) {
+    uint8_t data = cpu_read_8(address);
+
+    int result = nes.cpu.a + data + get_flag(CARRY);
+
+    set_flag(CARRY, result > 0xff);
+    set_flag(ZERO, (result & 0xff) == 0);
+    set_flag(OVERFLOW, ~(nes.cpu.a ^ data) & (nes.cpu.a ^ result) & 0x80);
+    set_flag(NEGATIVE, result & 0x80);
+
+    nes.cpu.a = result;
+
+    return 0;
+}
+
+uint8_t _and(enum address_mode mode, uint16_t address) {
+    uint8_t result = nes.cpu.a & cpu_read_8(address);
+
+    set_flag(ZERO, result == 0);
+    set_flag(NEGATIVE, result & 0x80);
+
+    nes.cpu.a = result;
+
+    return 0;
+}
+
+uint8_t _asl(enum address_mode mode, uint16_t address) {
+    int result;
+    if (mode == ACCUMULATOR) {
+        result = nes.cpu.a << 1;
+    } else {
+        result = cpu_read_8(address) << 1;
+    }
+
+    set_flag(CARRY, result & 0x0100);
+    set_flag(ZERO, (result & 0xff) == 0);
+    set_flag(NEGATIVE, result & 0x80);
+
+    if (mode == ACCUMULATOR) {
+        nes.cpu.a = result;
+    } else {
+        cpu_write_8(address, result);
+    }
+
+    if (mode == ACCUMULATOR) {
+        return 0;
+    } else if (mode == ABSOLUTE_X) {
+        return 3;
+    } else {
+        return 2;
+    }
+}
+
+uint8_t _bcc(enum address_mode mode, uint16_t address) {
+    uint8_t cycles = 0;
+    uint16_t initial_pc = nes.cpu.pc;
+
+    if (!get_flag(CARRY)) {
+        nes.cpu.pc += (int8_t)cpu_read_8(address) + 2;
+        cycles += 1;
+    }
+
+    if (nes.cpu.pc >> 8 != initial_pc >> 8) {
+        cycles += 2;
+    }
+
+    return cycles;
+}
+
+uint8_t _bcs(enum address_mode mode, uint16_t address) {
+    uint8_t cycles = 0;
+    uint16_t initial_pc = nes.cpu.pc;
+
+    if (get_flag(CARRY)) {
+        nes.cpu.pc += (int8_t)cpu_read_8(address) + 2;
+        cycles += 1;
+    }
+
+    if (nes.cpu.pc >> 8 != initial_pc >> 8) {
+        cycles += 2;
+    }
+
+    return cycles;
+}
+
+uint8_t _beq(enum address_mode mode, uint16_t address) {
+    uint8_t cycles = 0;
+    // uint16_t initial_pc = nes.cpu.pc;
+
+    if (get_flag(ZERO)) {
+        nes.cpu.pc += (int8_t)cpu_read_8(address) + 2;
+        cycles += 1;
+    }
+
+    // if (nes.cpu.pc >> 8 != initial_pc >> 8) {
+    //     cycles += 2;
+    // }
+
+    return cycles;
+}
+
+uint8_t _bit(enum address_mode mode, uint16_t address) {
+    uint8_t data = cpu_read_8(address);
+    uint8_t result = nes.cpu.a & data;
+
+    set_flag(ZERO, result == 0);
+
+    set_flag(OVERFLOW, data & 0x40);
+    set_flag(NEGATIVE, data & 0x80);
+
+    return 0;
+}
+
+uint8_t _bmi(enum address_mode mode, uint16_t address) {
+    uint8_t cycles = 0;
+    uint16_t initial_pc = nes.cpu.pc;
+
+    if (get_flag(NEGATIVE)) {
+        nes.cpu.pc += (int8_t)cpu_read_8(address) + 2;
+        cycles += 1;
+    }
+
+    if (nes.cpu.pc >> 8 != initial_pc >> 8) {
+        cycles += 2;
+    }
+
+    return cycles;
+}
+
+uint8_t _bne(enum address_mode mode, uint16_t address) {
+    uint8_t cycles = 0;
+    uint16_t initial_pc = nes.cpu.pc;
+
+    if (!get_flag(ZERO)) {
+        nes.cpu.pc += (int8_t)cpu_read_8(address) + 2;
+        cycles += 1;
+    }
+
+    if (nes.cpu.pc >> 8 != initial_pc >> 8) {
+        cycles += 2;
+    }
+
+    return cycles;
+}
+
+uint8_t _bpl(enum address_mode mode, uint16_t address) {
+    uint8_t cycles = 0;
+    uint16_t initial_pc = nes.cpu.pc;
+
+    if (!get_flag(NEGATIVE)) {
+        nes.cpu.pc += (int8_t)cpu_read_8(address) + 2;
+        cycles += 1;
+    }
+
+    if (nes.cpu.pc >> 8 != initial_pc >> 8) {
+        cycles += 2;
+    }
+
+    return cycles;
+}
+
+uint8_t _brk(enum address_mode mode, uint16_t address) {
+    stack_push_16(nes.cpu.pc);
+    stack_push_8(nes.cpu.p);
+    nes.cpu.pc = cpu_read_16(IRQ_VECTOR);
+    set_flag(BREAK, true);
+    sampler_call(nes.cpu.pc);
+
+    return 0;
+}
+
+uint8_t _bvc(enum address_mode mode, uint16_t address) {
+    uint8_t cycles = 0;
+    uint16_t initial_pc = nes.cpu.pc;
+
+    if (!get_flag(OVERFLOW)) {
+        nes.cpu.pc += (int8_t)cpu_read_8(address) + 2;
+        cycles += 1;
+    }
+
+    if (nes.cpu.pc >> 8 != initial_pc >> 8) {
+        cycles += 2;
+    }
+
+    return cycles;
+}
+
+uint8_t _bvs(enum address_mode mode, uint16_t address) {
+    uint8_t cycles = 0;
+    uint16_t initial_pc = nes.cpu.pc;
+
+    if (get_flag(OVERFLOW)) {
+        nes.cpu.pc += (int8_t)cpu_read_8(address) + 2;
+        cycles += 1;
+    }
+
+    if (nes.cpu.pc >> 8 != initial_pc >> 8) {
+        cycles += 2;
+    }
+
+    return cycles;
+}
+
+uint8_t _clc(enum address_mode mode, uint16_t address) {
+    set_flag(CARRY, false);
+
+    return 0;
+}
+
+uint8_t _cld(enum address_mode mode, uint16_t address) {
+    set_flag(DECIMAL, false);
+
+    return 0;
+}
+
+uint8_t _cli(enum address_mode mode, uint16_t address) {
+    set_flag(INTERRUPT, false);
+
+    return 0;
+}
+
+uint8_t _clv(enum address_mode mode, uint16_t address) {
+    set_flag(OVERFLOW, false);
+
+    return 0;
+}
+
+uint8_t _cmp(enum address_mode mode, uint16_t address) {
+    uint8_t data = cpu_read_8(address);
+    uint8_t result = nes.cpu.a - data;
+
+    set_flag(CARRY, nes.cpu.a >= data);
+    set_flag(ZERO, result == 0);
+    set_flag(NEGATIVE, result & 0x80);
+
+    return 0;
+}
+
+uint8_t _cpx(enum address_mode mode, uint16_t address) {
+    uint8_t data = cpu_read_8(address);
+    uint8_t result = nes.cpu.x - data;
+
+    set_flag(CARRY, nes.cpu.x >= data);
+    set_flag(ZERO, result == 0);
+    set_flag(NEGATIVE, result & 0x80);
+
+    return 0;
+}
+
+uint8_t _cpy(enum address_mode mode, uint16_t address) {
+    uint8_t data = cpu_read_8(address);
+    uint8_t result = nes.cpu.y - data;
+
+    set_flag(CARRY, nes.cpu.y >= data);
+    set_flag(ZERO, result == 0);
+    set_flag(NEGATIVE, result & 0x80);
+
+    return 0;
+}
+
+uint8_t _dec(enum address_mode mode, uint16_t address) {
+    uint8_t result = cpu_read_8(address) - 1;
+
+    set_flag(ZERO, result == 0);
+    set_flag(NEGATIVE, result & 0x80);
+
+    cpu_write_8(address, result);
+
+    if (mode == ABSOLUTE_X) {
+        return 1;
+    } else {
+        return 0;
+    }
+}
+
+uint8_t _dex(enum address_mode mode, uint16_t address) {
+    uint8_t result = nes.cpu.x - 1;
+
+    set_flag(ZERO, result == 0);
+    set_flag(NEGATIVE, result & 0x80);
+
+    nes.cpu.x = result;
+
+    return 0;
+}
+
+uint8_t _dey(enum address_mode mode, uint16_t address) {
+    uint8_t result = nes.cpu.y - 1;
+
+    set_flag(ZERO, result == 0);
+    set_flag(NEGATIVE, result & 0x80);
+
+    nes.cpu.y = result;
+
+    return 0;
+}
+
+uint8_t _eor(enum address_mode mode, uint16_t address) {
+    uint8_t result = nes.cpu.a ^ cpu_read_8(address);
+
+    set_flag(ZERO, result == 0);
+    set_flag(NEGATIVE, result & 0x80);
+
+    nes.cpu.a = result;
+
+    return 0;
+}
+
+uint8_t _inc(enum address_mode mode, uint16_t address) {
+    uint8_t result = cpu_read_8(address) + 1;
+
+    set_flag(ZERO, result == 0);
+    set_flag(NEGATIVE, result & 0x80);
+
+    cpu_write_8(address, result);
+
+    if (mode == ABSOLUTE_X) {
+        return 1;
+    } else {
+        return 0;
+    }
+}
+
+uint8_t _inx(enum address_mode mode, uint16_t address) {
+    uint8_t result = nes.cpu.x + 1;
+
+    set_flag(ZERO, result == 0);
+    set_flag(NEGATIVE, result & 0x80);
+
+    nes.cpu.x = result;
+
+    return 0;
+}
+
+uint8_t _iny(enum address_mode mode, uint16_t address) {
+    uint8_t result = nes.cpu.y + 1;
+
+    set_flag(ZERO, result == 0);
+    set_flag(NEGATIVE, result & 0x80);
+
+    nes.cpu.y = result;
+
+    return 0;
+}
+
+uint8_t _jmp(enum address_mode mode, uint16_t address) {
+    // TODO: Indirect mode page boundary bug
+    nes.cpu.pc = address;
+
+    return 0;
+}
+
+uint8_t _jsr(enum address_mode mode, uint16_t address) {
+    stack_push_16(nes.cpu.pc + instruction_length(mode) - 1);
+    nes.cpu.pc = address;
+    sampler_call(address);
+
+    return 0;
+}
+
+uint8_t _lda(enum address_mode mode, uint16_t address) {
+    uint8_t data = cpu_read_8(address);
+
+    set_flag(ZERO, data == 0);
+    set_flag(NEGATIVE, data & 0x80);
+
+    nes.cpu.a = data;
+
+    if ((mode == ABSOLUTE_X || mode == ABSOLUTE_Y ||
+        mode == INDIRECT_INDEXED) && page_cross(mode)) {
+        return 1;
+    } else {
+        return 0;
+    }
+}
+
+uint8_t _ldx(enum address_mode mode, uint16_t address) {
+    uint8_t data = cpu_read_8(address);
+
+    set_flag(ZERO, data == 0);
+    set_flag(NEGATIVE, data & 0x80);
+
+    nes.cpu.x = data;
+
+    if (mode == ABSOLUTE_Y && page_cross(mode)) {
+        return 1;
+    } else {
+        return 0;
+    }
+}
+
+uint8_t _ldy(enum address_mode mode, uint16_t address) {
+    uint8_t data = cpu_read_8(address);
+
+    set_flag(ZERO, data == 0);
+    set_flag(NEGATIVE, data & 0x80);
+
+    nes.cpu.y = data;
+
+    if (mode == ABSOLUTE_X && page_cross(mode)) {
+        return 1;
+    } else {
+        return 0;
+    }
+}
+
+uint8_t _lsr(enum address_mode mode, uint16_t address) {
+    uint8_t data;
+    if (mode == ACCUMULATOR) {
+        data = nes.cpu.a;
+    } else {
+        data = cpu_read_8(address);
+    }
+
+    uint8_t result = data >> 1;
+
+    set_flag(CARRY, data & 1);
+    set_flag(ZERO, result == 0);
+    set_flag(NEGATIVE, result & 0x80);
+
+    if (mode == ACCUMULATOR) {
+        nes.cpu.a = result;
+    } else {
+        cpu_write_8(address, result);
+    }
+
+    if (mode == ACCUMULATOR) {
+        return 0;
+    } else if (mode == ABSOLUTE_X) {
+        return 3;
+    } else {
+        return 2;
+    }
+}
+
+uint8_t _nop(enum address_mode mode, uint16_t address) {return 0;}
+
+uint8_t _ora(enum address_mode mode, uint16_t address) {
+    uint8_t result = nes.cpu.a | cpu_read_8(address);
+
+    set_flag(ZERO, result == 0);
+    set_flag(NEGATIVE, result & 0x80);
+
+    nes.cpu.a = result;
+
+    return 0;
+}
+
+uint8_t _pha(enum address_mode mode, uint16_t address) {
+    stack_push_8(nes.cpu.a);
+
+    return 0;
+}
+
+uint8_t _php(enum address_mode mode, uint16_t address) {
+    stack_push_8(nes.cpu.p | (1 << BREAK));
+
+    return 0;
+}
+
+uint8_t _pla(enum address_mode mode, uint16_t address) {
+    uint8_t result = stack_pop_8();
+
+    set_flag(ZERO, result == 0);
+    set_flag(NEGATIVE, result & 0x80);
+
+    nes.cpu.a = result;
+
+    return 0;
+}
+
+uint8_t _plp(enum address_mode mode, uint16_t address) {
+    uint8_t initial_flags = nes.cpu.p;
+    uint8_t result = stack_pop_8();
+
+    nes.cpu.p = result;
+    set_flag(ONE, true);
+    set_flag(BREAK, initial_flags & (1 << BREAK));
+
+    return 0;
+}
+
+uint8_t _rol(enum address_mode mode, uint16_t address) {
+    uint8_t data;
+    if (mode == ACCUMULATOR) {
+        data = nes.cpu.a;
+    } else {
+        data = cpu_read_8(address);
+    }
+
+    uint8_t result = data << 1 | get_flag(CARRY);
+
+    set_flag(CARRY, data & 0x80);
+    set_flag(ZERO, result == 0);
+    set_flag(NEGATIVE, result & 0x80);
+
+    if (mode == ACCUMULATOR) {
+        nes.cpu.a = result;
+    } else {
+        cpu_write_8(address, result);
+    }
+
+    if (mode == ACCUMULATOR) {
+        return 0;
+    } else if (mode == ABSOLUTE_X) {
+        return 3;
+    } else {
+        return 2;
+    }
+}
+
+uint8_t _ror(enum address_mode mode, uint16_t address) {
+    uint8_t data;
+    if (mode == ACCUMULATOR) {
+        data = nes.cpu.a;
+    } else {
+        data = cpu_read_8(address);
+    }
+
+    uint8_t result = data >> 1 | (get_flag(CARRY) << 7);
+
+    set_flag(CARRY, data & 1);
+    set_flag(ZERO, result == 0);
+    set_flag(NEGATIVE, result & 0x80);
+
+    if (mode == ACCUMULATOR) {
+        nes.cpu.a = result;
+    } else {
+        cpu_write_8(address, result);
+    }
+
+    if (mode == ACCUMULATOR) {
+        return 0;
+    } else if (mode == ABSOLUTE_X) {
+        return 3;
+    } else {
+        return 2;
+    }
+}
+
+uint8_t _rti(enum address_mode mode, uint16_t address) {
+    nes.cpu.p = stack_pop_8();
+    set_flag(ONE, true);
+    nes.cpu.pc = stack_pop_16();
+    sampler_return();
+
+    return 0;
+}
+
+uint8_t _rts(enum address_mode mode, uint16_t address) {
+    nes.cpu.pc = stack_pop_16() + 1;
+    sampler_return();
+
+    return 0;
+}
+
+uint8_t _sbc(enum address_mode mode, uint16_t address) {
+    uint8_t data = ~cpu_read_8(address);
+
+    int result = nes.cpu.a + data + get_flag(CARRY);
+
+    set_flag(CARRY, result > 0xff);
+    set_flag(ZERO, (result & 0xff) == 0);
+    set_flag(OVERFLOW, ~(nes.cpu.a ^ data) & (nes.cpu.a ^ result) & 0x80);
+    set_flag(NEGATIVE, result & 0x80);
+
+    nes.cpu.a = result;
+
+    return 0;
+}
+
+uint8_t _sec(enum address_mode mode, uint16_t address) {
+    set_flag(CARRY, 1);
+
+    return 0;
+}
+
+uint8_t _sed(enum address_mode mode, uint16_t address) {
+    set_flag(DECIMAL, 1);
+
+    return 0;
+}
+
+uint8_t _sei(enum address_mode mode, uint16_t address) {
+    set_flag(INTERRUPT, 1);
+
+    return 0;
+}
+
+uint8_t _sta(enum address_mode mode, uint16_t address) {
+    cpu_write_8(address, nes.cpu.a);
+
+    if (mode == ABSOLUTE_X || mode == ABSOLUTE_Y || mode == INDIRECT_INDEXED) {
+        return 1;
+    } else {
+        return 0;
+    }
+}
+
+uint8_t _stx(enum address_mode mode, uint16_t address) {
+    cpu_write_8(address, nes.cpu.x);
+
+    return 0;
+}
+
+uint8_t _sty(enum address_mode mode, uint16_t address) {
+    cpu_write_8(address, nes.cpu.y);
+
+    return 0;
+}
+
+uint8_t _tax(enum address_mode mode, uint16_t address) {
+    uint8_t result = nes.cpu.a;
+
+    set_flag(ZERO, result == 0);
+    set_flag(NEGATIVE, result & 0x80);
+
+    nes.cpu.x = result;
+
+    return 0;
+}
+
+uint8_t _tay(enum address_mode mode, uint16_t address) {
+    uint8_t result = nes.cpu.a;
+
+    set_flag(ZERO, result == 0);
+    set_flag(NEGATIVE, result & 0x80);
+
+    nes.cpu.y = result;
+
+    return 0;
+}
+
+uint8_t _tsx(enum address_mode mode, uint16_t address) {
+    uint8_t result = nes.cpu.s;
+
+    set_flag(ZERO, result == 0);
+    set_flag(NEGATIVE, result & 0x80);
+
+    nes.cpu.x = result;
+
+    return 0;
+}
+
+uint8_t _txa(enum address_mode mode, uint16_t address) {
+    uint8_t result = nes.cpu.x;
+
+    set_flag(ZERO, result == 0);
+    set_flag(NEGATIVE, result & 0x80);
+
+    nes.cpu.a = result;
+
+    return 0;
+}
+
+uint8_t _txs(enum address_mode mode, uint16_t address) {
+    nes.cpu.s = nes.cpu.x;
+
+    return 0;
+}
+
+uint8_t _tya(enum address_mode mode, uint16_t address) {
+    uint8_t result = nes.cpu.y;
+
+    set_flag(ZERO, result == 0);
+    set_flag(NEGATIVE, result & 0x80);
+
+    nes.cpu.a = result;
+
+    return 0;
+}
+
+uint8_t (*const INSTRUCTION_FUNCTIONS[])(enum address_mode mode, uint16_t address) = {
+    [ADC] = _adc, [AND] = _and, [ASL] = _asl, [BCC] = _bcc, [BCS] = _bcs, [BEQ] = _beq, [BIT] = _bit,
+    [BMI] = _bmi, [BNE] = _bne, [BPL] = _bpl, [BRK] = _brk, [BVC] = _bvc, [BVS] = _bvs, [CLC] = _clc,
+    [CLD] = _cld, [CLI] = _cli, [CLV] = _clv, [CMP] = _cmp, [CPX] = _cpx, [CPY] = _cpy, [DEC] = _dec,
+    [DEX] = _dex, [DEY] = _dey, [EOR] = _eor, [INC] = _inc, [INX] = _inx, [INY] = _iny, [JMP] = _jmp,
+    [JSR] = _jsr, [LDA] = _lda, [LDX] = _ldx, [LDY] = _ldy, [LSR] = _lsr, [NOP] = _nop, [ORA] = _ora,
+    [PHA] = _pha, [PHP] = _php, [PLA] = _pla, [PLP] = _plp, [ROL] = _rol, [ROR] = _ror, [RTI] = _rti,
+    [RTS] = _rts, [SBC] = _sbc, [SEC] = _sec, [SED] = _sed, [SEI] = _sei, [STA] = _sta, [STX] = _stx,
+    [STY] = _sty, [TAX] = _tax, [TAY] = _tay, [TSX] = _tsx, [TXA] = _txa, [TXS] = _txs, [TYA] = _tya,
+};
+
+
+int execute_next() {
+    uint16_t initial_pc = nes.cpu.pc;
+
+    // Opcode fetches have their own page table so breakpoints cost nothing until their page is reached
+    uint8_t opcode;
+    uint8_t *page = memory_map.fetch[nes.cpu.pc >> 8];
+    if (page != NULL) {
+        opcode = page[nes.cpu.pc & 0xff];
+    } else {
+        if (debugger.armed && debugger_fetch(nes.cpu.pc)) {
+            return 0;
+        }
+        opcode = cpu_read_8(nes.cpu.pc);
+    }
+
+    profile_instruction(initial_pc, opcode);
+
+    enum instruction_name name = INSTRUCTION_LOOKUP[opcode];
+    enum address_mode mode = ADDRESS_MODE_LOOKUP[opcode];
+
+    uint8_t cycles = INSTRUCTION_CYCLES[name] + ADDRESS_MODE_CYCLES[mode];
+
+    uint16_t address = read_operand(mode);
+
+    if (state.debug) {
+        print_next_instruction();
+    }
+    journal_step();
+
+    switch (name) {
+        case ADC: cycles += _adc(mode, address); break;
+        case AND: cycles += _and(mode, address); break;
+        case ASL: cycles += _asl(mode, address); break;
+        case BCC: cycles += _bcc(mode, address); break;
+        case BCS: cycles += _bcs(mode, address); break;
+        case BEQ: cycles += _beq(mode, address); break;
+        case BIT: cycles += _bit(mode, address); break;
+        case BMI: cycles += _bmi(mode, address); break;
+        case BNE: cycles += _bne(mode, address); break;
+        case BPL: cycles += _bpl(mode, address); break;
+        case BRK: cycles += _brk(mode, address); break;
+        case BVC: cycles += _bvc(mode, address); break;
+        case BVS: cycles += _bvs(mode, address); break;
+        case CLC: cycles += _clc(mode, address); break;
+        case CLD: cycles += _cld(mode, address); break;
+        case CLI: cycles += _cli(mode, address); break;
+        case CLV: cycles += _clv(mode, address); break;
+        case CMP: cycles += _cmp(mode, address); break;
+        case CPX: cycles += _cpx(mode, address); break;
+        case CPY: cycles += _cpy(mode, address); break;
+        case DEC: cycles += _dec(mode, address); break;
+        case DEX: cycles += _dex(mode, address); break;
+        case DEY: cycles += _dey(mode, address); break;
+        case EOR: cycles += _eor(mode, address); break;
+        case INC: cycles += _inc(mode, address); break;
+        case INX: cycles += _inx(mode, address); break;
+        case INY: cycles += _iny(mode, address); break;
+        case JMP: cycles += _jmp(mode, address); break;
+        case JSR: cycles += _jsr(mode, address); break;
+        case LDA: cycles += _lda(mode, address); break;
+        case LDX: cycles += _ldx(mode, address); break;
+        case LDY: cycles += _ldy(mode, address); break;
+        case LSR: cycles += _lsr(mode, address); break;
+        case NOP: cycles += _nop(mode, address); break;
+        case ORA: cycles += _ora(mode, address); break;
+        case PHA: cycles += _pha(mode, address); break;
+        case PHP: cycles += _php(mode, address); break;
+        case PLA: cycles += _pla(mode, address); break;
+        case PLP: cycles += _plp(mode, address); break;
+        case ROL: cycles += _rol(mode, address); break;
+        case ROR: cycles += _ror(mode, address); break;
+        case RTI: cycles += _rti(mode, address); break;
+        case RTS: cycles += _rts(mode, address); break;
+        case SBC: cycles += _sbc(mode, address); break;
+        case SEC: cycles += _sec(mode, address); break;
+        case SED: cycles += _sed(mode, address); break;
+        case SEI: cycles += _sei(mode, address); break;
+        case STA: cycles += _sta(mode, address); break;
+        case STX: cycles += _stx(mode, address); break;
+        case STY: cycles += _sty(mode, address); break;
+        case TAX: cycles += _tax(mode, address); break;
+        case TAY: cycles += _tay(mode, address); break;
+        case TSX: cycles += _tsx(mode, address); break;
+        case TXA: cycles += _txa(mode, address); break;
+        case TXS: cycles += _txs(mode, address); break;
+        case TYA: cycles += _tya(mode, address); break;
+        default:
+            logf_error("Unknown instruction with opcode: #$%02X\n", opcode);
+            log_error("Halting execution\n");
+            break;
+    }
+
+    // Prevent jmp and branch instructions from skipping the next instruction
+    if (initial_pc == nes.cpu.pc) {
+        nes.cpu.pc += instruction_length(mode);
+    }
+
+    return cycles;
+}
+
+void poweron() {
+    nes.cpu.pc = cpu_read_16(RESET_VECTOR);
+    nes.cpu.cycles = 7;
+    nes.cpu.s = 0xfd;
+    set_flag(INTERRUPT, true);
+    set_flag(ONE, true);
+}
+
+// The reset line leaves RAM and registers alone but still runs the interrupt sequence without writing the stack
+void reset() {
+    nes.cpu.pc = cpu_read_16(RESET_VECTOR);
+    nes.cpu.s -= 3;
+    set_flag(INTERRUPT, true);
+    nes.cpu.cycles += 7;
+    journal_restored();
+}
+
+void run_frame() {
+    uint64_t frame_end = (state.frames + 1) * CPU_CYCLES_PER_FRAME;
+
+    // Vertical blank started as the last frame ended and lasts into this one
+    uint64_t vblank_end = state.frames * CPU_CYCLES_PER_FRAME + CPU_CYCLES_PER_VBLANK;
+
+    // Tracing, the debugger, the journal and profiling hook into execute_next(), other engines only take over without them
+    bool hooks = state.debug || debugger.armed || debugger.watching || journal.instructions || profile_enabled();
+
+    while (nes.cpu.cycles < frame_end) {
+        bool in_vblank = nes.cpu.cycles < vblank_end;
+        uint64_t leg_end = in_vblank ? vblank_end : frame_end;
+
+        int cycles;
+        if (hooks) {
+            cycles = execute_next();
+        } else if (current_engine->run != NULL) {
+            uint64_t until = sampler.next < leg_end ? sampler.next : leg_end;
+            cycles = current_engine->run(until - nes.cpu.cycles, NULL);
+        } else {
+            cycles = current_engine->step();
+        }
+
+        // The debugger stopped before an instruction, the next call picks the frame up again
+        if (cycles == 0) {
+            return;
+        }
+        nes.cpu.cycles += cycles;
+
+        if (in_vblank && nes.cpu.cycles >= vblank_end) {
+            end_vblank();
+            journal_vblank();
+        }
+
+        if (nes.cpu.cycles >= sampler.next) {
+            sampler_sample();
+        }
+    }
+
+    state.frames++;
+    state_hash_frame();
+    battery_frame();
+    journal_frame();
+    start_vblank();
+}
+
+void save_snapshot(struct snapshot *snapshot) {
+    snapshot->nes = nes;
+    memcpy(snapshot->prg_ram, cartridge.prg_ram, sizeof(snapshot->prg_ram));
+    snapshot->frames = state.frames;
+}
+
+// RAM and cycles come back with the nes struct, the framebuffer pointer stored in the snapshot is ignored
+void load_snapshot(const struct snapshot *snapshot) {
+    uint8_t *framebuffer = nes.ppu.framebuffer;
+
+    nes = snapshot->nes;
+    nes.ppu.framebuffer = framebuffer;
+
+    memcpy(cartridge.prg_ram, snapshot->prg_ram, sizeof(snapshot->prg_ram));
+    state.frames = snapshot->frames;
+
+    // Any page may differ from what the dirty page trackers last saw
+    mark_pages_written(ALL_DIRTY_PAGES);
+    journal_restored();
+}
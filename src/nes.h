@@ -0,0 +1,244 @@
+#ifndef NES_H
+#define NES_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "instructions.h"
+#include "ppu.h"
+
+
+extern const uint16_t NMI_VECTOR;
+extern const uint16_t RESET_VECTOR;
+extern const uint16_t IRQ_VECTOR;
+
+extern const uint32_t SCREEN_WIDTH;
+extern const uint32_t SCREEN_HEIGHT;
+
+extern const uint32_t SCANLINE_WIDTH;
+extern const uint32_t SCANLINE_HEIGHT;
+
+extern const uint32_t CPU_CYCLES_PER_FRAME;
+extern const uint32_t CPU_CYCLES_PER_VBLANK;
+
+extern const uint32_t PRG_RAM_SIZE;
+
+extern const uint8_t PALETTE[64][3];
+
+enum flag {
+    CARRY     = 0,
+    ZERO      = 1,
+    INTERRUPT = 2,
+    DECIMAL   = 3,
+    BREAK     = 4,
+    ONE       = 5,
+    OVERFLOW  = 6,
+    NEGATIVE  = 7,
+};
+
+
+enum button {
+    BUTTON_A      = 0,
+    BUTTON_B      = 1,
+    BUTTON_SELECT = 2,
+    BUTTON_START  = 3,
+    BUTTON_UP     = 4,
+    BUTTON_DOWN   = 5,
+    BUTTON_LEFT   = 6,
+    BUTTON_RIGHT  = 7,
+};
+
+
+struct cartridge {
+    struct {
+        char nes[4];
+        uint8_t prg_size;
+        uint8_t chr_size;
+        uint8_t flags_6;
+        uint8_t flags_7;
+        char padding[8];
+    } header;
+
+    uint8_t *prg_rom;
+    uint8_t *chr_rom;
+
+    // 8KiB of work RAM at $6000-$7FFF, also used by test ROMs to report results
+    uint8_t *prg_ram;
+
+    // Flags 6 bit 1, PRG RAM keeps its contents while the power is off
+    bool battery;
+
+    uint8_t mapper;
+};
+
+// Hot state comes first so the registers, the cycle counter and the start of RAM share
+// a cache line. The global is 64-byte aligned in nes.c.
+struct nes {
+    struct {
+        uint16_t pc;
+        uint8_t a, x, y, s, p;
+        uint64_t cycles;
+
+        // Inline rather than allocated, so zero page and stack accesses skip a pointer load
+        uint8_t ram[2048];
+    } cpu;
+
+    // Standard controllers on $4016/$4017
+    struct {
+        uint8_t buttons;
+        uint8_t shift;
+    } controllers[2];
+
+    bool controller_strobe;
+
+    // Last, so its memory pages end the struct
+    struct ppu ppu;
+};
+
+struct state {
+    bool debug;
+
+    // Silences all logging, for tools that run millions of instructions and report failures themselves
+    bool quiet;
+
+    uint8_t *filedata;
+    size_t filesize;
+
+    uint8_t *prg_ram;
+    uint8_t *framebuffer;
+
+    uint64_t frames;
+
+    // Called around drawing a frame when set, so a frontend can time the PPU apart from the CPU
+    void (*render_begin)();
+    void (*render_end)();
+};
+
+// Everything an instruction can change, so the machine can be rewound
+struct snapshot {
+    struct nes nes;
+    uint8_t prg_ram[0x2000];
+    uint64_t frames;
+};
+
+#define WRITE_LOG_SIZE 8
+
+// Records CPU bus writes while enabled, count keeps going past WRITE_LOG_SIZE
+struct write_log {
+    bool enabled;
+    int count;
+    struct {
+        uint16_t address;
+        uint8_t data;
+    } writes[WRITE_LOG_SIZE];
+};
+
+// RAM, PRG RAM and PPU memory pages written, for copy-on-write snapshots and the state
+// hash. While anything tracks them, a clean page has no write entry in the memory map, so
+// the first write to it takes the slow path and marks it. Bit n is RAM page n with its
+// mirrors for n < 8, then PRG RAM page n - 8, then from PPU_DIRTY_PAGE on the pages of the
+// PPU's memory, which are never mapped and marked by the PPU as it writes them.
+#define PPU_DIRTY_PAGE (8 + 32)
+#define DIRTY_PAGES (PPU_DIRTY_PAGE + 10)
+#define ALL_DIRTY_PAGES ((1ull << DIRTY_PAGES) - 1)
+#define PRG_RAM_DIRTY_PAGES (((1ull << 32) - 1) << 8)
+
+enum dirty_tracker {
+    DIRTY_FORK,
+    DIRTY_STATE_HASH,
+    DIRTY_BATTERY,
+    DIRTY_TRACKERS,
+};
+
+struct dirty_pages {
+    // One bit per enum dirty_tracker
+    unsigned trackers;
+
+    // Written since the pages were last protected
+    uint64_t dirty;
+
+    // Written before that, and not taken by the tracker yet
+    uint64_t pending[DIRTY_TRACKERS];
+};
+
+// CPU address space in 256-byte pages. A NULL entry sends the access down the slow
+// path, which handles registers, unmapped addresses and debugger watchpoints.
+struct memory_map {
+    uint8_t *read[256];
+    uint8_t *write[256];
+    uint8_t *fetch[256];
+
+    // Bumped by every map_memory() so anything derived from the pages can tell it is stale
+    uint32_t generation;
+};
+
+extern struct cartridge cartridge;
+extern struct nes nes;
+extern struct state state;
+extern struct write_log write_log;
+extern struct dirty_pages dirty_pages;
+extern struct memory_map memory_map;
+
+
+#define log_info(format) do { if (!state.quiet) fprintf(stderr, "INFO [CYCLE %04lX PC %04X]: " format, nes.cpu.cycles, nes.cpu.pc); } while (0)
+#define log_warning(format) do { if (!state.quiet) fprintf(stderr, "WARNING [CYCLE %04lX PC %04X]: " format, nes.cpu.cycles, nes.cpu.pc); } while (0)
+#define log_error(format) do { if (!state.quiet) fprintf(stdout, "ERROR [CYCLE %04lX PC %04X]: " format, nes.cpu.cycles, nes.cpu.pc); } while (0)
+
+#define logf_info(format, ...) do { if (!state.quiet) fprintf(stderr, "INFO [CYCLE %04lX PC %04X]: " format, nes.cpu.cycles, nes.cpu.pc, ##__VA_ARGS__); } while (0)
+#define logf_warning(format, ...) do { if (!state.quiet) fprintf(stderr, "WARNING [CYCLE %04lX PC %04X]: " format, nes.cpu.cycles, nes.cpu.pc, ##__VA_ARGS__); } while (0)
+#define logf_error(format, ...) do { if (!state.quiet) fprintf(stdout, "ERROR [CYCLE %04lX PC %04X]: " format, nes.cpu.cycles, nes.cpu.pc, ##__VA_ARGS__); } while (0)
+
+
+uint8_t *read_file(const char *filename, size_t *length);
+bool load_cartridge();
+void print_header();
+
+void init_memory();
+void map_memory();
+uint8_t *dirty_page_memory(int index);
+void mark_pages_written(uint64_t pages);
+
+// For writes to the machine's PPU memory, marks the page holding that byte
+void mark_ppu_written(const uint8_t *memory);
+
+// A tracker that starts sees every page as written
+void track_dirty_pages(enum dirty_tracker tracker, bool enabled);
+uint64_t peek_dirty_pages(enum dirty_tracker tracker);
+uint64_t take_dirty_pages(enum dirty_tracker tracker);
+void cleanup_nes();
+
+uint8_t cpu_read_8(uint16_t address);
+uint16_t cpu_read_16(uint16_t address);
+void cpu_write_8(uint16_t address, uint8_t data);
+void cpu_write_16(uint16_t address, uint16_t data);
+
+void set_buttons(int port, uint8_t buttons);
+
+void set_flag(enum flag f, bool set);
+uint8_t get_flag(enum flag f);
+
+void stack_push_8(uint8_t data);
+void stack_push_16(uint16_t data);
+uint8_t stack_pop_8();
+uint16_t stack_pop_16();
+
+// Instruction behaviour shared by the CPU engines, indexed by instruction name. Each
+// returns the cycles it adds on top of INSTRUCTION_CYCLES and ADDRESS_MODE_CYCLES.
+extern uint8_t (*const INSTRUCTION_FUNCTIONS[])(enum address_mode mode, uint16_t address);
+
+uint16_t instruction_length(enum address_mode mode);
+uint16_t read_operand(enum address_mode mode);
+void print_next_instruction();
+
+void perform_nmi();
+void start_vblank();
+void end_vblank();
+int execute_next();
+void poweron();
+void reset();
+void run_frame();
+
+void save_snapshot(struct snapshot *snapshot);
+void load_snapshot(const struct snapshot *snapshot);
+
+#endif
@@ -0,0 +1,400 @@
+#define _DEFAULT_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include "fork.h"
+#include "netplay.h"
+#include "nes.h"
+#include "statehash.h"
+
+
+// Local input frames one packet can carry, the rest follow once these are acknowledged
+#define NETPLAY_PACKET_INPUTS 32
+
+// Packets held back by simulated latency
+#define NETPLAY_QUEUE 256
+
+// magic[2] first[4] count[1] acknowledged[4] hash_frame[4] hash[8], then count inputs
+#define PACKET_HEADER 23
+#define PACKET_SIZE (PACKET_HEADER + NETPLAY_PACKET_INPUTS)
+
+#define NO_ROLLBACK UINT64_MAX
+
+const uint8_t PACKET_MAGIC[2] = { 'C', 'N' };
+
+
+struct delayed_packet {
+    uint64_t due;
+    int size;
+    uint8_t data[PACKET_SIZE];
+};
+
+struct netplay netplay = { 0 };
+
+struct {
+    struct netplay_config config;
+    int socket;
+
+    // Indexed by frame modulo NETPLAY_WINDOW. predicted is the remote input a frame last
+    // ran with, nodes the machine before it and hashes the state after it.
+    uint8_t local[NETPLAY_WINDOW];
+    uint8_t remote[NETPLAY_WINDOW];
+    uint8_t predicted[NETPLAY_WINDOW];
+    struct fork_node *nodes[NETPLAY_WINDOW];
+    uint64_t hashes[NETPLAY_WINDOW];
+
+    uint8_t last_remote;
+
+    // The earliest frame that ran with a wrong prediction
+    uint64_t rollback_from;
+
+    // The newest hash the peer reported, kept until that frame is confirmed here
+    bool have_peer_hash;
+    uint64_t peer_hash_frame;
+    uint64_t peer_hash;
+
+    struct delayed_packet queue[NETPLAY_QUEUE];
+    int queued;
+    uint64_t rng;
+} rollback = { .socket = -1 };
+
+
+static uint64_t now_ns() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000ull + now.tv_nsec;
+}
+
+// xorshift64*, in [0, 1)
+static double next_random() {
+    rollback.rng ^= rollback.rng >> 12;
+    rollback.rng ^= rollback.rng << 25;
+    rollback.rng ^= rollback.rng >> 27;
+    return (rollback.rng * 0x2545f4914f6cdd1dull >> 11) * (1.0 / (1ull << 53));
+}
+
+static void put_32(uint8_t *p, uint32_t value) {
+    for (int i = 0; i < 4; i++) p[i] = value >> (8 * i);
+}
+
+static uint32_t get_32(const uint8_t *p) {
+    return p[0] | p[1] << 8 | p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+static void put_64(uint8_t *p, uint64_t value) {
+    put_32(p, value);
+    put_32(p + 4, value >> 32);
+}
+
+static uint64_t get_64(const uint8_t *p) {
+    return get_32(p) | (uint64_t)get_32(p + 4) << 32;
+}
+
+
+// The peer may not be listening yet, so failed sends are not errors
+static void send_now(const uint8_t *data, int size) {
+    if (send(rollback.socket, data, size, 0) == size) {
+        netplay.sent++;
+    }
+}
+
+static void send_packet(const uint8_t *data, int size) {
+    const struct netplay_config *config = &rollback.config;
+
+    if (config->loss > 0 && next_random() < config->loss) {
+        netplay.dropped++;
+        return;
+    }
+
+    uint64_t delay_ms = config->latency_ms + (config->jitter_ms > 0 ? (uint64_t)(next_random() * config->jitter_ms) : 0);
+    if (delay_ms == 0) {
+        send_now(data, size);
+        return;
+    }
+
+    if (rollback.queued == NETPLAY_QUEUE) {
+        netplay.dropped++;
+        return;
+    }
+
+    struct delayed_packet *packet = &rollback.queue[rollback.queued++];
+    packet->due = now_ns() + delay_ms * 1000000ull;
+    packet->size = size;
+    memcpy(packet->data, data, size);
+}
+
+// With jitter packets fall due out of order, as they would arrive on a real network
+static void flush_queue() {
+    uint64_t now = now_ns();
+
+    for (int i = 0; i < rollback.queued;) {
+        if (rollback.queue[i].due > now) {
+            i++;
+            continue;
+        }
+
+        send_now(rollback.queue[i].data, rollback.queue[i].size);
+        rollback.queue[i] = rollback.queue[--rollback.queued];
+    }
+}
+
+// Everything the peer has not acknowledged, up to the input sampled ahead by the delay
+static void transmit() {
+    uint8_t packet[PACKET_SIZE];
+    uint64_t known = netplay.frame + rollback.config.input_delay;
+    uint64_t count = known - netplay.acknowledged;
+    if (count > NETPLAY_PACKET_INPUTS) {
+        count = NETPLAY_PACKET_INPUTS;
+    }
+
+    uint64_t confirmed = netplay_confirmed();
+
+    memcpy(packet, PACKET_MAGIC, sizeof(PACKET_MAGIC));
+    put_32(packet + 2, netplay.acknowledged);
+    packet[6] = count;
+    put_32(packet + 7, netplay.remote_frames);
+    put_32(packet + 11, confirmed);
+    put_64(packet + 15, confirmed > 0 ? rollback.hashes[(confirmed - 1) % NETPLAY_WINDOW] : 0);
+
+    for (uint64_t i = 0; i < count; i++) {
+        packet[PACKET_HEADER + i] = rollback.local[(netplay.acknowledged + i) % NETPLAY_WINDOW];
+    }
+
+    send_packet(packet, PACKET_HEADER + count);
+}
+
+
+// Captures the machine, then runs frame with the local input and the best remote input known
+static void run_input_frame(uint64_t frame) {
+    int slot = frame % NETPLAY_WINDOW;
+
+    if (rollback.nodes[slot] != NULL) {
+        fork_release(rollback.nodes[slot]);
+    }
+    rollback.nodes[slot] = fork_capture();
+
+    uint8_t remote = frame < netplay.remote_frames ? rollback.remote[slot] : rollback.last_remote;
+    rollback.predicted[slot] = remote;
+
+    set_buttons(rollback.config.player, rollback.local[slot]);
+    set_buttons(1 - rollback.config.player, remote);
+    run_frame();
+
+    rollback.hashes[slot] = state_hash.current;
+}
+
+static void resimulate() {
+    uint64_t from = rollback.rollback_from;
+    rollback.rollback_from = NO_ROLLBACK;
+
+    uint64_t depth = netplay.frame - from;
+    netplay.rollbacks++;
+    netplay.resimulated += depth;
+    if (depth > netplay.deepest_rollback) {
+        netplay.deepest_rollback = depth;
+    }
+
+    // Only the last frame is shown again, the ones before it run with nothing to draw into
+    uint8_t *framebuffer = nes.ppu.framebuffer;
+    fork_restore(rollback.nodes[from % NETPLAY_WINDOW]);
+    for (uint64_t frame = from; frame < netplay.frame; frame++) {
+        nes.ppu.framebuffer = frame + 1 < netplay.frame ? NULL : framebuffer;
+        run_input_frame(frame);
+    }
+    nes.ppu.framebuffer = framebuffer;
+}
+
+// Input is taken in order only, a gap is filled when the peer sends it again
+static void take_inputs(uint64_t first, int count, const uint8_t *inputs) {
+    uint64_t limit = netplay.frame - rollback.config.max_rollback + NETPLAY_WINDOW;
+
+    for (uint64_t frame = netplay.remote_frames; frame >= first && frame < first + count && frame < limit; frame++) {
+        uint8_t buttons = inputs[frame - first];
+        int slot = frame % NETPLAY_WINDOW;
+
+        if (frame < netplay.frame && rollback.predicted[slot] != buttons && frame < rollback.rollback_from) {
+            rollback.rollback_from = frame;
+        }
+
+        rollback.remote[slot] = buttons;
+        rollback.last_remote = buttons;
+        netplay.remote_frames = frame + 1;
+    }
+}
+
+static void receive() {
+    uint8_t packet[PACKET_SIZE + 1];
+
+    for (;;) {
+        ssize_t size = recv(rollback.socket, packet, sizeof(packet), 0);
+        if (size < 0) {
+            // A refused earlier send shows up here while the peer is not listening yet
+            if (errno == ECONNREFUSED) continue;
+            break;
+        }
+
+        if (size < PACKET_HEADER || memcmp(packet, PACKET_MAGIC, sizeof(PACKET_MAGIC)) != 0 || packet[6] > size - PACKET_HEADER) {
+            continue;
+        }
+        netplay.received++;
+
+        take_inputs(get_32(packet + 2), packet[6], packet + PACKET_HEADER);
+
+        uint64_t acknowledged = get_32(packet + 7);
+        if (acknowledged > netplay.acknowledged) {
+            netplay.acknowledged = acknowledged;
+        }
+
+        uint64_t confirmed = get_32(packet + 11);
+        if (confirmed > 0 && (!rollback.have_peer_hash || confirmed - 1 > rollback.peer_hash_frame)) {
+            rollback.have_peer_hash = true;
+            rollback.peer_hash_frame = confirmed - 1;
+            rollback.peer_hash = get_64(packet + 15);
+        }
+    }
+}
+
+// Compares once the frame's input is known here too, and only while its hash is still kept
+static void check_peer_hash() {
+    uint64_t frame = rollback.peer_hash_frame;
+    if (!rollback.have_peer_hash || frame >= netplay_confirmed()) return;
+
+    rollback.have_peer_hash = false;
+    if (frame + NETPLAY_WINDOW <= netplay.frame) return;
+
+    uint64_t local = rollback.hashes[frame % NETPLAY_WINDOW];
+    if (local != rollback.peer_hash) {
+        if (netplay.desyncs == 0) {
+            logf_error("Netplay desync at frame %lu: local state %016lx, remote %016lx\n", frame, local, rollback.peer_hash);
+        }
+        netplay.desyncs++;
+    }
+}
+
+static void exchange() {
+    flush_queue();
+    receive();
+
+    if (rollback.rollback_from != NO_ROLLBACK) {
+        resimulate();
+    }
+
+    check_peer_hash();
+}
+
+
+bool netplay_open(const struct netplay_config *config) {
+    if (config->player < 0 || config->player > 1) {
+        logf_error("Netplay player must be 0 or 1, not %d\n", config->player);
+        return false;
+    }
+
+    netplay_close();
+    memset(&netplay, 0, sizeof(netplay));
+    memset(&rollback, 0, sizeof(rollback));
+    rollback.socket = -1;
+    rollback.config = *config;
+    rollback.rollback_from = NO_ROLLBACK;
+    rollback.rng = config->seed != 0 ? config->seed : 0x9e3779b97f4a7c15ull + config->player;
+
+    if (rollback.config.max_rollback <= 0) {
+        rollback.config.max_rollback = NETPLAY_DEFAULT_ROLLBACK;
+    }
+
+    // Local input waits for acknowledgement up to a window behind, see netplay_frame()
+    if (rollback.config.input_delay < 0 || 2 * (rollback.config.max_rollback + rollback.config.input_delay) > NETPLAY_WINDOW) {
+        logf_error("Netplay rollback of %d and input delay of %d frames do not fit in %d frames\n",
+                rollback.config.max_rollback, rollback.config.input_delay, NETPLAY_WINDOW / 2);
+        return false;
+    }
+
+    char port[8];
+    snprintf(port, sizeof(port), "%u", config->remote_port);
+
+    struct addrinfo hints = { .ai_family = AF_INET, .ai_socktype = SOCK_DGRAM };
+    struct addrinfo *remote = NULL;
+    if (getaddrinfo(config->remote_host, port, &hints, &remote) != 0) {
+        logf_error("Unable to resolve netplay peer %s\n", config->remote_host);
+        return false;
+    }
+
+    struct sockaddr_in local = { .sin_family = AF_INET, .sin_port = htons(config->local_port), .sin_addr.s_addr = htonl(INADDR_ANY) };
+
+    rollback.socket = socket(AF_INET, SOCK_DGRAM, 0);
+    bool connected = rollback.socket >= 0
+            && bind(rollback.socket, (struct sockaddr *)&local, sizeof(local)) == 0
+            && connect(rollback.socket, remote->ai_addr, remote->ai_addrlen) == 0
+            && fcntl(rollback.socket, F_SETFL, O_NONBLOCK) == 0;
+    freeaddrinfo(remote);
+
+    if (!connected) {
+        logf_error("Unable to open netplay socket on port %u to %s:%u\n", config->local_port, config->remote_host, config->remote_port);
+        if (rollback.socket >= 0) {
+            close(rollback.socket);
+            rollback.socket = -1;
+        }
+        return false;
+    }
+
+    // Hashes are exchanged for every confirmed frame
+    state_hash_open();
+    netplay.player = config->player;
+    netplay.enabled = true;
+    return true;
+}
+
+void netplay_close() {
+    if (!netplay.enabled) return;
+
+    for (int i = 0; i < NETPLAY_WINDOW; i++) {
+        if (rollback.nodes[i] != NULL) {
+            fork_release(rollback.nodes[i]);
+            rollback.nodes[i] = NULL;
+        }
+    }
+    fork_close();
+
+    close(rollback.socket);
+    rollback.socket = -1;
+    netplay.enabled = false;
+}
+
+
+bool netplay_frame(uint8_t buttons) {
+    exchange();
+
+    // Beyond the rollback limit there are no snapshots to go back to, and local input
+    // is overwritten a window after it was sampled, so both wait on the peer
+    uint64_t sampled = netplay.frame + rollback.config.input_delay;
+    if (netplay.frame >= netplay.remote_frames + rollback.config.max_rollback || sampled >= netplay.acknowledged + NETPLAY_WINDOW) {
+        netplay.stalls++;
+        transmit();
+        return false;
+    }
+
+    rollback.local[sampled % NETPLAY_WINDOW] = buttons;
+    run_input_frame(netplay.frame);
+    netplay.frame++;
+
+    transmit();
+    return true;
+}
+
+void netplay_poll() {
+    exchange();
+    transmit();
+}
+
+uint64_t netplay_confirmed() {
+    return netplay.remote_frames < netplay.frame ? netplay.remote_frames : netplay.frame;
+}
@@ -0,0 +1,87 @@
+#ifndef NETPLAY_H
+#define NETPLAY_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "cnes.h"
+
+// Two-player rollback netplay over UDP. Each peer runs the whole machine. The local
+// controller is known at once, and the remote one is predicted to hold its last known
+// buttons. A copy-on-write fork node is captured before every frame. When the remote
+// input for a frame arrives and differs from the prediction, the machine is restored
+// to that frame and every frame since is run again. This happens within the same call,
+// and only the newest of the frames run again is drawn.
+//
+// Every packet carries all the local input the peer has not acknowledged yet, so a
+// lost packet only costs time. It also carries the state hash of the newest frame
+// whose input is fully known. Each side compares that hash with its own to detect a
+// desync. Both peers need the same ROM and engine.
+//
+// Latency, jitter and loss can be simulated on the sending side, so two processes on
+// one machine can test the whole thing over the loopback interface.
+
+// Frames of input, snapshots and hashes kept, which bounds max_rollback and input_delay
+#define NETPLAY_WINDOW 64
+
+#define NETPLAY_DEFAULT_ROLLBACK 8
+
+struct netplay_config {
+    // 0 or 1, the controller port played locally, the peer plays the other
+    int player;
+
+    uint16_t local_port;
+    const char *remote_host;
+    uint16_t remote_port;
+
+    // Frames that can run ahead of the remote input before waiting for it, 0 for the default
+    int max_rollback;
+
+    // Frames between sampling local input and using it, which hides that much latency
+    int input_delay;
+
+    // Simulated on every packet sent
+    int latency_ms;
+    int jitter_ms;
+    double loss;
+    uint64_t seed;
+};
+
+struct netplay {
+    bool enabled;
+    int player;
+
+    // The next frame to run, and how many frames the remote input is known for
+    uint64_t frame;
+    uint64_t remote_frames;
+
+    // How many frames of local input the peer has acknowledged
+    uint64_t acknowledged;
+
+    uint64_t rollbacks;
+    uint64_t resimulated;
+    uint64_t deepest_rollback;
+    uint64_t stalls;
+
+    uint64_t sent;
+    uint64_t received;
+    uint64_t dropped;
+    uint64_t desyncs;
+};
+
+extern struct netplay netplay;
+
+// Starts from the machine as it is now, so both peers load the same ROM first
+CNES_API bool netplay_open(const struct netplay_config *config);
+CNES_API void netplay_close();
+
+// Takes the local buttons sampled this host frame and runs one frame. Returns false
+// without running anything while the remote input is too far behind.
+CNES_API bool netplay_frame(uint8_t buttons);
+
+// Sends and receives, rolling back if needed, without running a new frame
+CNES_API void netplay_poll();
+
+// Frames whose input is known on both sides and which have been run with it
+CNES_API uint64_t netplay_confirmed();
+
+#endif
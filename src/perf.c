@@ -0,0 +1,225 @@
+#define _GNU_SOURCE
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#include "nes.h"
+#include "perf.h"
+
+
+#define PERF_COUNTERS 5
+
+const char *PERF_SPAN_NAMES[PERF_SPANS] = {
+    [PERF_CPU]     = "cpu",
+    [PERF_PPU]     = "ppu",
+    [PERF_EXPORT]  = "export",
+    [PERF_CAPTURE] = "capture",
+    [PERF_PRESENT] = "present",
+};
+
+const struct {
+    const char *name;
+    uint32_t type;
+    uint64_t config;
+} PERF_EVENTS[PERF_COUNTERS] = {
+    { "cycles",        PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+    { "instructions",  PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+    { "branch_misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES },
+    { "l1d_misses",    PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16) },
+    { "llc_misses",    PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_LL | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16) },
+};
+
+
+struct sample {
+    uint64_t ns;
+
+    // How long the group was enabled and how long it was actually on the PMU. They
+    // differ when the kernel multiplexes more counters than the host has.
+    uint64_t enabled;
+    uint64_t running;
+
+    uint64_t counters[PERF_COUNTERS];
+};
+
+struct {
+    bool enabled;
+    FILE *csv;
+
+    // -1 when not open, fd 0 is stdin
+    int group;
+    int fds[PERF_COUNTERS];
+
+    // Position of each counter in the group read, -1 if the host does not support it
+    int slots[PERF_COUNTERS];
+    int opened;
+
+    uint64_t frame;
+    struct sample frame_start;
+    struct sample last;
+    struct sample spans[PERF_SPANS];
+} perf = { .group = -1, .fds = { -1, -1, -1, -1, -1 }, .slots = { -1, -1, -1, -1, -1 } };
+
+
+static long perf_event_open(struct perf_event_attr *attr, int group) {
+    return syscall(__NR_perf_event_open, attr, 0, -1, group, 0);
+}
+
+static void perf_read(struct sample *sample) {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    sample->ns = (uint64_t)t.tv_sec * 1000000000 + t.tv_nsec;
+
+    // The group read: the number of counters, time enabled, time running, then the values
+    uint64_t values[3 + PERF_COUNTERS] = { 0 };
+    if (read(perf.group, values, sizeof(values)) < 0) {
+        memset(values, 0, sizeof(values));
+    }
+
+    sample->enabled = values[1];
+    sample->running = values[2];
+    for (int i = 0; i < PERF_COUNTERS; i++) {
+        sample->counters[i] = perf.slots[i] >= 0 ? values[3 + perf.slots[i]] : 0;
+    }
+}
+
+// Counts from a span the group was only partly scheduled for are scaled up to the whole
+// span, like perf stat does, and the row is flagged as estimated
+static void perf_accumulate(struct sample *total, const struct sample *from, const struct sample *to) {
+    uint64_t enabled = to->enabled - from->enabled;
+    uint64_t running = to->running - from->running;
+
+    total->ns += to->ns - from->ns;
+    total->enabled += enabled;
+    total->running += running;
+    for (int i = 0; i < PERF_COUNTERS; i++) {
+        uint64_t count = to->counters[i] - from->counters[i];
+        if (running > 0 && running < enabled) {
+            count = (uint64_t)((double)count * enabled / running);
+        }
+        total->counters[i] += count;
+    }
+}
+
+static void perf_write_row(const char *span, const struct sample *sample) {
+    fprintf(perf.csv, "%lu,%s,%lu", perf.frame, span, sample->ns);
+    for (int i = 0; i < PERF_COUNTERS; i++) {
+        if (perf.slots[i] >= 0) {
+            fprintf(perf.csv, ",%lu", sample->counters[i]);
+        } else {
+            fprintf(perf.csv, ",");
+        }
+    }
+    fprintf(perf.csv, ",%d\n", sample->running < sample->enabled);
+}
+
+
+bool perf_open(const char *filename) {
+    for (int i = 0; i < PERF_COUNTERS; i++) {
+        struct perf_event_attr attr = { 0 };
+        attr.size = sizeof(attr);
+        attr.type = PERF_EVENTS[i].type;
+        attr.config = PERF_EVENTS[i].config;
+        attr.disabled = perf.group < 0;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+        perf.fds[i] = perf_event_open(&attr, perf.group);
+        if (perf.fds[i] < 0) {
+            logf_warning("Hardware counter %s is unavailable\n", PERF_EVENTS[i].name);
+            perf.slots[i] = -1;
+            continue;
+        }
+
+        if (perf.group < 0) {
+            perf.group = perf.fds[i];
+        }
+        perf.slots[i] = perf.opened++;
+    }
+
+    if (perf.group < 0) {
+        log_warning("perf_event_open failed, check /proc/sys/kernel/perf_event_paranoid\n");
+        return false;
+    }
+
+    perf.csv = fopen(filename, "w");
+    if (perf.csv == NULL) {
+        logf_warning("Unable to open %s for writing\n", filename);
+        perf_close();
+        return false;
+    }
+
+    fprintf(perf.csv, "frame,span,ns");
+    for (int i = 0; i < PERF_COUNTERS; i++) {
+        fprintf(perf.csv, ",%s", PERF_EVENTS[i].name);
+    }
+    fprintf(perf.csv, ",scaled\n");
+
+    ioctl(perf.group, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+    ioctl(perf.group, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+
+    perf.enabled = true;
+    return true;
+}
+
+void perf_close() {
+    for (int i = 0; i < PERF_COUNTERS; i++) {
+        if (perf.fds[i] >= 0) {
+            close(perf.fds[i]);
+        }
+        perf.fds[i] = -1;
+        perf.slots[i] = -1;
+    }
+
+    if (perf.csv != NULL) {
+        fclose(perf.csv);
+        perf.csv = NULL;
+    }
+
+    perf.group = -1;
+    perf.opened = 0;
+    perf.enabled = false;
+}
+
+void perf_begin_frame() {
+    if (!perf.enabled) {
+        return;
+    }
+
+    perf.frame = state.frames;
+    memset(perf.spans, 0, sizeof(perf.spans));
+    perf_read(&perf.frame_start);
+    perf.last = perf.frame_start;
+}
+
+void perf_end_span(enum perf_span span) {
+    if (!perf.enabled) {
+        return;
+    }
+
+    struct sample now;
+    perf_read(&now);
+    perf_accumulate(&perf.spans[span], &perf.last, &now);
+    perf.last = now;
+}
+
+void perf_end_frame() {
+    if (!perf.enabled) {
+        return;
+    }
+
+    struct sample frame = { 0 };
+    perf_accumulate(&frame, &perf.frame_start, &perf.last);
+
+    perf_write_row("frame", &frame);
+    for (int i = 0; i < PERF_SPANS; i++) {
+        perf_write_row(PERF_SPAN_NAMES[i], &perf.spans[i]);
+    }
+}
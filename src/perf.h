@@ -0,0 +1,26 @@
+#ifndef PERF_H
+#define PERF_H
+
+#include <stdbool.h>
+
+// Host hardware counters (perf_event_open) sampled around every emulated
+// frame and every subsystem step within it, written out as CSV. When the kernel
+// multiplexes the group, counts are scaled up and the row's scaled column is 1.
+
+enum perf_span {
+    PERF_CPU,
+    PERF_PPU,
+    PERF_EXPORT,
+    PERF_CAPTURE,
+    PERF_PRESENT,
+    PERF_SPANS,
+};
+
+bool perf_open(const char *filename);
+void perf_close();
+
+void perf_begin_frame();
+void perf_end_span(enum perf_span span);
+void perf_end_frame();
+
+#endif
@@ -0,0 +1,425 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include "nes.h"
+#include "ppu.h"
+
+
+#define TILE_COLUMNS 32
+#define TILE_ROWS 30
+#define ATTRIBUTES 0x3c0
+
+// PPUCTRL
+#define CTRL_INCREMENT 0x04
+#define CTRL_BACKGROUND_TABLE 0x10
+#define CTRL_NMI 0x80
+
+// PPUMASK
+#define MASK_GRAYSCALE 0x01
+#define MASK_LEFT_BACKGROUND 0x02
+#define MASK_BACKGROUND 0x08
+
+// What the framebuffer was last composed from
+struct composed {
+    uint8_t *framebuffer;
+    uint16_t t;
+    uint8_t fine_x;
+    uint8_t mask;
+    uint8_t palette[32];
+};
+
+struct {
+    bool valid;
+
+    // Every background pixel as a palette RAM offset, 0-15, one plane per physical nametable
+    uint8_t planes[2][PPU_HEIGHT][PPU_WIDTH];
+
+    // The nametables and pattern table the planes were decoded from
+    uint8_t nametables[0x800];
+    uint8_t background_table;
+    bool vertical;
+
+    // Tile columns decoded again this frame, one bit each, per tile row
+    uint32_t redrawn[2][TILE_ROWS];
+
+    struct composed composed;
+
+    // Rows composed and not taken yet, -1 for none
+    int first_row;
+    int last_row;
+} renderer = { .first_row = -1, .last_row = -1 };
+
+
+static bool vertical_mirroring() {
+    return cartridge.header.flags_6 & 0x01;
+}
+
+static int physical_nametable(int logical) {
+    return vertical_mirroring() ? logical & 1 : logical >> 1;
+}
+
+// Offset into the two physical nametables for $2000-$3EFF
+static uint16_t nametable_offset(uint16_t address) {
+    return physical_nametable((address >> 10) & 3) * 0x400 + (address & 0x3ff);
+}
+
+// $3F10, $3F14, $3F18 and $3F1C are the same bytes as $3F00, $3F04, $3F08 and $3F0C
+static uint8_t palette_offset(uint16_t address) {
+    uint8_t offset = address & 0x1f;
+    return (offset & 0x13) == 0x10 ? offset & 0x0f : offset;
+}
+
+static uint8_t pattern_byte(uint16_t address) {
+    return cartridge.header.chr_size > 0 ? cartridge.chr_rom[address & 0x1fff] : 0;
+}
+
+static uint8_t vram_read(struct ppu *ppu, uint16_t address) {
+    address &= 0x3fff;
+    if (address < 0x2000) {
+        return pattern_byte(address);
+    } else if (address < 0x3f00) {
+        return ppu->nametables[nametable_offset(address)];
+    }
+    return ppu->palette[palette_offset(address)];
+}
+
+// Batch lanes have PPUs of their own, only the machine's pages are tracked
+static void mark_written(const struct ppu *ppu, const uint8_t *memory) {
+    if (ppu == &nes.ppu) {
+        mark_ppu_written(memory);
+    }
+}
+
+// Pattern tables are CHR ROM, writes to them are dropped
+static void vram_write(struct ppu *ppu, uint16_t address, uint8_t data) {
+    address &= 0x3fff;
+    if (address >= 0x3f00) {
+        ppu->palette[palette_offset(address)] = data & 0x3f;
+        mark_written(ppu, ppu->palette);
+    } else if (address >= 0x2000) {
+        uint16_t offset = nametable_offset(address);
+        ppu->nametables[offset] = data;
+        mark_written(ppu, ppu->nametables + offset);
+    }
+}
+
+
+uint8_t ppu_read_register(struct ppu *ppu, uint16_t address) {
+    switch (address & 7) {
+        case 2: {
+            uint8_t status = (ppu->nmi_occured ? 0x80 : 0) | (ppu->latch & 0x1f);
+            ppu->nmi_occured = false;
+            ppu->w = false;
+            return status;
+        }
+        case 4:
+            return ppu->oam[ppu->oam_address];
+        case 7: {
+            // Reads lag one behind through a buffer, except palette reads, which buffer the nametable byte under them
+            uint16_t target = ppu->v & 0x3fff;
+            uint8_t data = ppu->read_buffer;
+            if (target >= 0x3f00) {
+                data = vram_read(ppu, target);
+                ppu->read_buffer = vram_read(ppu, target - 0x1000);
+            } else {
+                ppu->read_buffer = vram_read(ppu, target);
+            }
+            ppu->v += ppu->ctrl & CTRL_INCREMENT ? 32 : 1;
+            return data;
+        }
+        default:
+            return ppu->latch;
+    }
+}
+
+void ppu_write_register(struct ppu *ppu, uint16_t address, uint8_t data) {
+    ppu->latch = data;
+
+    switch (address & 7) {
+        case 0:
+            ppu->ctrl = data;
+            ppu->nmi_enabled = data & CTRL_NMI;
+            ppu->t = (ppu->t & ~0x0c00) | (data & 0x03) << 10;
+            break;
+        case 1:
+            ppu->mask = data;
+            break;
+        case 3:
+            ppu->oam_address = data;
+            break;
+        case 4:
+            ppu->oam[ppu->oam_address++] = data;
+            mark_written(ppu, ppu->oam);
+            break;
+        case 5:
+            if (!ppu->w) {
+                ppu->t = (ppu->t & ~0x001f) | data >> 3;
+                ppu->fine_x = data & 0x07;
+            } else {
+                ppu->t = (ppu->t & ~0x73e0) | (data & 0x07) << 12 | (data & 0xf8) << 2;
+            }
+            ppu->w = !ppu->w;
+            break;
+        case 6:
+            if (!ppu->w) {
+                ppu->t = (ppu->t & 0x00ff) | (data & 0x3f) << 8;
+            } else {
+                ppu->t = (ppu->t & 0xff00) | data;
+                ppu->v = ppu->t;
+            }
+            ppu->w = !ppu->w;
+            break;
+        case 7:
+            vram_write(ppu, ppu->v, data);
+            ppu->v += ppu->ctrl & CTRL_INCREMENT ? 32 : 1;
+            break;
+    }
+}
+
+uint8_t ppu_peek_register(const struct ppu *ppu, uint16_t address) {
+    switch (address & 7) {
+        case 2:
+            return (ppu->nmi_occured ? 0x80 : 0) | (ppu->latch & 0x1f);
+        case 4:
+            return ppu->oam[ppu->oam_address];
+        case 7:
+            return (ppu->v & 0x3fff) >= 0x3f00 ? ppu->palette[palette_offset(ppu->v)] : ppu->read_buffer;
+        default:
+            return ppu->latch;
+    }
+}
+
+bool ppu_start_vblank(struct ppu *ppu) {
+    ppu->nmi_occured = true;
+    return ppu->nmi_enabled;
+}
+
+void ppu_end_vblank(struct ppu *ppu) {
+    ppu->nmi_occured = false;
+}
+
+uint16_t ppu_data_address(const struct ppu *ppu) {
+    return ppu->v & 0x3fff;
+}
+
+
+void ppu_invalidate() {
+    renderer.valid = false;
+}
+
+// Marks the tiles whose name or attribute byte differs from what the plane was drawn from
+static void find_changed_tiles(int plane) {
+    const uint8_t *now = nes.ppu.nametables + plane * 0x400;
+    const uint8_t *drawn = renderer.nametables + plane * 0x400;
+    if (memcmp(now, drawn, 0x400) == 0) return;
+
+    for (int row = 0; row < TILE_ROWS; row++) {
+        const uint8_t *names = now + row * TILE_COLUMNS;
+        if (memcmp(names, drawn + row * TILE_COLUMNS, TILE_COLUMNS) == 0) continue;
+
+        for (int column = 0; column < TILE_COLUMNS; column++) {
+            if (names[column] != drawn[row * TILE_COLUMNS + column]) {
+                renderer.redrawn[plane][row] |= 1u << column;
+            }
+        }
+    }
+
+    // Each attribute byte colours a block of 4x4 tiles
+    for (int i = 0; i < 64; i++) {
+        if (now[ATTRIBUTES + i] == drawn[ATTRIBUTES + i]) continue;
+
+        int top = (i / 8) * 4;
+        uint32_t columns = 0x0fu << (i % 8) * 4;
+        for (int row = top; row < top + 4 && row < TILE_ROWS; row++) {
+            renderer.redrawn[plane][row] |= columns;
+        }
+    }
+}
+
+static void decode_tile(int plane, int row, int column) {
+    const uint8_t *nametable = nes.ppu.nametables + plane * 0x400;
+    uint8_t name = nametable[row * TILE_COLUMNS + column];
+    uint8_t attribute = nametable[ATTRIBUTES + (row / 4) * 8 + column / 4];
+    int shift = (row & 2) * 2 + (column & 2);
+    uint8_t palette = (attribute >> shift & 0x03) << 2;
+
+    uint16_t pattern = (renderer.background_table ? 0x1000 : 0) + name * 16;
+    for (int y = 0; y < 8; y++) {
+        uint8_t low = pattern_byte(pattern + y);
+        uint8_t high = pattern_byte(pattern + y + 8);
+        uint8_t *pixels = &renderer.planes[plane][row * 8 + y][column * 8];
+
+        for (int x = 0; x < 8; x++) {
+            uint8_t color = (low >> (7 - x) & 1) | (high >> (7 - x) & 1) << 1;
+            pixels[x] = color != 0 ? palette | color : 0;
+        }
+    }
+}
+
+static void decode_changed_tiles() {
+    uint8_t background_table = nes.ppu.ctrl & CTRL_BACKGROUND_TABLE;
+    bool everything = !renderer.valid || background_table != renderer.background_table || vertical_mirroring() != renderer.vertical;
+
+    renderer.background_table = background_table;
+    renderer.vertical = vertical_mirroring();
+
+    for (int plane = 0; plane < 2; plane++) {
+        if (everything) {
+            for (int row = 0; row < TILE_ROWS; row++) {
+                renderer.redrawn[plane][row] = UINT32_MAX;
+            }
+        } else {
+            find_changed_tiles(plane);
+        }
+
+        for (int row = 0; row < TILE_ROWS; row++) {
+            for (uint32_t columns = renderer.redrawn[plane][row]; columns != 0; columns &= columns - 1) {
+                decode_tile(plane, row, __builtin_ctz(columns));
+            }
+        }
+    }
+
+    memcpy(renderer.nametables, nes.ppu.nametables, sizeof(renderer.nametables));
+}
+
+// Whether screen row y shows a tile decoded again this frame
+static bool row_redrawn(int y, int scroll_x, int scroll_y) {
+    int world_y = (scroll_y + y) % (2 * PPU_HEIGHT);
+    int tile_row = (world_y % PPU_HEIGHT) / 8;
+    int logical_row = (world_y / PPU_HEIGHT) * 2;
+
+    // The row shows both horizontal nametables unless it is scrolled exactly onto one
+    int start = scroll_x / PPU_WIDTH;
+    int count = scroll_x % PPU_WIDTH != 0 ? 2 : 1;
+    for (int i = 0; i < count; i++) {
+        if (renderer.redrawn[physical_nametable(logical_row + ((start + i) & 1))][tile_row] != 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static void compose_row(uint8_t *out, int y, int scroll_x, int scroll_y) {
+    const struct ppu *ppu = &nes.ppu;
+    uint8_t gray = ppu->mask & MASK_GRAYSCALE ? 0x30 : 0x3f;
+    uint8_t backdrop = ppu->palette[0] & gray;
+
+    if (!(ppu->mask & MASK_BACKGROUND)) {
+        memset(out, backdrop, PPU_WIDTH);
+        return;
+    }
+
+    int world_y = (scroll_y + y) % (2 * PPU_HEIGHT);
+    int logical_row = (world_y / PPU_HEIGHT) * 2;
+
+    for (int x = 0; x < PPU_WIDTH;) {
+        int world_x = (scroll_x + x) % (2 * PPU_WIDTH);
+        int plane = physical_nametable(logical_row + world_x / PPU_WIDTH);
+
+        // Up to the edge of this nametable in one go
+        int span = PPU_WIDTH - world_x % PPU_WIDTH;
+        if (span > PPU_WIDTH - x) span = PPU_WIDTH - x;
+
+        const uint8_t *pixels = &renderer.planes[plane][world_y % PPU_HEIGHT][world_x % PPU_WIDTH];
+        for (int i = 0; i < span; i++) {
+            out[x + i] = ppu->palette[pixels[i]] & gray;
+        }
+        x += span;
+    }
+
+    if (!(ppu->mask & MASK_LEFT_BACKGROUND)) {
+        memset(out, backdrop, 8);
+    }
+}
+
+// Where the top left pixel of the picture is in the 512x480 world of four nametables
+static void scroll_position(const struct ppu *ppu, int *scroll_x, int *scroll_y) {
+    *scroll_x = ((ppu->t >> 10) & 1) * PPU_WIDTH + (ppu->t & 0x1f) * 8 + ppu->fine_x;
+    *scroll_y = ((ppu->t >> 11) & 1) * PPU_HEIGHT + ((ppu->t >> 5) & 0x1f) * 8 + ((ppu->t >> 12) & 7);
+}
+
+void ppu_render() {
+    struct ppu *ppu = &nes.ppu;
+    if (ppu->framebuffer == NULL) return;
+
+    for (int plane = 0; plane < 2; plane++) {
+        memset(renderer.redrawn[plane], 0, sizeof(renderer.redrawn[plane]));
+    }
+    decode_changed_tiles();
+
+    // Cleared first so the padding compares equal too
+    struct composed now;
+    memset(&now, 0, sizeof(now));
+    now.framebuffer = ppu->framebuffer;
+    now.t = ppu->t;
+    now.fine_x = ppu->fine_x;
+    now.mask = ppu->mask;
+    memcpy(now.palette, ppu->palette, sizeof(now.palette));
+    bool everything = !renderer.valid || memcmp(&now, &renderer.composed, sizeof(now)) != 0;
+
+    int scroll_x, scroll_y;
+    scroll_position(ppu, &scroll_x, &scroll_y);
+
+    for (int y = 0; y < PPU_HEIGHT; y++) {
+        if (!everything && !row_redrawn(y, scroll_x, scroll_y)) continue;
+
+        compose_row(ppu->framebuffer + y * PPU_WIDTH, y, scroll_x, scroll_y);
+        if (renderer.first_row < 0 || y < renderer.first_row) renderer.first_row = y;
+        if (y > renderer.last_row) renderer.last_row = y;
+    }
+
+    renderer.composed = now;
+    renderer.valid = true;
+}
+
+// One pixel of the background decoded from the nametables, as a palette RAM offset
+static uint8_t background_pixel(const struct ppu *ppu, int world_x, int world_y) {
+    const uint8_t *nametable = ppu->nametables + physical_nametable((world_y / PPU_HEIGHT) * 2 + world_x / PPU_WIDTH) * 0x400;
+    int x = world_x % PPU_WIDTH;
+    int y = world_y % PPU_HEIGHT;
+    int row = y / 8;
+    int column = x / 8;
+
+    uint8_t name = nametable[row * TILE_COLUMNS + column];
+    uint16_t pattern = (ppu->ctrl & CTRL_BACKGROUND_TABLE ? 0x1000 : 0) + name * 16 + y % 8;
+    int bit = 7 - x % 8;
+    uint8_t color = (pattern_byte(pattern) >> bit & 1) | (pattern_byte(pattern + 8) >> bit & 1) << 1;
+    if (color == 0) return 0;
+
+    uint8_t attribute = nametable[ATTRIBUTES + (row / 4) * 8 + column / 4];
+    int shift = (row & 2) * 2 + (column & 2);
+    return (attribute >> shift & 0x03) << 2 | color;
+}
+
+void ppu_draw(const struct ppu *ppu, uint8_t *out, int step) {
+    uint8_t gray = ppu->mask & MASK_GRAYSCALE ? 0x30 : 0x3f;
+    uint8_t backdrop = ppu->palette[0] & gray;
+    int width = (PPU_WIDTH + step - 1) / step;
+    int height = (PPU_HEIGHT + step - 1) / step;
+
+    if (!(ppu->mask & MASK_BACKGROUND)) {
+        memset(out, backdrop, width * height);
+        return;
+    }
+
+    int scroll_x, scroll_y;
+    scroll_position(ppu, &scroll_x, &scroll_y);
+
+    for (int y = 0; y < height; y++) {
+        int world_y = (scroll_y + y * step) % (2 * PPU_HEIGHT);
+
+        for (int x = 0; x < width; x++) {
+            bool hidden = x * step < 8 && !(ppu->mask & MASK_LEFT_BACKGROUND);
+            int world_x = (scroll_x + x * step) % (2 * PPU_WIDTH);
+            *out++ = hidden ? backdrop : ppu->palette[background_pixel(ppu, world_x, world_y)] & gray;
+        }
+    }
+}
+
+bool ppu_take_changed_rows(int *first, int *last) {
+    *first = renderer.first_row;
+    *last = renderer.last_row;
+    renderer.first_row = -1;
+    renderer.last_row = -1;
+    return *first >= 0;
+}
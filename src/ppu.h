@@ -0,0 +1,90 @@
+#ifndef PPU_H
+#define PPU_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// The PPU with frame granularity. The registers at $2000-$3FFF behave as on hardware,
+// and the vertical blank flag and NMI come at the end of every frame. The flag is cleared
+// again CPU_CYCLES_PER_VBLANK into the next frame, at the first instruction boundary. Nothing depends
+// on where in the frame an access lands, so every CPU engine sees the same PPU. The
+// background is drawn once a frame, as vertical blank starts, with the scroll and
+// palette as they are then. Sprites, CHR RAM, raster effects and the OAM DMA stall are
+// not emulated yet.
+//
+// Drawing only redoes what changed. Background tiles are decoded into a cache per
+// physical nametable. Comparing the nametables with a copy taken when they were drawn
+// finds the tiles whose name or attribute byte changed, and a change of pattern table
+// redoes them all. The framebuffer is composed from the cache again only on rows that
+// show a redone tile, or everywhere when the scroll, palette or mask changed. The rows
+// composed are collected until taken, so a frontend converts and uploads only those,
+// even when frames it never showed were run in between.
+
+// The picture, in pixels
+#define PPU_WIDTH 256
+#define PPU_HEIGHT 240
+
+struct ppu {
+    // The vertical blank flag, cleared by reading PPUSTATUS, and PPUCTRL bit 7
+    bool nmi_occured;
+    bool nmi_enabled;
+
+    uint8_t ctrl;
+    uint8_t mask;
+    uint8_t oam_address;
+
+    // The last value written to any register, read back from write-only registers and
+    // as the low bits of PPUSTATUS
+    uint8_t latch;
+    uint8_t read_buffer;
+
+    // The VRAM address, the address the scroll and address writes build up, fine X
+    // scroll and the toggle between first and second writes
+    uint16_t v;
+    uint16_t t;
+    uint8_t fine_x;
+    bool w;
+
+    // One palette index per pixel, PPU_WIDTH * PPU_HEIGHT
+    uint8_t *framebuffer;
+
+    // Memory comes last, in whole pages the dirty page trackers follow like RAM: two
+    // physical nametables, mirrored as the cartridge's flags 6 say, then OAM, then the
+    // palette padded out to a page
+    uint8_t nametables[0x800];
+    uint8_t oam[256];
+    uint8_t palette[32];
+    uint8_t palette_padding[256 - 32];
+};
+
+// For the machine and for each batch lane, the cartridge supplies the pattern tables
+uint8_t ppu_read_register(struct ppu *ppu, uint16_t address);
+void ppu_write_register(struct ppu *ppu, uint16_t address, uint8_t data);
+
+// What a read would return, without clearing the flag or moving the VRAM address
+uint8_t ppu_peek_register(const struct ppu *ppu, uint16_t address);
+
+// Sets the vertical blank flag, returns whether that raises an NMI
+bool ppu_start_vblank(struct ppu *ppu);
+
+// Clears the vertical blank flag at the pre-render line
+void ppu_end_vblank(struct ppu *ppu);
+
+// The VRAM address the next PPUDATA access goes to, for the debugger
+uint16_t ppu_data_address(const struct ppu *ppu);
+
+// Brings the machine's framebuffer up to date
+void ppu_render();
+
+// Draws a PPU's background straight from its nametables, without the tile cache, as
+// one palette index for every step'th pixel across and down. That is PPU_WIDTH / step by
+// PPU_HEIGHT / step pixels, rounded up. For batch lanes, whose PPUs have no framebuffer.
+void ppu_draw(const struct ppu *ppu, uint8_t *out, int step);
+
+// Forgets the tile cache, for a new cartridge
+void ppu_invalidate();
+
+// The band of framebuffer rows composed since the last call, false when there were none
+bool ppu_take_changed_rows(int *first, int *last);
+
+#endif
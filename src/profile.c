@@ -0,0 +1,170 @@
+#define _POSIX_C_SOURCE 199309L
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+#include "nes.h"
+#include "engine.h"
+#include "profile.h"
+
+
+const char *PROFILE_REPORT = "cnes-profile.txt";
+
+const int PROFILE_TOP_OPCODES = 20;
+const int PROFILE_TOP_ADDRESSES = 32;
+
+// Histogram buckets are 1ms wide, the last one collects everything slower
+const uint64_t PROFILE_BUCKET_NS = 1000000;
+
+
+struct profile profile = { 0 };
+
+
+static uint64_t profile_now() {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (uint64_t)t.tv_sec * 1000000000 + t.tv_nsec;
+}
+
+void profile_frame_begin() {
+    profile.frame_start = profile_now();
+}
+
+void profile_frame_end() {
+    uint64_t elapsed = profile_now() - profile.frame_start;
+
+    uint64_t bucket = elapsed / PROFILE_BUCKET_NS;
+    if (bucket >= PROFILE_HISTOGRAM_BUCKETS) {
+        bucket = PROFILE_HISTOGRAM_BUCKETS - 1;
+    }
+
+    profile.histogram[bucket]++;
+    profile.frames++;
+    profile.frame_time_total += elapsed;
+    if (elapsed > profile.frame_time_max) {
+        profile.frame_time_max = elapsed;
+    }
+}
+
+
+static int compare_opcodes(const void *a, const void *b) {
+    uint64_t count_a = profile.opcodes[*(const uint8_t *)a];
+    uint64_t count_b = profile.opcodes[*(const uint8_t *)b];
+    return (count_a < count_b) - (count_a > count_b);
+}
+
+static int compare_addresses(const void *a, const void *b) {
+    uint64_t count_a = profile.addresses[*(const uint16_t *)a];
+    uint64_t count_b = profile.addresses[*(const uint16_t *)b];
+    return (count_a < count_b) - (count_a > count_b);
+}
+
+// Static disassembly: unlike print_next_instruction() this does not depend on the current registers
+static void disassemble(FILE *f, uint16_t address) {
+    uint8_t opcode = cpu_read_8(address);
+    enum instruction_name name = INSTRUCTION_LOOKUP[opcode];
+    enum address_mode mode = ADDRESS_MODE_LOOKUP[opcode];
+
+    if (name == INSTRUCTION_NONE) {
+        fprintf(f, "%02X        ???", opcode);
+        return;
+    }
+
+    uint16_t length = instruction_length(mode);
+    for (int i = 0; i < 3; i++) {
+        if (i < length) {
+            fprintf(f, "%02X ", cpu_read_8(address + i));
+        } else {
+            fprintf(f, "   ");
+        }
+    }
+
+    fprintf(f, " %s %-16s", INSTRUCTION_NAME_STRING[name], ADDRESS_MODE_STRING[mode]);
+
+    if (mode == RELATIVE) {
+        fprintf(f, " $%04X", (uint16_t)(address + 2 + (int8_t)cpu_read_8(address + 1)));
+    } else if (length == 2) {
+        fprintf(f, " $%02X", cpu_read_8(address + 1));
+    } else if (length == 3) {
+        fprintf(f, " $%04X", cpu_read_16(address + 1));
+    }
+}
+
+void profile_report() {
+    FILE *f = fopen(PROFILE_REPORT, "w");
+    if (f == NULL) {
+        logf_warning("Unable to write profile report to %s\n", PROFILE_REPORT);
+        return;
+    }
+
+    uint64_t total = 0;
+    for (int i = 0; i < 256; i++) {
+        total += profile.opcodes[i];
+    }
+
+    fprintf(f, "Instructions: %lu\n", total);
+    fprintf(f, "Cycles: %lu\n", nes.cpu.cycles);
+    fprintf(f, "Frames: %lu\n", profile.frames);
+    fprintf(f, "Engine: %s", ENGINES[0].name);
+    if (current_engine != &ENGINES[0]) {
+        fprintf(f, ", %s was bypassed to count every instruction", current_engine->name);
+    }
+    fprintf(f, "\n\n");
+
+    uint8_t opcodes[256];
+    for (int i = 0; i < 256; i++) {
+        opcodes[i] = i;
+    }
+    qsort(opcodes, 256, sizeof(opcodes[0]), compare_opcodes);
+
+    fprintf(f, "Top opcodes:\n");
+    for (int i = 0; i < PROFILE_TOP_OPCODES && profile.opcodes[opcodes[i]] != 0; i++) {
+        uint8_t opcode = opcodes[i];
+        fprintf(f, "  $%02X %s %-16s %12lu %6.2f%%\n", opcode,
+                INSTRUCTION_NAME_STRING[INSTRUCTION_LOOKUP[opcode]],
+                ADDRESS_MODE_STRING[ADDRESS_MODE_LOOKUP[opcode]],
+                profile.opcodes[opcode], 100.0 * profile.opcodes[opcode] / total);
+    }
+
+    uint16_t *addresses = malloc(0x10000 * sizeof(uint16_t));
+    if (addresses != NULL) {
+        for (int i = 0; i < 0x10000; i++) {
+            addresses[i] = i;
+        }
+        qsort(addresses, 0x10000, sizeof(addresses[0]), compare_addresses);
+
+        fprintf(f, "\nHot addresses:\n");
+        for (int i = 0; i < PROFILE_TOP_ADDRESSES && profile.addresses[addresses[i]] != 0; i++) {
+            uint16_t address = addresses[i];
+            fprintf(f, "  $%04X %12lu %6.2f%%  ", address, profile.addresses[address], 100.0 * profile.addresses[address] / total);
+            disassemble(f, address);
+            fprintf(f, "\n");
+        }
+
+        free(addresses);
+    }
+
+    if (profile.frames > 0) {
+        fprintf(f, "\nFrame time: mean %.3fms, max %.3fms\n",
+                profile.frame_time_total / 1e6 / profile.frames, profile.frame_time_max / 1e6);
+
+        for (int i = 0; i < PROFILE_HISTOGRAM_BUCKETS; i++) {
+            if (profile.histogram[i] == 0) {
+                continue;
+            }
+
+            if (i == PROFILE_HISTOGRAM_BUCKETS - 1) {
+                fprintf(f, "  >=%2dms ", i);
+            } else {
+                fprintf(f, "  %2d-%2dms", i, i + 1);
+            }
+
+            int width = 50 * profile.histogram[i] / profile.frames;
+            fprintf(f, " %8lu |%.*s\n", profile.histogram[i], width, "##################################################");
+        }
+    }
+
+    fclose(f);
+    logf_info("Wrote profile report to %s\n", PROFILE_REPORT);
+}
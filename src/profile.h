@@ -0,0 +1,43 @@
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include <stdint.h>
+
+// Profiling is compiled in with -DCNES_PROFILE (make PROFILE=1); otherwise
+// every hook below expands to nothing.
+#ifdef CNES_PROFILE
+
+#define PROFILE_HISTOGRAM_BUCKETS 34
+
+struct profile {
+    uint64_t opcodes[256];
+    uint64_t addresses[0x10000];
+
+    uint64_t frame_start;
+    uint64_t frames;
+    uint64_t frame_time_total;
+    uint64_t frame_time_max;
+    uint64_t histogram[PROFILE_HISTOGRAM_BUCKETS];
+};
+
+extern struct profile profile;
+
+#define profile_instruction(pc, opcode) do { profile.opcodes[opcode]++; profile.addresses[pc]++; } while (0)
+
+// The counters live in execute_next(), so run_frame() stays on it whatever --engine says
+#define profile_enabled() true
+
+void profile_frame_begin();
+void profile_frame_end();
+void profile_report();
+
+#else
+
+#define profile_instruction(pc, opcode) do { } while (0)
+#define profile_enabled() false
+#define profile_frame_begin() do { } while (0)
+#define profile_frame_end() do { } while (0)
+
+#endif
+
+#endif
@@ -0,0 +1,299 @@
+#include <stdbool.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/wait.h>
+#include "nes.h"
+#include "engine.h"
+#include "hash.h"
+#include "workers.h"
+
+
+#define REGRESS_PATH_LENGTH 1024
+#define REGRESS_MESSAGE_LENGTH (2 * REGRESS_PATH_LENGTH)
+
+
+enum verdict {
+    VERDICT_PENDING,
+    VERDICT_PASS,
+    VERDICT_RECORDED,
+    VERDICT_DIVERGED,
+    VERDICT_ERROR,
+};
+
+const char *VERDICT_STRING[] = {
+    [VERDICT_PENDING]  = "CRASH",
+    [VERDICT_PASS]     = "PASS",
+    [VERDICT_RECORDED] = "RECORDED",
+    [VERDICT_DIVERGED] = "FAIL",
+    [VERDICT_ERROR]    = "ERROR",
+};
+
+// One line of the manifest: <rom> <movie or -> <frames> <golden hashes>
+struct test {
+    char rom[REGRESS_PATH_LENGTH];
+    char movie[REGRESS_PATH_LENGTH];
+    char golden[REGRESS_PATH_LENGTH];
+    long frames;
+};
+
+struct outcome {
+    enum verdict verdict;
+    long frame;
+    uint64_t expected;
+    uint64_t actual;
+    char message[REGRESS_MESSAGE_LENGTH];
+};
+
+struct {
+    bool record;
+    bool verbose;
+    const char *out;
+    int jobs;
+} options = { .out = ".", .jobs = 0 };
+
+// Lives in shared memory so forked workers can report back
+struct outcome *outcomes = NULL;
+
+
+// fm2 input lines look like '|0|RLDUTSBA|RLDUTSBA||' with '.' for released buttons
+uint8_t parse_fm2_buttons(const char *field) {
+    uint8_t buttons = 0;
+    for (int i = 0; i < 8 && field[i] != '\0' && field[i] != '|'; i++) {
+        if (field[i] != '.' && field[i] != ' ') {
+            buttons |= 1 << (7 - i);
+        }
+    }
+    return buttons;
+}
+
+bool next_movie_frame(FILE *movie, uint8_t *port_0, uint8_t *port_1) {
+    char line[256];
+
+    while (fgets(line, sizeof(line), movie) != NULL) {
+        if (line[0] != '|') {
+            continue;
+        }
+
+        char *field = strchr(line + 1, '|');
+        if (field == NULL) {
+            continue;
+        }
+
+        *port_0 = parse_fm2_buttons(field + 1);
+
+        field = strchr(field + 1, '|');
+        *port_1 = field != NULL ? parse_fm2_buttons(field + 1) : 0;
+
+        return true;
+    }
+
+    return false;
+}
+
+// What the player sees, the PPU draws the framebuffer as each frame ends
+uint64_t hash_frame() {
+    return hash_bytes(nes.ppu.framebuffer, SCREEN_WIDTH * SCREEN_HEIGHT, 0);
+}
+
+void write_ppm(const char *filename) {
+    FILE *f = fopen(filename, "wb");
+    if (f == NULL) {
+        return;
+    }
+
+    fprintf(f, "P6\n%u %u\n255\n", SCREEN_WIDTH, SCREEN_HEIGHT);
+    for (uint32_t i = 0; i < SCREEN_WIDTH * SCREEN_HEIGHT; i++) {
+        fwrite(PALETTE[nes.ppu.framebuffer[i] & 0x3f], 3, 1, f);
+    }
+
+    fclose(f);
+}
+
+const char *basename_of(const char *path) {
+    const char *slash = strrchr(path, '/');
+    return slash != NULL ? slash + 1 : path;
+}
+
+void run_test(const struct test *test, struct outcome *outcome) {
+    state.filedata = read_file(test->rom, &state.filesize);
+    if (state.filedata == NULL) {
+        snprintf(outcome->message, sizeof(outcome->message), "unable to read %s", test->rom);
+        outcome->verdict = VERDICT_ERROR;
+        return;
+    }
+
+    if (!load_cartridge()) {
+        snprintf(outcome->message, sizeof(outcome->message), "invalid iNES image %s", test->rom);
+        outcome->verdict = VERDICT_ERROR;
+        return;
+    }
+
+    init_memory();
+    poweron();
+
+    FILE *movie = NULL;
+    if (strcmp(test->movie, "-") != 0) {
+        movie = fopen(test->movie, "r");
+        if (movie == NULL) {
+            snprintf(outcome->message, sizeof(outcome->message), "unable to read %s", test->movie);
+            outcome->verdict = VERDICT_ERROR;
+            return;
+        }
+    }
+
+    FILE *golden = fopen(test->golden, options.record ? "w" : "r");
+    if (golden == NULL) {
+        snprintf(outcome->message, sizeof(outcome->message), "unable to open %s", test->golden);
+        outcome->verdict = VERDICT_ERROR;
+        return;
+    }
+
+    uint8_t port_0 = 0, port_1 = 0;
+
+    for (long frame = 0; frame < test->frames; frame++) {
+        if (movie != NULL && !next_movie_frame(movie, &port_0, &port_1)) {
+            port_0 = port_1 = 0;
+        }
+        set_buttons(0, port_0);
+        set_buttons(1, port_1);
+
+        run_frame();
+        uint64_t hash = hash_frame();
+
+        if (options.record) {
+            fprintf(golden, "%016lx\n", hash);
+            continue;
+        }
+
+        unsigned long expected;
+        if (fscanf(golden, "%lx", &expected) != 1) {
+            snprintf(outcome->message, sizeof(outcome->message), "golden list ends at frame %ld", frame);
+            outcome->verdict = VERDICT_ERROR;
+            return;
+        }
+
+        if (hash != expected) {
+            char filename[REGRESS_PATH_LENGTH + 64];
+            snprintf(filename, sizeof(filename), "%s/%s.frame%ld.ppm", options.out, basename_of(test->rom), frame);
+            write_ppm(filename);
+
+            outcome->frame = frame;
+            outcome->expected = expected;
+            outcome->actual = hash;
+            snprintf(outcome->message, sizeof(outcome->message), "dumped %s", filename);
+            outcome->verdict = VERDICT_DIVERGED;
+            return;
+        }
+    }
+
+    fclose(golden);
+    if (movie != NULL) {
+        fclose(movie);
+    }
+
+    outcome->verdict = options.record ? VERDICT_RECORDED : VERDICT_PASS;
+}
+
+struct test *load_manifest(const char *filename, int *count) {
+    FILE *f = fopen(filename, "r");
+    if (f == NULL) {
+        fprintf(stderr, "Unable to open manifest %s\n", filename);
+        exit(EXIT_FAILURE);
+    }
+
+    struct test *tests = NULL;
+    *count = 0;
+
+    char line[4 * REGRESS_PATH_LENGTH];
+    while (fgets(line, sizeof(line), f) != NULL) {
+        struct test test = { 0 };
+        if (line[0] == '#' || sscanf(line, "%1023s %1023s %ld %1023s", test.rom, test.movie, &test.frames, test.golden) != 4) {
+            continue;
+        }
+
+        tests = realloc(tests, (*count + 1) * sizeof(struct test));
+        if (tests == NULL) {
+            fprintf(stderr, "Unable to allocate test list\n");
+            exit(EXIT_FAILURE);
+        }
+        tests[(*count)++] = test;
+    }
+
+    fclose(f);
+    return tests;
+}
+
+void run_job(int index, void *context) {
+    struct test *tests = context;
+    run_test(&tests[index], &outcomes[index]);
+}
+
+int main(int argc, char **argv) {
+    const char *manifest = NULL;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--record") == 0) {
+            options.record = true;
+        } else if (strcmp(argv[i], "--verbose") == 0) {
+            options.verbose = true;
+        } else if (strcmp(argv[i], "--jobs") == 0 && i + 1 < argc) {
+            options.jobs = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--out") == 0 && i + 1 < argc) {
+            options.out = argv[++i];
+        } else if (strcmp(argv[i], "--engine") == 0 && i + 1 < argc && find_engine(argv[i + 1]) != NULL) {
+            current_engine = find_engine(argv[++i]);
+        } else if (manifest == NULL && argv[i][0] != '-') {
+            manifest = argv[i];
+        } else {
+            manifest = NULL;
+            break;
+        }
+    }
+
+    if (manifest == NULL) {
+        fprintf(stderr, "Usage: %s [--record] [--jobs N] [--out DIR] [--engine NAME] [--verbose] MANIFEST\n", argv[0]);
+        fprintf(stderr, "Manifest lines: <rom> <fm2 movie or -> <frames> <golden hash list>\n");
+        exit(EXIT_FAILURE);
+    }
+
+    int count;
+    struct test *tests = load_manifest(manifest, &count);
+
+    outcomes = workers_shared(count * sizeof(struct outcome));
+    int *statuses = calloc(count + 1, sizeof(int));
+
+    workers_run(count, options.jobs, !options.verbose, run_job, tests, statuses);
+
+    for (int i = 0; i < count; i++) {
+        if (outcomes[i].verdict == VERDICT_PENDING) {
+            snprintf(outcomes[i].message, sizeof(outcomes[i].message), "emulator exited with status %d", WIFEXITED(statuses[i]) ? WEXITSTATUS(statuses[i]) : -1);
+        }
+    }
+
+    int failures = 0;
+    for (int i = 0; i < count; i++) {
+        const struct outcome *outcome = &outcomes[i];
+        printf("%-8s %s", VERDICT_STRING[outcome->verdict], tests[i].rom);
+
+        if (outcome->verdict == VERDICT_DIVERGED) {
+            printf(": frame %ld expected %016lx got %016lx", outcome->frame, outcome->expected, outcome->actual);
+        }
+        if (outcome->message[0] != '\0') {
+            printf(" (%s)", outcome->message);
+        }
+        printf("\n");
+
+        if (outcome->verdict != VERDICT_PASS && outcome->verdict != VERDICT_RECORDED) {
+            failures++;
+        }
+    }
+
+    printf("%d/%d passed\n", count - failures, count);
+
+    free(statuses);
+    free(tests);
+
+    return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,465 @@
+#include <stdbool.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "nes.h"
+#include "sampler.h"
+
+
+#define SAMPLER_MAX_DEPTH 256
+#define SAMPLER_NAME_LENGTH 64
+
+
+struct symbol {
+    uint16_t address;
+    uint32_t size;
+    char name[SAMPLER_NAME_LENGTH];
+};
+
+struct frame {
+    uint16_t target;
+    uint8_t s;
+};
+
+// Open addressing string -> count table used for both folded stacks and flat totals
+struct counter {
+    char *key;
+    uint64_t self;
+    uint64_t total;
+};
+
+struct counters {
+    struct counter *entries;
+    uint32_t capacity;
+    uint32_t count;
+};
+
+struct sampler sampler = { .next = UINT64_MAX };
+
+struct {
+    const char *prefix;
+    uint64_t interval;
+    uint64_t samples;
+
+    struct symbol *symbols;
+    uint32_t symbol_count;
+
+    struct frame stack[SAMPLER_MAX_DEPTH];
+    int depth;
+
+    struct counters stacks;
+    struct counters functions;
+} profiler = { 0 };
+
+
+static uint32_t hash_string(const char *s) {
+    uint32_t hash = 2166136261u;
+    while (*s) {
+        hash = (hash ^ (uint8_t)*s++) * 16777619u;
+    }
+    return hash;
+}
+
+static struct counter *counters_get(struct counters *table, const char *key) {
+    if (table->count * 2 >= table->capacity) {
+        struct counters grown = { 0 };
+        grown.capacity = table->capacity ? table->capacity * 2 : 1024;
+        grown.entries = calloc(grown.capacity, sizeof(struct counter));
+        if (grown.entries == NULL) {
+            log_error("Unable to grow sampler table\n");
+            exit(EXIT_FAILURE);
+        }
+
+        for (uint32_t i = 0; i < table->capacity; i++) {
+            struct counter *old = &table->entries[i];
+            if (old->key == NULL) {
+                continue;
+            }
+
+            uint32_t slot = hash_string(old->key) & (grown.capacity - 1);
+            while (grown.entries[slot].key != NULL) {
+                slot = (slot + 1) & (grown.capacity - 1);
+            }
+            grown.entries[slot] = *old;
+            grown.count++;
+        }
+
+        free(table->entries);
+        *table = grown;
+    }
+
+    uint32_t slot = hash_string(key) & (table->capacity - 1);
+    while (table->entries[slot].key != NULL) {
+        if (strcmp(table->entries[slot].key, key) == 0) {
+            return &table->entries[slot];
+        }
+        slot = (slot + 1) & (table->capacity - 1);
+    }
+
+    struct counter *counter = &table->entries[slot];
+    counter->key = malloc(strlen(key) + 1);
+    if (counter->key == NULL) {
+        log_error("Unable to allocate sampler key\n");
+        exit(EXIT_FAILURE);
+    }
+    strcpy(counter->key, key);
+    table->count++;
+
+    return counter;
+}
+
+static void counters_free(struct counters *table) {
+    for (uint32_t i = 0; i < table->capacity; i++) {
+        free(table->entries[i].key);
+    }
+    free(table->entries);
+    memset(table, 0, sizeof(*table));
+}
+
+
+static void add_symbol(uint16_t address, uint32_t size, const char *name) {
+    if (name[0] == '@' || name[0] == '\0') {
+        return;
+    }
+
+    struct symbol *symbols = realloc(profiler.symbols, (profiler.symbol_count + 1) * sizeof(struct symbol));
+    if (symbols == NULL) {
+        log_error("Unable to allocate symbol table\n");
+        exit(EXIT_FAILURE);
+    }
+    profiler.symbols = symbols;
+
+    struct symbol *symbol = &profiler.symbols[profiler.symbol_count++];
+    symbol->address = address;
+    symbol->size = size;
+    snprintf(symbol->name, sizeof(symbol->name), "%s", name);
+}
+
+static int compare_symbols(const void *a, const void *b) {
+    const struct symbol *symbol_a = a;
+    const struct symbol *symbol_b = b;
+
+    if (symbol_a->address != symbol_b->address) {
+        return symbol_a->address - symbol_b->address;
+    }
+
+    // Prefer sized scopes over bare labels at the same address
+    return (symbol_b->size > 0) - (symbol_a->size > 0);
+}
+
+// Finds 'key=' in a comma separated ld65 debug info record
+static const char *dbg_field(const char *line, const char *key) {
+    size_t length = strlen(key);
+    for (const char *p = line; (p = strstr(p, key)) != NULL; p++) {
+        if ((p == line || p[-1] == ',' || p[-1] == '\t') && p[length] == '=') {
+            return p + length + 1;
+        }
+    }
+    return NULL;
+}
+
+static void dbg_name(const char *value, char *name) {
+    int i = 0;
+    if (*value == '"') {
+        value++;
+    }
+    while (value[i] != '\0' && value[i] != '"' && value[i] != ',' && value[i] != '\n' && i < SAMPLER_NAME_LENGTH - 1) {
+        name[i] = value[i];
+        i++;
+    }
+    name[i] = '\0';
+}
+
+struct dbg_symbol {
+    long id;
+    long value;
+};
+
+// ld65 --dbgfile: labels come from 'sym' records, .proc sizes from 'scope' records
+static void load_dbg(FILE *f) {
+    char line[1024];
+
+    struct dbg_symbol *labels = NULL;
+    uint32_t label_count = 0;
+
+    while (fgets(line, sizeof(line), f) != NULL) {
+        if (strncmp(line, "sym\t", 4) != 0) {
+            continue;
+        }
+
+        const char *type = dbg_field(line, "type");
+        const char *value = dbg_field(line, "val");
+        const char *id = dbg_field(line, "id");
+        const char *name = dbg_field(line, "name");
+        if (type == NULL || strncmp(type, "lab", 3) != 0 || value == NULL || id == NULL || name == NULL) {
+            continue;
+        }
+
+        char label[SAMPLER_NAME_LENGTH];
+        dbg_name(name, label);
+        add_symbol(strtol(value, NULL, 0), 0, label);
+
+        struct dbg_symbol *grown = realloc(labels, (label_count + 1) * sizeof(struct dbg_symbol));
+        if (grown == NULL) {
+            log_error("Unable to allocate symbol table\n");
+            exit(EXIT_FAILURE);
+        }
+        labels = grown;
+        labels[label_count].id = strtol(id, NULL, 10);
+        labels[label_count].value = strtol(value, NULL, 0);
+        label_count++;
+    }
+
+    rewind(f);
+
+    while (fgets(line, sizeof(line), f) != NULL) {
+        if (strncmp(line, "scope\t", 6) != 0) {
+            continue;
+        }
+
+        const char *name = dbg_field(line, "name");
+        const char *size = dbg_field(line, "size");
+        const char *sym = dbg_field(line, "sym");
+        if (name == NULL || size == NULL || sym == NULL) {
+            continue;
+        }
+
+        long id = strtol(sym, NULL, 10);
+        for (uint32_t i = 0; i < label_count; i++) {
+            if (labels[i].id == id) {
+                char scope[SAMPLER_NAME_LENGTH];
+                dbg_name(name, scope);
+                add_symbol(labels[i].value, strtol(size, NULL, 10), scope);
+                break;
+            }
+        }
+    }
+
+    free(labels);
+}
+
+// VICE labels ('al 00C000 .name'), FCEUX .nl ('$C000#name#') or plain 'C000 name'
+static void load_labels(FILE *f) {
+    char line[1024];
+
+    while (fgets(line, sizeof(line), f) != NULL) {
+        unsigned int address;
+        char name[SAMPLER_NAME_LENGTH];
+
+        if (sscanf(line, "al %x .%63s", &address, name) == 2 ||
+                sscanf(line, "$%x#%63[^#\n]", &address, name) == 2 ||
+                sscanf(line, "$%x %63s", &address, name) == 2 ||
+                sscanf(line, "%x %63s", &address, name) == 2) {
+            add_symbol(address & 0xffff, 0, name);
+        }
+    }
+}
+
+static const struct symbol *find_symbol(uint16_t address) {
+    int low = 0;
+    int high = (int)profiler.symbol_count - 1;
+    const struct symbol *found = NULL;
+
+    while (low <= high) {
+        int middle = (low + high) / 2;
+        if (profiler.symbols[middle].address <= address) {
+            found = &profiler.symbols[middle];
+            low = middle + 1;
+        } else {
+            high = middle - 1;
+        }
+    }
+
+    if (found != NULL && found->size > 0 && address >= found->address + found->size) {
+        return NULL;
+    }
+
+    return found;
+}
+
+static void symbol_name(uint16_t address, char *name) {
+    const struct symbol *symbol = find_symbol(address);
+    if (symbol != NULL) {
+        strcpy(name, symbol->name);
+    } else {
+        snprintf(name, SAMPLER_NAME_LENGTH, "sub_%04X", address);
+    }
+}
+
+// Drops frames whose return address has already been pulled off the 6502 stack
+static void unwind() {
+    while (profiler.depth > 1 && profiler.stack[profiler.depth - 1].s < nes.cpu.s) {
+        profiler.depth--;
+    }
+}
+
+
+bool sampler_open(const char *prefix, uint64_t interval) {
+    profiler.prefix = prefix;
+    profiler.interval = interval > 0 ? interval : 1;
+
+    profiler.stack[0].target = nes.cpu.pc;
+    profiler.stack[0].s = 0xff;
+    profiler.depth = 1;
+
+    sampler.enabled = true;
+    sampler.next = nes.cpu.cycles + profiler.interval;
+
+    return true;
+}
+
+bool sampler_load_symbols(const char *filename) {
+    FILE *f = fopen(filename, "r");
+    if (f == NULL) {
+        logf_warning("Unable to open symbol file %s\n", filename);
+        return false;
+    }
+
+    char line[16] = { 0 };
+    if (fgets(line, sizeof(line), f) != NULL && strncmp(line, "version\t", 8) == 0) {
+        load_dbg(f);
+    } else {
+        rewind(f);
+        load_labels(f);
+    }
+
+    fclose(f);
+
+    qsort(profiler.symbols, profiler.symbol_count, sizeof(struct symbol), compare_symbols);
+    logf_info("Loaded %u symbols from %s\n", profiler.symbol_count, filename);
+
+    return true;
+}
+
+void sampler_push(uint16_t target) {
+    unwind();
+
+    if (profiler.depth < SAMPLER_MAX_DEPTH) {
+        profiler.stack[profiler.depth].target = target;
+        profiler.stack[profiler.depth].s = nes.cpu.s;
+        profiler.depth++;
+    }
+}
+
+void sampler_pop() {
+    unwind();
+}
+
+void sampler_sample() {
+    sampler.next += profiler.interval;
+    profiler.samples++;
+
+    unwind();
+
+    char names[SAMPLER_MAX_DEPTH + 1][SAMPLER_NAME_LENGTH];
+    int count = 0;
+
+    for (int i = 0; i < profiler.depth; i++) {
+        symbol_name(profiler.stack[i].target, names[count++]);
+    }
+
+    // Code reached by JMP or fallthrough is attributed to the label it sits under
+    if (profiler.symbol_count > 0 && find_symbol(nes.cpu.pc) != NULL) {
+        symbol_name(nes.cpu.pc, names[count]);
+        if (strcmp(names[count], names[count - 1]) != 0) {
+            count++;
+        }
+    }
+
+    char key[(SAMPLER_MAX_DEPTH + 1) * SAMPLER_NAME_LENGTH] = "";
+    size_t length = 0;
+    for (int i = 0; i < count; i++) {
+        length += snprintf(key + length, sizeof(key) - length, i == 0 ? "%s" : ";%s", names[i]);
+    }
+    counters_get(&profiler.stacks, key)->self++;
+
+    counters_get(&profiler.functions, names[count - 1])->self++;
+    for (int i = 0; i < count; i++) {
+        bool seen = false;
+        for (int j = 0; j < i; j++) {
+            seen = seen || strcmp(names[i], names[j]) == 0;
+        }
+        if (!seen) {
+            counters_get(&profiler.functions, names[i])->total++;
+        }
+    }
+}
+
+
+static int compare_self(const void *a, const void *b) {
+    const struct counter *counter_a = a;
+    const struct counter *counter_b = b;
+    return (counter_a->self < counter_b->self) - (counter_a->self > counter_b->self);
+}
+
+static void write_flat(const char *filename) {
+    FILE *f = fopen(filename, "w");
+    if (f == NULL) {
+        logf_warning("Unable to write %s\n", filename);
+        return;
+    }
+
+    struct counter *entries = malloc(profiler.functions.count * sizeof(struct counter));
+    uint32_t count = 0;
+    for (uint32_t i = 0; entries != NULL && i < profiler.functions.capacity; i++) {
+        if (profiler.functions.entries[i].key != NULL) {
+            entries[count++] = profiler.functions.entries[i];
+        }
+    }
+    qsort(entries, count, sizeof(struct counter), compare_self);
+
+    fprintf(f, "Samples: %lu every %lu cycles\n\n", profiler.samples, profiler.interval);
+    fprintf(f, "%7s %10s %7s %10s  %s\n", "self%", "self", "total%", "total", "function");
+    for (uint32_t i = 0; i < count; i++) {
+        fprintf(f, "%6.2f%% %10lu %6.2f%% %10lu  %s\n",
+                100.0 * entries[i].self / profiler.samples, entries[i].self,
+                100.0 * entries[i].total / profiler.samples, entries[i].total,
+                entries[i].key);
+    }
+
+    free(entries);
+    fclose(f);
+}
+
+static void write_folded(const char *filename) {
+    FILE *f = fopen(filename, "w");
+    if (f == NULL) {
+        logf_warning("Unable to write %s\n", filename);
+        return;
+    }
+
+    for (uint32_t i = 0; i < profiler.stacks.capacity; i++) {
+        struct counter *counter = &profiler.stacks.entries[i];
+        if (counter->key != NULL) {
+            fprintf(f, "%s %lu\n", counter->key, counter->self);
+        }
+    }
+
+    fclose(f);
+}
+
+void sampler_close() {
+    if (!sampler.enabled) {
+        return;
+    }
+
+    char filename[1024];
+
+    snprintf(filename, sizeof(filename), "%s.txt", profiler.prefix);
+    write_flat(filename);
+
+    snprintf(filename, sizeof(filename), "%s.folded", profiler.prefix);
+    write_folded(filename);
+
+    logf_info("Wrote guest profile of %lu samples to %s.txt and %s.folded\n", profiler.samples, profiler.prefix, profiler.prefix);
+
+    counters_free(&profiler.stacks);
+    counters_free(&profiler.functions);
+    free(profiler.symbols);
+    profiler.symbols = NULL;
+    profiler.symbol_count = 0;
+
+    sampler.enabled = false;
+    sampler.next = UINT64_MAX;
+}
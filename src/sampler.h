@@ -0,0 +1,31 @@
+#ifndef SAMPLER_H
+#define SAMPLER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Guest sampling profiler: every N CPU cycles the guest PC is attributed to
+// the function on top of a shadow call stack maintained from JSR, RTS, RTI
+// and interrupts. Functions are named from ld65 .dbg files or label files.
+
+struct sampler {
+    bool enabled;
+
+    // Cycle count at which run_frame() takes the next sample, UINT64_MAX when disabled
+    uint64_t next;
+};
+
+extern struct sampler sampler;
+
+#define sampler_call(target) do { if (sampler.enabled) sampler_push(target); } while (0)
+#define sampler_return() do { if (sampler.enabled) sampler_pop(); } while (0)
+
+bool sampler_open(const char *prefix, uint64_t interval);
+bool sampler_load_symbols(const char *filename);
+void sampler_close();
+
+void sampler_push(uint16_t target);
+void sampler_pop();
+void sampler_sample();
+
+#endif
@@ -0,0 +1,177 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "nes.h"
+#include "hash.h"
+#include "statehash.h"
+
+
+struct state_hash state_hash = { 0 };
+
+const char *STATE_HASH_PART_STRING[] = {
+    [HASH_CPU]     = "cpu",
+    [HASH_RAM]     = "ram",
+    [HASH_PRG_RAM] = "prg_ram",
+    [HASH_DEVICES] = "devices",
+};
+
+// One line of a recorded file: <frame> <cpu> <ram> <prg_ram> <devices>
+struct recorded_frame {
+    uint64_t frame;
+    uint64_t parts[HASH_PARTS];
+};
+
+struct {
+    // Pages are numbered like the bits of dirty_pages
+    uint64_t pages[DIRTY_PAGES];
+
+    FILE *record;
+    FILE *check;
+
+    // The next line of the checked file, read ahead until it catches up with the frame
+    struct recorded_frame expected;
+    bool have_expected;
+    bool diverged;
+} hasher = { 0 };
+
+
+void state_hash_open() {
+    if (state_hash.enabled) return;
+
+    state_hash.enabled = true;
+    state_hash.rolling = 0;
+    track_dirty_pages(DIRTY_STATE_HASH, true);
+    state_hash_update();
+}
+
+void state_hash_close() {
+    if (hasher.record != NULL) {
+        fclose(hasher.record);
+        hasher.record = NULL;
+    }
+
+    if (hasher.check != NULL) {
+        fclose(hasher.check);
+        hasher.check = NULL;
+    }
+
+    if (state_hash.enabled) {
+        track_dirty_pages(DIRTY_STATE_HASH, false);
+        state_hash.enabled = false;
+    }
+}
+
+bool state_hash_record(const char *filename) {
+    hasher.record = fopen(filename, "w");
+    if (hasher.record == NULL) {
+        logf_error("Unable to open state hash file %s\n", filename);
+        return false;
+    }
+
+    state_hash_open();
+    return true;
+}
+
+bool state_hash_check(const char *filename) {
+    hasher.check = fopen(filename, "r");
+    if (hasher.check == NULL) {
+        logf_error("Unable to open state hash file %s\n", filename);
+        return false;
+    }
+
+    hasher.have_expected = false;
+    hasher.diverged = false;
+    state_hash_open();
+    return true;
+}
+
+
+uint64_t state_hash_update() {
+    uint64_t written = take_dirty_pages(DIRTY_STATE_HASH);
+    for (int index = 0; index < DIRTY_PAGES; index++) {
+        if (written & 1ull << index) {
+            hasher.pages[index] = hash_bytes(dirty_page_memory(index), 256, index);
+        }
+    }
+
+    // Fields one by one, struct padding is not state
+    uint8_t cpu[7 + 2 * sizeof(uint64_t)] = { nes.cpu.pc & 0xff, nes.cpu.pc >> 8, nes.cpu.a, nes.cpu.x, nes.cpu.y, nes.cpu.s, nes.cpu.p };
+    memcpy(cpu + 7, &nes.cpu.cycles, sizeof(uint64_t));
+    memcpy(cpu + 7 + sizeof(uint64_t), &state.frames, sizeof(uint64_t));
+
+    const struct ppu *ppu = &nes.ppu;
+    uint8_t devices[17 + sizeof(uint64_t)] = {
+        nes.controllers[0].buttons, nes.controllers[0].shift,
+        nes.controllers[1].buttons, nes.controllers[1].shift,
+        nes.controller_strobe, ppu->nmi_occured, ppu->nmi_enabled,
+        ppu->ctrl, ppu->mask, ppu->oam_address, ppu->latch, ppu->read_buffer,
+        ppu->fine_x | ppu->w << 3, ppu->v & 0xff, ppu->v >> 8, ppu->t & 0xff, ppu->t >> 8,
+    };
+    // PPU memory through its page hashes, like RAM
+    uint64_t ppu_memory = hash_bytes(hasher.pages + PPU_DIRTY_PAGE, (DIRTY_PAGES - PPU_DIRTY_PAGE) * sizeof(uint64_t), HASH_DEVICES);
+    memcpy(devices + 17, &ppu_memory, sizeof(ppu_memory));
+
+    state_hash.parts[HASH_CPU] = hash_bytes(cpu, sizeof(cpu), HASH_CPU);
+    state_hash.parts[HASH_RAM] = hash_bytes(hasher.pages, 8 * sizeof(uint64_t), HASH_RAM);
+    state_hash.parts[HASH_PRG_RAM] = hash_bytes(hasher.pages + 8, (PPU_DIRTY_PAGE - 8) * sizeof(uint64_t), HASH_PRG_RAM);
+    state_hash.parts[HASH_DEVICES] = hash_bytes(devices, sizeof(devices), HASH_DEVICES);
+
+    state_hash.current = hash_bytes(state_hash.parts, sizeof(state_hash.parts), 0);
+    return state_hash.current;
+}
+
+static bool read_expected() {
+    struct recorded_frame *line = &hasher.expected;
+    unsigned long frame, parts[HASH_PARTS];
+
+    if (fscanf(hasher.check, "%lu %lx %lx %lx %lx", &frame, &parts[0], &parts[1], &parts[2], &parts[3]) != 5) {
+        return false;
+    }
+
+    line->frame = frame;
+    for (int part = 0; part < HASH_PARTS; part++) {
+        line->parts[part] = parts[part];
+    }
+
+    hasher.have_expected = true;
+    return true;
+}
+
+// Frames missing from the file are skipped, only the first divergence is logged
+static void check_frame() {
+    while (!hasher.have_expected || hasher.expected.frame < state.frames) {
+        if (!read_expected()) {
+            logf_info("State hash file ends before frame %lu\n", state.frames);
+            fclose(hasher.check);
+            hasher.check = NULL;
+            return;
+        }
+    }
+
+    if (hasher.expected.frame != state.frames) {
+        return;
+    }
+
+    for (int part = 0; part < HASH_PARTS; part++) {
+        if (hasher.expected.parts[part] != state_hash.parts[part]) {
+            logf_error("State diverged at frame %lu in %s: expected %016lx, got %016lx\n",
+                    state.frames, STATE_HASH_PART_STRING[part], hasher.expected.parts[part], state_hash.parts[part]);
+            hasher.diverged = true;
+        }
+    }
+}
+
+void state_hash_end_frame() {
+    state_hash_update();
+    state_hash.rolling = hash_bytes(&state_hash.current, sizeof(state_hash.current), state_hash.rolling);
+
+    if (hasher.record != NULL) {
+        fprintf(hasher.record, "%lu %016lx %016lx %016lx %016lx\n", state.frames,
+                state_hash.parts[HASH_CPU], state_hash.parts[HASH_RAM], state_hash.parts[HASH_PRG_RAM], state_hash.parts[HASH_DEVICES]);
+    }
+
+    if (hasher.check != NULL && !hasher.diverged) {
+        check_frame();
+    }
+}
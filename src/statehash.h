@@ -0,0 +1,48 @@
+#ifndef STATEHASH_H
+#define STATEHASH_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Hash of the whole machine, brought up to date at the end of every frame. Only the RAM
+// and PRG RAM pages written since the last update are hashed again, found through dirty
+// page tracking, so it is cheap enough to leave on. Every frame's hashes can be recorded,
+// and a later run checked against them logs the first frame and subsystem that differ.
+
+enum state_hash_part {
+    HASH_CPU,
+    HASH_RAM,
+    HASH_PRG_RAM,
+    HASH_DEVICES,
+    HASH_PARTS,
+};
+
+extern const char *STATE_HASH_PART_STRING[];
+
+struct state_hash {
+    bool enabled;
+
+    uint64_t parts[HASH_PARTS];
+
+    // The state as of the last update, and that chained over every frame since opening
+    uint64_t current;
+    uint64_t rolling;
+};
+
+extern struct state_hash state_hash;
+
+#define state_hash_frame() do { if (state_hash.enabled) state_hash_end_frame(); } while (0)
+
+void state_hash_open();
+void state_hash_close();
+
+// Writes one line per frame, or compares each frame with such a file
+bool state_hash_record(const char *filename);
+bool state_hash_check(const char *filename);
+
+// Brings the hash up to date now, for callers that check between frames
+uint64_t state_hash_update();
+
+void state_hash_end_frame();
+
+#endif
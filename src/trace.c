@@ -0,0 +1,161 @@
+#define _POSIX_C_SOURCE 199309L
+
+#include <signal.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+#include "nes.h"
+#include "trace.h"
+
+
+// Seven events a frame, six spans and the frame itself, so about 40 minutes at 60Hz
+#define TRACE_CAPACITY (1 << 20)
+
+// 1.5 NTSC frame periods of 16639267ns. A frame paced by vsync lasts a period or a little
+// more, one taking this long missed its vblank and is marked as a stall.
+const uint64_t TRACE_STALL_NS = 24958900;
+
+
+struct trace_event {
+    const char *name;
+    char phase;
+    uint64_t start;
+    uint64_t duration;
+    uint64_t arg;
+};
+
+struct {
+    bool enabled;
+    const char *filename;
+
+    uint64_t origin;
+
+    struct trace_event *events;
+    uint64_t count;
+
+    volatile sig_atomic_t dump_requested;
+} trace = { 0 };
+
+
+static uint64_t trace_now() {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (uint64_t)t.tv_sec * 1000000000 + t.tv_nsec;
+}
+
+static void trace_push(const char *name, char phase, uint64_t start, uint64_t duration, uint64_t arg) {
+    struct trace_event *event = &trace.events[trace.count++ % TRACE_CAPACITY];
+    event->name = name;
+    event->phase = phase;
+    event->start = start;
+    event->duration = duration;
+    event->arg = arg;
+}
+
+static void trace_request_dump(int signal) {
+    trace.dump_requested = 1;
+}
+
+static void trace_write() {
+    FILE *f = fopen(trace.filename, "w");
+    if (f == NULL) {
+        logf_warning("Unable to write trace to %s\n", trace.filename);
+        return;
+    }
+
+    uint64_t first = trace.count > TRACE_CAPACITY ? trace.count - TRACE_CAPACITY : 0;
+
+    fprintf(f, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    fprintf(f, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":1,\"args\":{\"name\":\"emulation\"}}");
+
+    for (uint64_t i = first; i < trace.count; i++) {
+        const struct trace_event *event = &trace.events[i % TRACE_CAPACITY];
+        double ts = (event->start - trace.origin) / 1e3;
+
+        if (event->phase == 'X') {
+            fprintf(f, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":1,\"tid\":1,\"args\":{\"frame\":%lu}}",
+                    event->name, ts, event->duration / 1e3, event->arg);
+        } else {
+            fprintf(f, ",\n{\"name\":\"%s\",\"ph\":\"i\",\"s\":\"t\",\"ts\":%.3f,\"pid\":1,\"tid\":1,\"args\":{\"value\":%lu}}",
+                    event->name, ts, event->arg);
+        }
+    }
+
+    fprintf(f, "\n],\"otherData\":{\"dropped_events\":%lu}}\n", first);
+    fclose(f);
+
+    logf_info("Wrote %lu trace events to %s\n", trace.count - first, trace.filename);
+}
+
+
+bool trace_open(const char *filename) {
+    trace.events = malloc(TRACE_CAPACITY * sizeof(struct trace_event));
+    if (trace.events == NULL) {
+        log_warning("Unable to allocate trace buffer\n");
+        return false;
+    }
+
+    trace.filename = filename;
+    trace.origin = trace_now();
+    trace.count = 0;
+    trace.enabled = true;
+
+    struct sigaction action = { 0 };
+    action.sa_handler = trace_request_dump;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGUSR1, &action, NULL);
+
+    return true;
+}
+
+void trace_close() {
+    if (!trace.enabled) {
+        return;
+    }
+
+    trace_write();
+
+    free(trace.events);
+    trace.events = NULL;
+    trace.enabled = false;
+}
+
+uint64_t trace_begin() {
+    return trace.enabled ? trace_now() : 0;
+}
+
+void trace_end(const char *name, uint64_t start) {
+    if (!trace.enabled) {
+        return;
+    }
+
+    trace_push(name, 'X', start, trace_now() - start, state.frames);
+}
+
+void trace_instant(const char *name, uint64_t arg) {
+    if (!trace.enabled) {
+        return;
+    }
+
+    trace_push(name, 'i', trace_now(), 0, arg);
+}
+
+void trace_end_frame(uint64_t start) {
+    if (!trace.enabled) {
+        return;
+    }
+
+    uint64_t duration = trace_now() - start;
+    trace_push("frame", 'X', start, duration, state.frames);
+
+    if (duration > TRACE_STALL_NS) {
+        trace_instant("stall", duration / 1000);
+    }
+
+    if (trace.dump_requested) {
+        trace.dump_requested = 0;
+        trace_write();
+    }
+}
@@ -0,0 +1,20 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Chrome/Perfetto trace-event timeline. Events go into a fixed-size ring
+// buffer in memory and are written out at exit or on SIGUSR1.
+
+bool trace_open(const char *filename);
+void trace_close();
+
+// Returns the current timestamp, or 0 when tracing is disabled
+uint64_t trace_begin();
+void trace_end(const char *name, uint64_t start);
+void trace_instant(const char *name, uint64_t arg);
+
+void trace_end_frame(uint64_t start);
+
+#endif
@@ -0,0 +1,73 @@
+#define _DEFAULT_SOURCE
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include "workers.h"
+
+
+void *workers_shared(size_t size) {
+    void *memory = mmap(NULL, size > 0 ? size : 1, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (memory == MAP_FAILED) {
+        fprintf(stderr, "Unable to map shared worker memory\n");
+        exit(EXIT_FAILURE);
+    }
+    return memory;
+}
+
+void workers_run(int count, int jobs, bool quiet, void (*job)(int index, void *context), void *context, int *statuses) {
+    if (jobs <= 0) {
+        jobs = sysconf(_SC_NPROCESSORS_ONLN);
+    }
+
+    pid_t *pids = calloc(count + 1, sizeof(pid_t));
+    if (pids == NULL) {
+        fprintf(stderr, "Unable to allocate worker table\n");
+        exit(EXIT_FAILURE);
+    }
+
+    fflush(stdout);
+    fflush(stderr);
+
+    int next = 0, running = 0;
+
+    while (next < count || running > 0) {
+        if (next < count && running < jobs) {
+            pid_t pid = fork();
+            if (pid == 0) {
+                if (quiet) {
+                    int null = open("/dev/null", O_WRONLY);
+                    dup2(null, STDOUT_FILENO);
+                    dup2(null, STDERR_FILENO);
+                }
+
+                job(next, context);
+                fflush(stdout);
+                _exit(EXIT_SUCCESS);
+            }
+
+            pids[next++] = pid;
+            running += pid > 0;
+            continue;
+        }
+
+        int status;
+        pid_t pid = wait(&status);
+        if (pid < 0) {
+            break;
+        }
+        running--;
+
+        for (int i = 0; i < next; i++) {
+            if (pids[i] == pid) {
+                statuses[i] = status;
+            }
+        }
+    }
+
+    free(pids);
+}
@@ -0,0 +1,17 @@
+#ifndef WORKERS_H
+#define WORKERS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// Process pool for headless tools. The core keeps its state in globals, so
+// every job runs in its own forked child and reports back through memory
+// obtained from workers_shared().
+
+void *workers_shared(size_t size);
+
+// Runs job(index, context) for every index with at most 'jobs' children at a
+// time (0 means one per online CPU). statuses[index] receives the wait status.
+void workers_run(int count, int jobs, bool quiet, void (*job)(int index, void *context), void *context, int *statuses);
+
+#endif